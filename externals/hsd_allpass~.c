@@ -51,9 +51,10 @@
 
 #include "m_pd.h"
 #include "math.h"
+#include "hsd_library.h"
 
 /* defaults */
-#define DELMAX 100
+#define DELMAX 100  //default maximum delay time in ms
 
 /* data struct */
 typedef struct _hsd_allpass{
@@ -64,14 +65,11 @@ typedef struct _hsd_allpass{
     /* sample rate */
     t_float sr;
     
-    /* the length of the complete delay-line in samples. the maximum delay time is defined by DELMAX 100 milliseconds, therefore the delayline is always allocated with enough samples to store 100ms of audio. this value is always in dependance of the samplerate and has to be recalculated when the sample rate changes */
-    t_float delay_line_length;
+    /* the delay-line: the pointer to the ring-buffer, its length in samples (always a power of two) and in bytes, and the current position of the write-pointer. the write-pointer is incremented with every sample-tick in the dsp-loop. it indicates the position, where the input is written to the delay-line. (see hsd_library.h) */
+    t_hsd_delayline delay_line;
     
-    /* the length of the delay-line in bytes. it is proportional to delay_line_length, which is just mulitplied by the byte-size of a float variable. it is important to store the bytes, because when the object is destroyed at the end of runtime, the allocated memory has to be freed again */
-    t_int delay_bytes;
-    
-    /* the pointer to the delay-line itself. when the memory of the delay-line is allocated, a pointer to this memory (to the first entry) is returned and stored in this variable. */
-    t_float *delay_line;
+    /* the maximum delay time in ms, set by creation argument. the delay-line is only allocated as long as the current delay time needs it, but it may grow up to this length */
+    t_float max_delay_ms;
     
     /* the paramter that is set from outside and indicates the time the audio-signal is delayed. this value needs to be converted to the amount of samples needed for delay_length (NOT delay-line length) to determine the displacement between read- and write pointer*/
     t_float delay_time_ms;
@@ -79,9 +77,6 @@ typedef struct _hsd_allpass{
     /* this is the real amount of delay. it determines the displacement between the read- and writepointer and therefore the amount of delayed samples. note that this is a float value, because some millisecond-values can result in noninteger sample-values. in this case an interpolation is necessary (as done in the perform routine) */
     t_float delay_length;
     
-    /* the current position of the write-pointer. it is incremented with every sample-tick in the dsp-loop. it indicates the position, where the input is written to the delay-line. */
-    t_int write_index;
-    
     /* the current position of the read-pointer. it "follows" the write pointer skimming thorugh the delay-line with a displacement of delay_length. this displacement is achieved by subtracting the delay_length from the write-pointer */
     t_int read_index;
 
@@ -100,6 +95,7 @@ void *hsd_allpass_new (t_symbol *s, short argc, t_atom *argv);
 void hsd_allpass_dsp(t_hsd_allpass *x, t_signal **sp);
 t_int *hsd_allpass_perform(t_int *w);
 void hsd_allpass_free(t_hsd_allpass *x);
+void hsd_allpass_stats(t_hsd_allpass *x);
 void hsd_allpass_delaytime(t_hsd_allpass *x, t_floatarg f);
 void hsd_allpass_gain(t_hsd_allpass *x, t_floatarg f);
 void hsd_allpass_bang(t_hsd_allpass *x);
@@ -112,10 +108,17 @@ void hsd_allpass_delaytime(t_hsd_allpass *x, t_floatarg f){
     t_float delay_time_ms = f;
     
     // sanity checking
-    if(delay_time_ms > DELMAX || delay_time_ms <=0.0){
+    if(delay_time_ms > x->max_delay_ms || delay_time_ms <=0.0){
         error("hsd_allpass~: illegal delay time: %f. delay time set to 10ms", delay_time_ms);
         delay_time_ms=10.0;
     }
+    
+    // let the delay-line grow, if it is too short for the new delay time
+    if(!hsd_delayline_grow(&x->delay_line, hsd_delayline_samples(x->sr, delay_time_ms))){
+        error("hsd_allpass~: cannot allocate memory for a delay time of %f ms", delay_time_ms);
+        return;
+    }
+    
     // calculating the needed samples from the millisecond-value
     x->delay_length = x->sr * delay_time_ms/1000;
     x->delay_time_ms = delay_time_ms;
@@ -139,49 +142,38 @@ void hsd_allpass_gain(t_hsd_allpass *x, t_floatarg f){
 /* function for clearing the delay-line */
 void hsd_allpass_bang(t_hsd_allpass *x){
     
-    int i;
-    // set all values of the delay line to zero
-    for (i=0; i<x->delay_line_length; i++) {
-        x->delay_line[i] =0.0;
-    }
-    // reset the write pointer
-    x->write_index = 0;
+    // set all values of the delay line to zero and reset the write pointer
+    hsd_delayline_clear(&x->delay_line);
+    
+}
+
+
+/* prints how much memory the delay-lines of the whole library take, executed when a "stats" message is received */
+void hsd_allpass_stats(t_hsd_allpass *x){
+    
+    hsd_arena_stats("hsd_allpass~");
     
 }
 
 // DSP-init routine
 void hsd_allpass_dsp(t_hsd_allpass *x, t_signal **sp)
 {
-    
-    
     /* check for sample rate change and recalculate the delay-line, if necessary */
     if(x->sr != sp[0]->s_sr){
         
-        int i;
-        
-        /* store the size of the delay-line. if the length of the delay-line needs to be changed, you need the new size and the old size */
-        int oldbytes = x->delay_bytes;
-        
         /* store the new sample rate */
         x->sr = sp[0]->s_sr;
         
-        /* reallocate the delay-line. this process is similar to the one in the new-instance-routine except the function "resizebytes()" instead of "getbytes()" */
-        int delay_line_length = (int)(x->sr * DELMAX/1000 + 1);
-        x->delay_bytes = (int)(delay_line_length * sizeof(t_float));
-        x->delay_line = (t_float*)resizebytes((void*)x->delay_line,oldbytes, x->delay_bytes);
-        if(x->delay_line == NULL){
-            error("hsd_allpass~: cannot reallocate %ld bytes of memory", x->delay_bytes);
+        /* the delay-line needs more samples for the same delay time at a higher sample rate. the old content doesn´t fit to the new sample rate anyway, so the delay-line is reset instead of grown: it is cleared with a single memset or replaced by a fresh (already zeroed) one, nothing is copied */
+        if(!hsd_delayline_reset(&x->delay_line, hsd_delayline_samples(x->sr, x->delay_time_ms))){
+            error("hsd_allpass~: cannot reallocate the delay-line");
+            // the old delay-line is gone: forget the sample rate, so the next DSP start tries again instead of running without delay-line
+            x->sr = 0;
             return;
         }
-        for (i=0; i<delay_line_length; i++) {
-            x->delay_line[i] =0.0;
-        }
-        x->delay_line_length = delay_line_length;
         
         //renew the offset between read and write pointer
         x->delay_length = x->sr * x->delay_time_ms/1000 + 1;
-        
-        x->write_index = 0;
     }
     
     /* add the objects signal processing to the signal-chain of puredata */
@@ -205,9 +197,10 @@ t_int *hsd_allpass_perform(t_int *w)
     t_int n = w[4];                                     //buffer-size
     
     /* get needed data from data struct */
-    t_float *delay_line = x->delay_line;
+    t_float *delay_line = x->delay_line.buffer;
     t_int read_index = x->read_index;
-    t_int write_index = x->write_index;
+    t_int write_index = x->delay_line.write_index;
+    t_int mask = x->delay_line.mask;
     t_float delay_length = x->delay_length;
     t_float g = x->g;
     
@@ -242,15 +235,12 @@ t_int *hsd_allpass_perform(t_int *w)
         // calculate the factor for interpolation
         fraction = delay_length - idelay;
         
-        //set the offset between read & write-pointer. wrap it into legal space if needed
-        read_index = write_index - idelay;
-        while (read_index < 0) {
-            read_index += delay_length;
-        }
+        //set the offset between read & write-pointer. wrap it into legal space (the length of the delay-line is a power of two, so a bitwise AND with the mask does the wrapping)
+        read_index = (write_index - idelay) & mask;
         
         // read the two samples
         samp1 = delay_line[read_index];
-        samp2 = delay_line[(read_index + 1) % idelay]; //(if the read_index is at the end of the array, (read_index+1) has to be wrapped into legal space (beginning of the array) again )
+        samp2 = delay_line[(read_index + 1) & mask]; //(if the read_index is at the end of the array, (read_index+1) has to be wrapped into legal space (beginning of the array) again )
         
         //quick buffer delayline-output before reading the input sample, so in case of shared input- and output-buffers, the input sample won´t be the recent written output-sample
         out_sample = samp1 + fraction* (samp2- samp1);
@@ -259,19 +249,17 @@ t_int *hsd_allpass_perform(t_int *w)
         xDL = *input++ + out_sample * g;
         
         // write the input of the delay line
-        delay_line[write_index++] = xDL;
+        delay_line[write_index] = xDL;
         
         //output y(n) = yDL + FF
         *output++ = out_sample + (-g * xDL);
         
-        //reset the write_index
-        if(write_index >= delay_length){
-            write_index -= delay_length;
-        }
+        //increment and wrap the write_index
+        write_index = (write_index + 1) & mask;
         
     }
     
-    x->write_index = write_index;
+    x->delay_line.write_index = write_index;
     
   
     return w+5;
@@ -282,7 +270,7 @@ t_int *hsd_allpass_perform(t_int *w)
 /* free function that is called when the object is destroyed */
 void hsd_allpass_free(t_hsd_allpass *x)
 {
-    freebytes(x->delay_line, x->delay_bytes);
+    hsd_delayline_free(&x->delay_line);
 }
 
 
@@ -293,6 +281,7 @@ void *hsd_allpass_new(t_symbol *s, short argc, t_atom *argv)
     // set default values
     t_float g=0.1;
     t_float delay_time_ms=30;
+    t_float max_delay_ms=0;
     
     t_hsd_allpass *x = (t_hsd_allpass *)pd_new(hsd_allpass_class);
     
@@ -309,6 +298,9 @@ void *hsd_allpass_new(t_symbol *s, short argc, t_atom *argv)
     
     
     /* getting creation arguments */
+    if (argc>=3) {
+        max_delay_ms = atom_getfloatarg(2, argc, argv);
+    }
     if (argc>=2) {
         g  = atom_getfloatarg(1, argc, argv);
     }
@@ -321,7 +313,10 @@ void *hsd_allpass_new(t_symbol *s, short argc, t_atom *argv)
         g = 1;
     }
     
-    if(delay_time_ms > DELMAX || delay_time_ms<=0.0){
+    // the maximum delay time (default DELMAX)
+    x->max_delay_ms = hsd_maxdelay(max_delay_ms, DELMAX, delay_time_ms);
+    
+    if(delay_time_ms > x->max_delay_ms || delay_time_ms<=0.0){
         error("hsd_allpass~: illegal delay time: %f. delay time set to 10ms", delay_time_ms);
         delay_time_ms=10.0;
     }
@@ -329,22 +324,13 @@ void *hsd_allpass_new(t_symbol *s, short argc, t_atom *argv)
     x->delay_length = x->sr * delay_time_ms/1000 + 1;
     
     
-    /* Allocating the DelayLine */
-    int delay_line_length = (int)(x->sr * DELMAX/1000 + 1);
-    x->delay_bytes = (int)(delay_line_length * sizeof(t_float));
-    x->delay_line = (t_float*)getbytes(x->delay_bytes);
-    if(x->delay_line == NULL){
-        error("hsd_allpass~: cannot allocate %d bytes of memory", x->delay_bytes);
+    /* Allocating the DelayLine, just long enough for the initial delay time */
+    if(!hsd_delayline_grow(&x->delay_line, hsd_delayline_samples(x->sr, delay_time_ms))){
+        error("hsd_allpass~: cannot allocate memory for the delay-line");
         return NULL;
     }
-    int i;
-    for (i=0; i<delay_line_length; i++) {
-        x->delay_line[i] =0.0;
-    }
     
-    x->delay_line_length = delay_line_length;
     x->g = g;
-    x->write_index=0;
     
     return x;
 }
@@ -380,6 +366,11 @@ void hsd_allpass_tilde_setup(void){
                     0);
     class_addbang(hsd_allpass_class, hsd_allpass_bang);
     
+    class_addmethod(hsd_allpass_class,
+                    (t_method)hsd_allpass_stats,
+                    gensym("stats"),
+                    0);
+    
     
     post ("hsd_allpass~ by David Bau, University of Applied Sciences Duessldorf");
     
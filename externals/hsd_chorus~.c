@@ -50,13 +50,53 @@
  
  Note that many parameters had to be doubled to be used for both channels. This is the reason for the length of the code.
  
+ 
+ Voices
+ 
+ For ensemble effects (like the "string machines" of the 70s), each channel can have up to HSD_CHORUS_MAX_VOICES voices (sixth creation argument or message "voices"). All voices of a channel read from the same delay-line with their own, modulated delay, so more voices don´t need more memory. The LFOs of the voices have the same frequency, but their phases are spread evenly over one cycle (voice k of N is shifted by k/N * 360°, the right channel again by 90° more). The output of a channel is the mean of its voices.
+ 
+ The LFOs of all voices are not calculated with one sin() per voice. There is only one oscillator, and the sine and cosine of its phase (theta) are calculated once per sample. the LFO of every voice then follows from the addition theorem:
+ 
+        sin(theta + offset) = sin(theta) * cos(offset) + cos(theta) * sin(offset)
+        sin(theta + offset + 90°) = cos(theta + offset) = cos(theta) * cos(offset) - sin(theta) * sin(offset)
+ 
+ cos(offset) and sin(offset) of every voice are constant and calculated when the number of voices is set. so the LFOs of all voices cost two multiplications and one addition each, in a short loop over the voices that the compiler can calculate with SIMD instructions. with one voice (the default) the chorus sounds the same as before.
+ 
+ 
+ The interleaved delay-line
+ 
+ Both channels are written in the same sample-tick, with the same write-pointer. So they don´t have two delay-lines of their own, but share one, in which the samples are stored interleaved, in frames of a left and a right sample:
+ 
+        | L0 R0 | L1 R1 | L2 R2 | ... |
+ 
+ The write-pointer and the mask count frames. Writing the input of both channels touches one cache-line instead of two, and the reads of both channels at nearby delays mostly hit the same cache-lines as well. The delay-line is as long as the longer of the two depths needs it. hsd_delayline_read_interleaved() (see hsd_library.h) reads one channel from it.
+ 
+ 
+ Mono input
+ 
+ For mono sources, the same signal would be written into both channels. In mono mode (creation argument "mono" after the numbers, or message "mono 1"), the right signal inlet is ignored and the delay-line holds only one channel (frames of one sample): the taps of the right channel read the same samples as the left ones, with their own depth and the 90° shifted LFO. So a mono chorus needs half the memory and only writes one sample per sample-tick. The dry signal of both outputs is the left input. Switching between mono and stereo clears the delay-line.
+ 
+ 
+ External modulation
+ 
+ With the creation argument "external" (after the numbers, before or after "mono"), the object gets another signal inlet on the right, and the internal LFO is switched off. The signal at this inlet (0...1) replaces the LFO: 0 is the shortest delay, 1 is the full depth. The right channel follows the inverted modulation (1 - modulation), as there is no way to shift an arbitrary signal by 90°. Like this, the chorus can be driven by any modulation (tempo-synced, random, envelopes), and many choruses can share one modulation oscillator instead of calculating the same sine and cosine each. The voices need the phase of the LFO for their offsets, so in this mode the chorus always runs with one voice per channel. The modulation signal is clipped to 0...1, so it can´t read outside the delay-line. The frequency inlet has no effect in this mode.
+ 
+ 
+ Shared LFO
+ 
+ With the message "lfo <name> <offset>", the chorus doesn´t calculate its own oscillator anymore, but uses the LFO group <name> together with other hsd_chorus~ and hsd_vibrato~ objects. The group calculates the sine and cosine only once per DSP tick for all members, the chorus shifts them by its own phase offset (in cycles, 0...1) with the addition theorem, before the voices are calculated from them as usual. The frequency inlet then sets the frequency of the whole group. "lfo" without a name switches back to the own oscillator. (see hsd_library.h)
+ 
  */
 
 #include "m_pd.h"
 #include "math.h"
+#include "hsd_library.h"
 
 /* defaults */
-#define DELMAX 40
+#define DELMAX 40  //default maximum depth in ms
+
+/* the maximum number of voices per channel */
+#define HSD_CHORUS_MAX_VOICES 8
 
 #define PI 3.1415926536
 
@@ -69,23 +109,32 @@ typedef struct _hsd_chorus{
     /* sample rate */
     t_float sr;
     
-    /* the length of the complete delay-line in samples. the maximum delay time is defined by DELMAX 100 milliseconds, therefore the delayline is always allocated with enough samples to store 100ms of audio. this value is always in dependance of the samplerate and has to be recalculated when the sample rate changes */
-    t_float delay_line_length;
+    /* the interleaved delay-line of both channels: the pointer to the ring-buffer, its length in samples (always a power of two) and in bytes, and the current position of the write-pointer. length and write-pointer count samples, a frame of both channels takes two of them. the write-pointer is incremented with every sample-tick in the dsp-loop. it indicates the position, where the input is written to the delay-line. (see hsd_library.h) */
+    t_hsd_delayline delay_line;
+    
+    /* 1 in mono mode: the delay-line holds only one channel, the right channel reads from it as well */
+    int mono;
+    
+    /* 1 if the modulation comes from the additional signal inlet instead of the LFO (creation argument "external") */
+    int external;
     
-    /* the length of the delay-line in bytes. it is proportional to delay_line_length, which is just mulitplied by the byte-size of a float variable. it is important to store the bytes, because when the object is destroyed at the end of runtime, the allocated memory has to be freed again */
-    t_int delay_bytes;
+    /* the shared LFO group (NULL, if the own LFO is used), the cosine and sine of the phase offset in the group, and the block size of the last dsp-init-routine */
+    t_hsd_lfo *lfo;
+    t_float lfo_cos, lfo_sin;
+    t_int blocksize;
     
-    /* the pointer to the delay-line itself. when the memory of the delay-line is allocated, a pointer to this memory (to the first entry) is returned and stored in this variable. */
-    t_float *delay_line_l;
-    t_float *delay_line_r;
+    /* the maximum depth in ms, set by the fifth creation argument. the delay-lines are only allocated as long as the current depths need it, but they may grow up to this length */
+    t_float max_depth_ms;
     
-    /* the current position of the write-pointer. it is incremented with every sample-tick in the dsp-loop. it indicates the position, where the input is written to the delay-line. */
-    t_int write_index_l;
-    t_int write_index_r;
+    /* the interpolation mode (HSD_INTERP_LINEAR ...) and the filter states of the allpass interpolation for every voice of both channels, see hsd_library.h */
+    int interpolation;
+    t_float z_alp_l[HSD_CHORUS_MAX_VOICES];
+    t_float z_alp_r[HSD_CHORUS_MAX_VOICES];
     
-    /* the current position of the read-pointer. it "follows" the write pointer skimming thorugh the delay-line with a displacement of delay_length. this displacement is achieved by subtracting the delay_length from the write-pointer */
-    t_int read_index_l;
-    t_int read_index_r;
+    /* the number of voices per channel, and the cosine and sine of the phase offset of every voice */
+    int voices;
+    t_float voice_cos[HSD_CHORUS_MAX_VOICES];
+    t_float voice_sin[HSD_CHORUS_MAX_VOICES];
     
     /* dummy float for CLASS_MAINSIGNALIN */
     t_float x_f;
@@ -121,26 +170,51 @@ void *hsd_chorus_new(t_symbol *s, short argc, t_atom *argv);
 void hsd_chorus_dsp(t_hsd_chorus *x, t_signal **sp);
 t_int *hsd_chorus_perform(t_int *w);
 void hsd_chorus_free(t_hsd_chorus *x);
+void hsd_chorus_stats(t_hsd_chorus *x);
+int hsd_chorus_resize(t_hsd_chorus *x, t_float depth_ms_l, t_float depth_ms_r, int mono, int reset);
 /* prototypes parameter-functions */
 void hsd_chorus_depth_l(t_hsd_chorus *x, t_floatarg f);
 void hsd_chorus_depth_r(t_hsd_chorus *x, t_floatarg f);
 void hsd_chorus_frequency(t_hsd_chorus *x, t_floatarg f);
 void hsd_chorus_drywet(t_hsd_chorus *x, t_floatarg f);
+void hsd_chorus_interpolation(t_hsd_chorus *x, t_symbol *s);
+void hsd_chorus_voices(t_hsd_chorus *x, t_floatarg f);
+void hsd_chorus_mono(t_hsd_chorus *x, t_floatarg f);
+void hsd_chorus_lfo(t_hsd_chorus *x, t_symbol *s, t_floatarg offset);
 
 
+/* makes sure the delay-line is long enough for both depths, with one (mono) or two channels per frame. if "reset" is set, the content is thrown away (sample rate change, switching between mono and stereo), otherwise it is kept. returns 0 if the memory could not be allocated */
+int hsd_chorus_resize(t_hsd_chorus *x, t_float depth_ms_l, t_float depth_ms_r, int mono, int reset){
+    
+    t_int channels = mono ? 1 : 2;
+    t_int frames = hsd_delayline_samples(x->sr, (depth_ms_l > depth_ms_r) ? depth_ms_l : depth_ms_r);
+    
+    // the number of frames is rounded up to a power of two, so the number of samples is one as well
+    if (reset) {
+        return hsd_delayline_reset(&x->delay_line, channels * hsd_nextpow2(frames));
+    }
+    return hsd_delayline_grow(&x->delay_line, channels * hsd_nextpow2(frames));
+}
+
 /* function for setting the modulation depth, called by the third inlet, performs sanity checking */
 void hsd_chorus_depth_l(t_hsd_chorus *x, t_floatarg f){
     
     t_float depth_ms = f;
     
     // sanity checking
-    if(depth_ms > DELMAX){
-        depth_ms=DELMAX;
+    if(depth_ms > x->max_depth_ms){
+        depth_ms=x->max_depth_ms;
         
     }
     if (depth_ms < 0) {
         depth_ms = 0;
     }
+    
+    // let the delay-line grow, if it is too short for the new depth
+    if(!hsd_chorus_resize(x, depth_ms, x->depth_ms_r, x->mono, 0)){
+        error("hsd_chorus~: cannot allocate memory for a depth of %f ms", depth_ms);
+        return;
+    }
     x->depth_ms_l = depth_ms;
     x->depth_l = x->sr * x->depth_ms_l/1000;
     
@@ -152,13 +226,19 @@ void hsd_chorus_depth_r(t_hsd_chorus *x, t_floatarg f){
     t_float depth_ms = f;
     
     // sanity checking
-    if(depth_ms > DELMAX){
-        depth_ms=DELMAX;
+    if(depth_ms > x->max_depth_ms){
+        depth_ms=x->max_depth_ms;
         
     }
     if (depth_ms < 0) {
         depth_ms = 0;
     }
+    
+    // let the delay-line grow, if it is too short for the new depth
+    if(!hsd_chorus_resize(x, x->depth_ms_l, depth_ms, x->mono, 0)){
+        error("hsd_chorus~: cannot allocate memory for a depth of %f ms", depth_ms);
+        return;
+    }
     x->depth_ms_r = depth_ms;
     x->depth_r = x->sr * x->depth_ms_r/1000;
     
@@ -175,6 +255,11 @@ void hsd_chorus_frequency(t_hsd_chorus *x, t_floatarg f){
     }else{
         x->cycle_length = x->sr/frequency;
         x->frequency = frequency;
+        
+        // in an LFO group, the frequency applies to all members
+        if (x->lfo) {
+            x->lfo->frequency = frequency;
+        }
         post("frequency: %f, cycle_length: %f", x->frequency, x->cycle_length);
     }
     
@@ -198,57 +283,148 @@ void hsd_chorus_drywet(t_hsd_chorus *x, t_floatarg f){
 }
 
 
+/* function for selecting the interpolation mode, executed when an "interpolation" message is received */
+void hsd_chorus_interpolation(t_hsd_chorus *x, t_symbol *s){
+    
+    int interpolation = hsd_interp_mode(s);
+    int k;
+    
+    // sanity checking
+    if(interpolation < 0){
+        error("hsd_chorus~: unknown interpolation mode: %s. use linear, lagrange, hermite or allpass", s->s_name);
+        return;
+    }
+    x->interpolation = interpolation;
+    for (k=0; k<HSD_CHORUS_MAX_VOICES; k++) {
+        x->z_alp_l[k] = 0;
+        x->z_alp_r[k] = 0;
+    }
+    
+}
+
+/* function for setting the number of voices per channel, executed when a "voices" message is received. the phase offsets of the voices are spread evenly over one cycle of the LFO */
+void hsd_chorus_voices(t_hsd_chorus *x, t_floatarg f){
+    
+    int voices = f;
+    int k;
+    
+    // sanity checking
+    if (voices < 1 || voices > HSD_CHORUS_MAX_VOICES) {
+        error("hsd_chorus~: illegal number of voices: %d. use 1 to %d", voices, HSD_CHORUS_MAX_VOICES);
+        return;
+    }
+    
+    x->voices = voices;
+    for (k=0; k<HSD_CHORUS_MAX_VOICES; k++) {
+        x->voice_cos[k] = cos(2*PI*k/voices);
+        x->voice_sin[k] = sin(2*PI*k/voices);
+        x->z_alp_l[k] = 0;
+        x->z_alp_r[k] = 0;
+    }
+    
+}
+
+/* function for switching the mono mode on (1) or off (0), executed when a "mono" message is received */
+void hsd_chorus_mono(t_hsd_chorus *x, t_floatarg f){
+    
+    int mono = (f != 0);
+    
+    if (mono == x->mono) {
+        return;
+    }
+    
+    // the frames of the delay-line change their size, so the old content can´t be used anymore and the delay-line starts silent. a stereo delay-line that is long enough simply keeps its memory in mono mode
+    if(!hsd_chorus_resize(x, x->depth_ms_l, x->depth_ms_r, mono, 1)){
+        error("hsd_chorus~: cannot allocate memory for the delay-line");
+        // the reset has already given the old delay-line back to the arena. a delay-line of the old size comes straight from its free-list again, so the perform-routine never runs without one
+        hsd_chorus_resize(x, x->depth_ms_l, x->depth_ms_r, x->mono, 1);
+        return;
+    }
+    x->mono = mono;
+    
+}
+
+/* function for joining the shared LFO group "s" with a phase offset in cycles, executed when an "lfo" message is received. without a name, the chorus leaves its group and uses its own oscillator again */
+void hsd_chorus_lfo(t_hsd_chorus *x, t_symbol *s, t_floatarg offset){
+    
+    if (x->lfo) {
+        hsd_lfo_leave(x->lfo);
+        x->lfo = NULL;
+    }
+    if (s == &s_) {
+        return;
+    }
+    
+    x->lfo = hsd_lfo_join(s, x->frequency, x->blocksize);
+    if (x->lfo == NULL) {
+        error("hsd_chorus~: cannot join the LFO group %s", s->s_name);
+        return;
+    }
+    x->lfo_cos = cos(2*PI*offset);
+    x->lfo_sin = sin(2*PI*offset);
+    
+}
+
+/* prints how much memory the delay-lines of the whole library take, executed when a "stats" message is received */
+void hsd_chorus_stats(t_hsd_chorus *x){
+    
+    hsd_arena_stats("hsd_chorus~");
+    
+}
+
 /* the dsp-init-routine */
 void hsd_chorus_dsp(t_hsd_chorus *x, t_signal **sp)
 {
     /* check if samplerate has changed */
     if(x->sr != sp[0]->s_sr){
         
-        
-        t_int i;
-        /* store the size of the delay-line. if the length of the delay-line needs to be changed, you need the new size and the old size */
-        t_int oldbytes = x->delay_bytes;
-        
         /* store the new sample rate */
         x->sr = sp[0]->s_sr;
         
-        /* reallocate the delay-line. this process is similar to the one in the new-instance-routine except the function "resizebytes()" instead of "getbytes()" */
-        t_int delay_line_length = (t_int)(x->sr * DELMAX/1000 + 1);
-        x->delay_bytes = (int)(delay_line_length) * sizeof(t_float);
-        x->delay_line_l = (t_float*)resizebytes((void*)x->delay_line_l,oldbytes, x->delay_bytes);
-        if(x->delay_line_l == NULL){
-            error("hsd_chorus~: cannot reallocate %ld bytes of memory", x->delay_bytes);
+        /* the delay-line needs more samples for the same depth at a higher sample rate. the old content doesn´t fit to the new sample rate anyway, so the delay-line is reset instead of grown: it is cleared with a single memset or replaced by a fresh (already zeroed) one, nothing is copied */
+        if(!hsd_chorus_resize(x, x->depth_ms_l, x->depth_ms_r, x->mono, 1)){
+            error("hsd_chorus~: cannot reallocate the delay-line");
+            // the old delay-line is gone: forget the sample rate, so the next DSP start tries again instead of running without delay-line
+            x->sr = 0;
             return;
         }
-        for (i=0; i<delay_line_length; i++) {
-            x->delay_line_l[i] =0.0;
-        }
-        x->delay_line_r = (t_float*)resizebytes((void*)x->delay_line_r,oldbytes, x->delay_bytes);
-        if(x->delay_line_r == NULL){
-            error("hsd_chorus~: cannot reallocate %ld bytes of memory", x->delay_bytes);
-            return;
-        }
-        for (i=0; i<delay_line_length; i++) {
-            x->delay_line_r[i] =0.0;
-        }
-        x->delay_line_length = delay_line_length;
-        x->write_index_l = 0;
-        x->write_index_r = 0;
         
-        // recalculate cycle_length
+        // recalculate depths and cycle_length
+        x->depth_l = x->sr * x->depth_ms_l/1000;
+        x->depth_r = x->sr * x->depth_ms_r/1000;
         x->cycle_length = x->sr/x->frequency;
         
     }
     
-    /* add the objects signal processing to the signal-chain of puredata */
-    dsp_add(hsd_chorus_perform,
-            6,
-            x,
-            sp[0]->s_vec,
-            sp[1]->s_vec,
-            sp[2]->s_vec,
-            sp[3]->s_vec,
-            sp[0]->s_n);
+    // the tables of the LFO group need room for a whole block
+    x->blocksize = sp[0]->s_n;
+    if (x->lfo && !hsd_lfo_dsp(x->lfo, x->blocksize)) {
+        error("hsd_chorus~: cannot allocate memory for the LFO group");
+    }
+    
+    /* add the objects signal processing to the signal-chain of puredata. with external modulation, the modulation signal is the third signal vector, followed by the outputs. without it, no modulation vector is passed (0) */
+    if (x->external) {
+        dsp_add(hsd_chorus_perform,
+                7,
+                x,
+                sp[0]->s_vec,
+                sp[1]->s_vec,
+                sp[2]->s_vec,
+                sp[3]->s_vec,
+                sp[4]->s_vec,
+                sp[0]->s_n);
+    }
+    else {
+        dsp_add(hsd_chorus_perform,
+                7,
+                x,
+                sp[0]->s_vec,
+                sp[1]->s_vec,
+                0,
+                sp[2]->s_vec,
+                sp[3]->s_vec,
+                sp[0]->s_n);
+    }
 }
 
 
@@ -258,158 +434,178 @@ t_int *hsd_chorus_perform(t_int *w)
     t_hsd_chorus *x = (t_hsd_chorus *) (w[1]);            //object data
     t_float *input_l = (t_float *) (w[2]);                //input-vector left
     t_float *input_r = (t_float *) (w[3]);                //input-vector right
-    t_float *output_l = (t_float *) (w[4]);               //output-vector left
-    t_float *output_r = (t_float *) (w[5]);               //output-vector right
-    t_int n = w[6];                                       //buffer-size
+    t_float *modulation = (t_float *) (w[4]);             //modulation-vector (0, if the internal LFO is used)
+    t_float *output_l = (t_float *) (w[5]);               //output-vector left
+    t_float *output_r = (t_float *) (w[6]);               //output-vector right
+    t_int n = w[7];                                       //buffer-size
     
     /* get needed data from data struct */
     t_float sr = x->sr;
-    t_float *delay_line_l = x->delay_line_l;
-    t_float *delay_line_r = x->delay_line_r;
-    t_int read_index_l = x->read_index_l;
-    t_int read_index_r = x->read_index_r;
-    t_int write_index_l = x->write_index_l;
-    t_int write_index_r = x->write_index_r;
-    t_int delay_line_length = (int)(x->delay_line_length);
+    int mono = x->mono;
+    int channels = mono ? 1 : 2;
+    t_float *delay_line = x->delay_line.buffer;
+    // write-pointer and mask count frames of both channels, the right channel is the second sample of every frame (the same one in mono mode)
+    t_int write_index = x->delay_line.write_index / channels;
+    t_int mask = x->delay_line.length / channels - 1;
+    t_float *delay_line_r = delay_line + channels - 1;
     t_float depth_l = x->depth_l;
     t_float depth_r = x->depth_r;
     t_float cycle_length = x->cycle_length;
     t_float phase = x->phase;
     t_float dry = x->dry;
     t_float wet = x->wet;
-    /* init variables need for interpolation */
+    int interpolation = x->interpolation;
+    int voices = x->voices;
+    t_float *voice_cos = x->voice_cos;
+    t_float *voice_sin = x->voice_sin;
+    t_float *z_alp_l = x->z_alp_l;
+    t_float *z_alp_r = x->z_alp_r;
+    
+    // in mono mode, the right channel uses the left input as dry signal
+    if (mono) {
+        input_r = input_l;
+    }
     
-    // the next lower integer-value of the delay-length. -> the next accessable array-position
-    t_int idelay_l, idelay_r;
+    t_float lfo_cos = x->lfo_cos;
+    t_float lfo_sin = x->lfo_sin;
     
-    // the factor for the interpolation -> the offset between the real delay-length and the next smaller integer value of the delay-length
-    t_float fraction_l, fraction_r;
+    // the external modulation drives only one voice per channel
+    if (modulation) {
+        voices = 1;
+    }
     
-    // the sample that is stored in the next lower accessable array-position
-    t_float samp1_l, samp1_r;
+    // the sine and cosine of the shared LFO for this block (NULL, if the own oscillator is used)
+    t_float *lfo_sin_table = NULL;
+    t_float *lfo_cos_table = NULL;
+    if (!modulation && x->lfo && hsd_lfo_block(x->lfo, x->sr, n)) {
+        lfo_sin_table = x->lfo->sin_table;
+        lfo_cos_table = x->lfo->cos_table;
+    }
+    
+    // the output of every channel is the mean of its voices
+    t_float voice_gain = 1.0 / voices;
     
-    // the sample that is stored in the next higher accessable array-position
-    t_float samp2_l, samp2_r;
-
     /* variable for storing the outputsample */
     t_float out_sample_l, out_sample_r;
     
     // running parameter for the LFO (runs from 0 to 1)
     t_float theta;
     
-    // output of the LFO, sinewave from -1 to 1. for the right channel the same just with a phase shift
+    // sine and cosine of the oscillator
+    t_float sin_theta, cos_theta;
+    
+    // one sample of the external modulation
+    t_float mod;
+    
+    // output of the LFO of one voice, sinewave from -1 to 1. for the right channel the same just with a phase shift
     t_float lfo_l, lfo_r;
     
-    // delaylength after applying the modulation
-    t_float delay_length_l, delay_length_r;
+    // delaylength of every voice after applying the modulation
+    t_float delay_length_l[HSD_CHORUS_MAX_VOICES], delay_length_r[HSD_CHORUS_MAX_VOICES];
     
-    //the second read index, used to read out the second sample used for interpolation
-    t_int read_index2_l, read_index2_r;
+    int k;
     
     
     /* DSP-Loop */
     while (n--) {
         
         
-        /* LFO */
-        theta = phase / cycle_length;
-        
-        //calculate low frequency sinewave
-        lfo_l = sin(2*PI*theta);
-        lfo_r = sin(2*PI*theta + 0.5*PI); //second lfo with a 90° phase shift (90°=pi/2)
-        
-        //map values from (-1...+1) to (0...+1)
-        lfo_l = (lfo_l + 1.0) / 2.0;
-        lfo_r = (lfo_r + 1.0) / 2.0;
-        
-        // increase phase
-        phase++;
-        
-        
-        // reset phase after one period
-        if (phase > cycle_length) {
-            phase = 0;
-        }
-        
-        // calculate delay by appling a sinusoidal modulation between 0 and depth ( 2 samples added for a minumum delay to avoid zero samples delay)
-        delay_length_l = depth_l * lfo_l + 2;
-        delay_length_r = depth_r * lfo_r + 2;
-        
-        /* delay line */
-        
-        // truncate the delay-length, so an array-entry can be accessed with it. (truncate -> round to next lower integer value)
-        idelay_l = trunc(delay_length_l);
-        idelay_r = trunc(delay_length_r);
-        
-        // calculate the factor for interpolation
-        fraction_l = delay_length_l - idelay_l;
-        fraction_r = delay_length_r - idelay_r;
-        
-        //set the offset between read & write; wrap it into legal space if needed
-        read_index_l = write_index_l - idelay_l;
-        read_index2_l = read_index_l - 1;
-        while (read_index_l < 0) {
-            read_index_l += delay_line_length;
-        }
-        while (read_index2_l < 0) {
-            read_index2_l += delay_line_length;
-        }
-        
-        
-        read_index_r = write_index_r - idelay_r;
-        read_index2_r = read_index_r - 1;
-        while (read_index_r < 0) {
-            read_index_r += delay_line_length;
+        if (modulation) {
+            
+            /* external modulation, clipped to (0...+1). the right channel gets the inverted modulation */
+            mod = *modulation++;
+            if (mod < 0) {
+                mod = 0;
+            }
+            if (mod > 1) {
+                mod = 1;
+            }
+            delay_length_l[0] = depth_l * mod + 2;
+            delay_length_r[0] = depth_r * (1 - mod) + 2;
         }
-        while (read_index2_r < 0) {
-            read_index2_r += delay_line_length;
+        else {
+            
+            if (lfo_sin_table) {
+                
+                /* shared LFO, shifted by the phase offset of this chorus */
+                sin_theta = *lfo_sin_table * lfo_cos + *lfo_cos_table * lfo_sin;
+                cos_theta = *lfo_cos_table++ * lfo_cos - *lfo_sin_table++ * lfo_sin;
+            }
+            else {
+                
+                /* LFO */
+                theta = phase / cycle_length;
+                
+                //calculate low frequency sine- and cosinewave, only once for all voices
+                sin_theta = sin(2*PI*theta);
+                cos_theta = cos(2*PI*theta);
+                
+                // increase phase
+                phase++;
+                
+                
+                // reset phase after one period
+                if (phase > cycle_length) {
+                    phase = 0;
+                }
+            }
+            
+            for (k=0; k<voices; k++) {
+                
+                // the LFO of the voice, shifted by its phase offset. the right channel has another 90° phase shift (90°=pi/2)
+                lfo_l = sin_theta * voice_cos[k] + cos_theta * voice_sin[k];
+                lfo_r = cos_theta * voice_cos[k] - sin_theta * voice_sin[k];
+                
+                // map values from (-1...+1) to (0...+1) and calculate the delay by appling a sinusoidal modulation between 0 and depth ( 2 samples added for a minumum delay to avoid zero samples delay)
+                delay_length_l[k] = depth_l * (lfo_l + 1.0) / 2.0 + 2;
+                delay_length_r[k] = depth_r * (lfo_r + 1.0) / 2.0 + 2;
+            }
         }
         
-        // read the two samples for interpolation
-        samp1_l = delay_line_l[read_index_l];
-        samp2_l = delay_line_l[read_index2_l];
-        samp1_r = delay_line_r[read_index_r];
-        samp2_r = delay_line_r[read_index2_r];
+        /* delay line */
         
+        // read the delayed samples of all voices, interpolated with the selected interpolation mode (see hsd_library.h)
         //quick buffer delayline-output before reading the input sample, so in case of shared input- and output-buffers, the input sample won´t be the recent written output-sample
-        
-        out_sample_l = samp1_l * fraction_l + samp2_l * (1.0-fraction_l);
-        out_sample_r = samp1_r * fraction_r + samp2_r * (1.0-fraction_r);
+        out_sample_l = 0;
+        out_sample_r = 0;
+        for (k=0; k<voices; k++) {
+            out_sample_l += hsd_delayline_read_interleaved(delay_line, mask, write_index, delay_length_l[k], channels, interpolation, &z_alp_l[k]);
+            out_sample_r += hsd_delayline_read_interleaved(delay_line_r, mask, write_index, delay_length_r[k], channels, interpolation, &z_alp_r[k]);
+        }
+        out_sample_l *= voice_gain;
+        out_sample_r *= voice_gain;
         
         t_float input_left = *input_l++;
         t_float input_right = *input_r++;
         
-        // write the input of the delay line
-        delay_line_l[write_index_l++] = input_left ;
-        delay_line_r[write_index_r++] = input_right ;
+        // write the input of both channels into the frame of the delay line (next to each other, in the same cache-line)
+        delay_line[write_index * channels] = input_left ;
+        if (!mono) {
+            delay_line_r[write_index * channels] = input_right ;
+        }
         
         //*output++ = out_sample + dry;
         *output_l++ = wet * out_sample_l + dry * input_left;
         *output_r++ = wet * out_sample_r + dry * input_right;
         
         
-        //reset the write_index
-        if(write_index_l >= delay_line_length){
-            write_index_l -= delay_line_length;
-        }
-        if(write_index_r >= delay_line_length){
-            write_index_r -= delay_line_length;
-        }
+        //increment and wrap the write_index
+        write_index = (write_index + 1) & mask;
     }
-    x->write_index_l = write_index_l;
-    x->write_index_r = write_index_r;
+    x->delay_line.write_index = write_index * channels;
     x->phase = phase;
     
-    return w+7;
+    return w+8;
 }
 
 
 /* free function that is called when the object is destroyed */
 void hsd_chorus_free(t_hsd_chorus *x)
 {
-    freebytes(x->delay_line_l, x->delay_bytes);
-    freebytes(x->delay_line_r, x->delay_bytes);
-
+    hsd_delayline_free(&x->delay_line);
+    if (x->lfo) {
+        hsd_lfo_leave(x->lfo);
+    }
 }
 
 
@@ -430,8 +626,32 @@ void *hsd_chorus_new(t_symbol *s, short argc, t_atom *argv)
     t_float depth_ms_r = 10.0;
     t_float frequency = 1.0;
     t_float dry_wet = 50.0;
+    t_float max_depth_ms = 0;
+    t_float voices = 1;
+    int mono = 0;
+    
+    // the symbols after the numbers: "mono" switches on the mono mode, "external" replaces the LFO by a modulation signal inlet
+    x->external = 0;
+    while (argc>=1 && argv[argc-1].a_type == A_SYMBOL) {
+        if (atom_getsymbolarg(argc-1, argc, argv) == gensym("mono")) {
+            mono = 1;
+        }
+        else if (atom_getsymbolarg(argc-1, argc, argv) == gensym("external")) {
+            x->external = 1;
+        }
+        else {
+            error("hsd_chorus~: unknown argument %s", atom_getsymbolarg(argc-1, argc, argv)->s_name);
+        }
+        argc--;
+    }
     
     /* get the creation arguments */
+    if (argc>=6) {
+        voices = atom_getfloatarg(5, argc, argv);
+    }
+    if (argc>=5) {
+        max_depth_ms = atom_getfloatarg(4, argc, argv);
+    }
     if (argc>=4) {
         dry_wet= atom_getfloatarg(3, argc, argv);
     }
@@ -445,15 +665,18 @@ void *hsd_chorus_new(t_symbol *s, short argc, t_atom *argv)
         depth_ms_l = atom_getfloatarg(0, argc, argv);
     }
 
+    // the maximum depth is the fifth creation argument (default DELMAX)
+    x->max_depth_ms = hsd_maxdelay(max_depth_ms, DELMAX, depth_ms_l > depth_ms_r ? depth_ms_l : depth_ms_r);
+    
     // sanity checking
-    if (depth_ms_l > DELMAX){
-        depth_ms_l = DELMAX;
+    if (depth_ms_l > x->max_depth_ms){
+        depth_ms_l = x->max_depth_ms;
     }
     if (depth_ms_l < 0.0){
         depth_ms_l = 0.0;
     }
-    if (depth_ms_r > DELMAX){
-        depth_ms_r = DELMAX;
+    if (depth_ms_r > x->max_depth_ms){
+        depth_ms_r = x->max_depth_ms;
     }
     if (depth_ms_r < 0.0){
         depth_ms_r = 0.0;
@@ -490,35 +713,32 @@ void *hsd_chorus_new(t_symbol *s, short argc, t_atom *argv)
     inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("frequency"));
     inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("drywet"));
     
+    // the signal inlet for the external modulation. if no signal is connected, it takes floats (fixed delays between 0 and the depths)
+    if (x->external) {
+        signalinlet_new(&x->obj, 0);
+    }
+    
     //creating the signal-outlets
     outlet_new(&x->obj, gensym("signal"));
     outlet_new(&x->obj, gensym("signal"));
     
-    //Allocating the DelayLines
-    t_int delay_line_length = (t_int)(x->sr * DELMAX/1000 + 1);
-    x->delay_bytes = delay_line_length * sizeof(t_float);
-    x->delay_line_l = (t_float*)getbytes(x->delay_bytes);
-    if(x->delay_line_l == NULL){
-        error("hsd_chorus~: cannot allocate %ld bytes of memory", x->delay_bytes);
+    //Allocating the DelayLine, just long enough for the initial depths (with one channel in mono mode)
+    x->mono = mono;
+    if(!hsd_chorus_resize(x, x->depth_ms_l, x->depth_ms_r, mono, 0)){
+        error("hsd_chorus~: cannot allocate memory for the delay-line");
         return NULL;
     }
-    t_int i;
-    for (i=0; i<delay_line_length; i++) {
-        x->delay_line_l[i] =0.0;
-    }
-    x->delay_line_r = (t_float*)getbytes(x->delay_bytes);
-    if(x->delay_line_r == NULL){
-        error("hsd_chorus~: cannot allocate %ld bytes of memory", x->delay_bytes);
-        return NULL;
-    }
-    for (i=0; i<delay_line_length; i++) {
-        x->delay_line_r[i] =0.0;
-    }
     
-    x->delay_line_length = delay_line_length;
-    x->write_index_l = 0;
-    x->write_index_r = 0;
     x->phase = 0;
+    x->interpolation = HSD_INTERP_LINEAR;
+    x->lfo = NULL;
+    x->blocksize = 0;
+    
+    // the number of voices (this also sets the phase offsets and resets the allpass states). one voice first, in case the argument is illegal
+    hsd_chorus_voices(x, 1);
+    if (voices != 1) {
+        hsd_chorus_voices(x, voices);
+    }
     return x;
 }
 
@@ -535,6 +755,9 @@ void hsd_chorus_tilde_setup(void){
     
     CLASS_MAINSIGNALIN(hsd_chorus_class, t_hsd_chorus, x_f);
     
+    // calculate the coefficient table of the interpolation
+    hsd_interp_init();
+    
     
     class_addmethod(hsd_chorus_class,
                     (t_method)hsd_chorus_dsp,
@@ -560,6 +783,31 @@ void hsd_chorus_tilde_setup(void){
                     gensym("drywet"),
                     A_DEFFLOAT,
                     0);
+    class_addmethod(hsd_chorus_class,
+                    (t_method)hsd_chorus_interpolation,
+                    gensym("interpolation"),
+                    A_SYMBOL,
+                    0);
+    class_addmethod(hsd_chorus_class,
+                    (t_method)hsd_chorus_voices,
+                    gensym("voices"),
+                    A_FLOAT,
+                    0);
+    class_addmethod(hsd_chorus_class,
+                    (t_method)hsd_chorus_mono,
+                    gensym("mono"),
+                    A_FLOAT,
+                    0);
+    class_addmethod(hsd_chorus_class,
+                    (t_method)hsd_chorus_lfo,
+                    gensym("lfo"),
+                    A_DEFSYMBOL,
+                    A_DEFFLOAT,
+                    0);
+    class_addmethod(hsd_chorus_class,
+                    (t_method)hsd_chorus_stats,
+                    gensym("stats"),
+                    0);
     
     
     post ("hsd_chorus~ by David Bau, HS Duesseldorf ");
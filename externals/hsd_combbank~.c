@@ -0,0 +1,478 @@
+/* hsd_combbank~ external from the HSD-Library, University of Applied Science Duesseldorf
+ Created 18.10.2026
+
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This is a bank of up to 32 comb filters (see hsd_comb~) that all filter the same input signal. Every comb filter has its own delay time and feedback gain. With lots of combs tuned to different pitches it works as a resonator, with short delays and a feedback close to 1 it rings like a plucked string (karplus-strong).
+
+                  --> [comb 1] --
+                 |               |
+        —>x      |--> [comb 2] --|
+        o————————|               (+)——> y (or one outlet per comb)
+                 |--> [ ...  ] --|
+                 |               |
+                  --> [comb N] --
+
+
+ The output is either the sum of all combs (one outlet) or every comb gets its own outlet (creation argument "multi").
+
+
+ Compared to lots of hsd_comb~ objects, the comb bank saves a lot of overhead:
+
+    -> all delay-lines are placed in ONE block of memory from the arena (a delay-bank, see hsd_library.h). every comb gets a region of the same length (a power of two), and all combs share one write-pointer. the regions only grow if a longer delay time is set, like the delay-lines of the other objects.
+    -> the signal vector is processed in chunks, like in hsd_reverb~: a chunk is never longer than the shortest delay, so all samples that are read in a chunk were written before the chunk started. the reading of a comb filter then doesn´t depend on its own writing anymore, and the loop over the chunk has no dependencies between the samples. the outputs of a comb for the whole chunk are read with hsd_delaybank_read(), then the inputs are written in a second loop. both loops run over contiguous pieces of memory (a chunk is split where a pointer wraps around), so the compiler can calculate them with SIMD instructions, several samples at a time.
+
+
+ Messages:
+
+    -> "delays <list>": the delay times of the combs in ms, the first value for the first comb and so on. a single value sets all combs.
+    -> "feedback <list>": the feedback gains of the combs (-1...1), the same way. negative gains give a hollow sound with only the odd harmonics.
+    -> "bang": clears all delay-lines.
+
+ */
+
+#include "m_pd.h"
+#include "math.h"
+#include <string.h>
+#include "hsd_library.h"
+
+/* the maximum number of comb filters */
+#define HSD_COMBBANK_MAX 32
+
+/* the longest chunk of samples that is processed in one go */
+#define HSD_COMBBANK_CHUNK 64
+
+/* defaults */
+#define DELMAX 100  //default maximum delay time in ms
+#define DEFAULT_TIME 10  //the initial delay times are spread from 10ms to 20ms (2*DEFAULT_TIME), illegal delay times are set to 10ms
+
+/* data struct */
+typedef struct _hsd_combbank{
+
+    /* the object data itself */
+    t_object obj;
+
+    /* sample rate */
+    t_float sr;
+
+    /* the number of comb filters */
+    int combs;
+
+    /* 1 if every comb has its own outlet, 0 if all combs are summed */
+    int multi;
+
+    /* the maximum delay time in ms */
+    t_float max_delay_ms;
+
+    /* the delay-lines of all combs in one block of memory (see hsd_library.h) */
+    t_hsd_delaybank lines;
+
+    /* the parameters of every comb: delay time in ms, the delay split into whole samples and fraction, and the feedback gain */
+    t_float delay_ms[HSD_COMBBANK_MAX];
+    t_int idelay[HSD_COMBBANK_MAX];
+    t_float fraction[HSD_COMBBANK_MAX];
+    t_float feedback[HSD_COMBBANK_MAX];
+
+    /* the number of samples that are processed in one chunk */
+    t_int chunk;
+
+    /* the output vectors of the comb filters in multichannel mode, set by the dsp-init-routine */
+    t_float *out_vec[HSD_COMBBANK_MAX];
+
+    /* dummy float for CLASS_MAINSIGNALIN */
+    t_float x_f;
+
+}t_hsd_combbank;
+
+static t_class *hsd_combbank_class;
+
+
+/* function prototypes */
+void *hsd_combbank_new(t_symbol *s, short argc, t_atom *argv);
+void hsd_combbank_dsp(t_hsd_combbank *x, t_signal **sp);
+t_int *hsd_combbank_perform(t_int *w);
+void hsd_combbank_free(t_hsd_combbank *x);
+void hsd_combbank_stats(t_hsd_combbank *x);
+void hsd_combbank_delays(t_hsd_combbank *x, t_symbol *s, short argc, t_atom *argv);
+void hsd_combbank_feedback(t_hsd_combbank *x, t_symbol *s, short argc, t_atom *argv);
+void hsd_combbank_bang(t_hsd_combbank *x);
+void hsd_combbank_update(t_hsd_combbank *x);
+
+
+/* calculates the delays in samples from the delay times in ms and the length of the chunks. called whenever a delay time or the sample rate changes */
+void hsd_combbank_update(t_hsd_combbank *x){
+
+    int k;
+    t_float delay;
+
+    x->chunk = HSD_COMBBANK_CHUNK;
+
+    for (k=0; k<x->combs; k++) {
+
+        delay = x->sr * x->delay_ms[k]/1000;
+
+        // the linear interpolation needs at least one sample of delay
+        if (delay < 1) {
+            delay = 1;
+        }
+        x->idelay[k] = (t_int)delay;
+        x->fraction[k] = delay - x->idelay[k];
+
+        // a chunk must not be longer than the shortest delay, otherwise samples would be read that are written in the same chunk
+        if (x->idelay[k] < x->chunk) {
+            x->chunk = x->idelay[k];
+        }
+    }
+}
+
+/* function for setting the delay times in ms, executed when a "delays" message is received */
+void hsd_combbank_delays(t_hsd_combbank *x, t_symbol *s, short argc, t_atom *argv){
+
+    int k;
+    t_float delay_time_ms;
+    t_float longest = 0;
+
+    if (argc < 1) {
+        return;
+    }
+
+    for (k=0; k<x->combs && (k<argc || argc==1); k++) {
+
+        delay_time_ms = atom_getfloatarg((argc==1) ? 0 : k, argc, argv);
+
+        // sanity checking
+        if(delay_time_ms > x->max_delay_ms || delay_time_ms <= 0.0){
+            error("hsd_combbank~: illegal delay time for comb %d: %f. delay time set to %dms", k+1, delay_time_ms, DEFAULT_TIME);
+            delay_time_ms = DEFAULT_TIME;
+        }
+        x->delay_ms[k] = delay_time_ms;
+    }
+
+    for (k=0; k<x->combs; k++) {
+        if (x->delay_ms[k] > longest) {
+            longest = x->delay_ms[k];
+        }
+    }
+
+    // let the regions grow, if they are too short for the new delay times
+    if(!hsd_delaybank_grow(&x->lines, hsd_delayline_samples(x->sr, longest))){
+        error("hsd_combbank~: cannot allocate memory for a delay time of %f ms", longest);
+        return;
+    }
+
+    hsd_combbank_update(x);
+}
+
+/* function for setting the feedback gains, executed when a "feedback" message is received */
+void hsd_combbank_feedback(t_hsd_combbank *x, t_symbol *s, short argc, t_atom *argv){
+
+    int k;
+    t_float feedback;
+
+    if (argc < 1) {
+        return;
+    }
+
+    for (k=0; k<x->combs && (k<argc || argc==1); k++) {
+
+        feedback = atom_getfloatarg((argc==1) ? 0 : k, argc, argv);
+
+        // sanity checking
+        if (feedback > 1 || feedback < -1) {
+            error("hsd_combbank~: illegal feedback for comb %d: %f. feedback set to 0", k+1, feedback);
+            feedback = 0;
+        }
+        x->feedback[k] = feedback;
+    }
+}
+
+/* function for clearing the delay-lines, executed when a bang message is received */
+void hsd_combbank_bang(t_hsd_combbank *x){
+
+    hsd_delaybank_clear(&x->lines);
+}
+
+/* prints how much memory the delay-lines of the whole library take, executed when a "stats" message is received */
+void hsd_combbank_stats(t_hsd_combbank *x){
+
+    hsd_arena_stats("hsd_combbank~");
+
+}
+
+
+/* the dsp-init-routine */
+void hsd_combbank_dsp(t_hsd_combbank *x, t_signal **sp)
+{
+    int k;
+    t_float longest = 0;
+
+    /* check for sample rate change. the old content doesn´t fit to the new sample rate, so the delay-lines are reset instead of grown (one memset or a fresh, already zeroed block) */
+    if(x->sr != sp[0]->s_sr){
+
+        x->sr = sp[0]->s_sr;
+
+        for (k=0; k<x->combs; k++) {
+            if (x->delay_ms[k] > longest) {
+                longest = x->delay_ms[k];
+            }
+        }
+
+        if(!hsd_delaybank_reset(&x->lines, hsd_delayline_samples(x->sr, longest))){
+            error("hsd_combbank~: cannot reallocate the delay-lines");
+            // the old delay-lines is gone: forget the sample rate, so the next DSP start tries again instead of running without delay-lines
+            x->sr = 0;
+            return;
+        }
+
+        hsd_combbank_update(x);
+    }
+
+    // the output vectors of all combs (multichannel mode)
+    if (x->multi) {
+        for (k=0; k<x->combs; k++) {
+            x->out_vec[k] = sp[k+1]->s_vec;
+        }
+    }
+
+    /* add the objects signal processing to the signal-chain of puredata */
+    dsp_add(hsd_combbank_perform,
+            4,
+            x,
+            sp[0]->s_vec,
+            sp[1]->s_vec,
+            sp[0]->s_n);
+}
+
+
+/* the perform routine */
+t_int *hsd_combbank_perform(t_int *w)
+{
+    t_hsd_combbank *x = (t_hsd_combbank *) (w[1]);      //object data
+    t_float *input = (t_float *) (w[2]);                //input-vector
+    t_float *output = (t_float *) (w[3]);               //output-vector (the first one in multichannel mode)
+    t_int n = w[4];                                     //buffer-size
+
+    /* get needed data from data struct */
+    t_float *memory = x->lines.buffer;
+    int combs = x->combs;
+    int multi = x->multi;
+    t_int length = x->lines.length;
+    t_int mask = x->lines.mask;
+    t_int write_index = x->lines.write_index;
+
+    // the input, the outputs of one comb and the sum of all combs in the current chunk
+    t_float in[HSD_COMBBANK_CHUNK];
+    t_float out[HSD_COMBBANK_CHUNK];
+    t_float sum[HSD_COMBBANK_CHUNK];
+
+    t_float *line, *write, feedback;
+    t_int chunk, done = 0, i;
+    int k;
+
+    /* DSP-Loop, one chunk after the other */
+    while (done < n) {
+
+        chunk = n - done;
+        if (chunk > x->chunk) {
+            chunk = x->chunk;
+        }
+        // the chunk must not run over the end of the regions, so the samples of a chunk are written to one contiguous piece of memory
+        if (chunk > length - write_index) {
+            chunk = length - write_index;
+        }
+
+        for (i=0; i<chunk; i++) {
+            in[i] = input[done + i];
+            sum[i] = 0;
+        }
+
+        /* the comb filters, one after the other */
+        for (k=0; k<combs; k++) {
+
+            line = memory + k * length;
+            write = line + write_index;
+            feedback = x->feedback[k];
+
+            // the outputs of the comb for the whole chunk
+            hsd_delaybank_read(line, mask, write_index, x->idelay[k], x->fraction[k], out, chunk);
+
+            // write the input of the delay line --> x(n) + g*y(n)
+            for (i=0; i<chunk; i++) {
+                write[i] = in[i] + feedback * out[i];
+            }
+
+            // sum the combs or send every comb to its own outlet
+            if (multi) {
+                for (i=0; i<chunk; i++) {
+                    x->out_vec[k][done + i] = out[i];
+                }
+            }
+            else {
+                for (i=0; i<chunk; i++) {
+                    sum[i] += out[i];
+                }
+            }
+        }
+
+        if (!multi) {
+            for (i=0; i<chunk; i++) {
+                output[done + i] = sum[i];
+            }
+        }
+
+        write_index = (write_index + chunk) & mask;
+        done += chunk;
+    }
+
+    x->lines.write_index = write_index;
+
+    return w+5;
+}
+
+
+/* free function that is called when the object is destroyed */
+void hsd_combbank_free(t_hsd_combbank *x)
+{
+    hsd_delaybank_free(&x->lines);
+}
+
+
+/* new-instance routine */
+void *hsd_combbank_new(t_symbol *s, short argc, t_atom *argv)
+{
+    // set default values
+    t_float combs = 8;
+    t_float max_delay_ms = 0;
+    t_atom delays[HSD_COMBBANK_MAX];
+    int i, k, floats = 0;
+
+    t_hsd_combbank *x = (t_hsd_combbank *)pd_new(hsd_combbank_class);
+
+    x->multi = 0;
+
+    /* getting creation arguments: the number of combs and the maximum delay time. the symbol "multi" gives every comb its own outlet */
+    for (i=0; i<argc; i++) {
+        if (argv[i].a_type == A_SYMBOL) {
+            if (atom_getsymbol(argv + i) == gensym("multi")) {
+                x->multi = 1;
+            }
+            else {
+                error("hsd_combbank~: unknown argument %s", atom_getsymbol(argv + i)->s_name);
+            }
+        }
+        else {
+            if (floats == 0) {
+                combs = atom_getfloat(argv + i);
+            }
+            else if (floats == 1) {
+                max_delay_ms = atom_getfloat(argv + i);
+            }
+            floats++;
+        }
+    }
+
+    // sanity checking
+    if (combs < 1 || combs > HSD_COMBBANK_MAX) {
+        error("hsd_combbank~: illegal number of combs: %f. number of combs set to 8", combs);
+        combs = 8;
+    }
+    x->combs = combs;
+
+    // the maximum delay time (default DELMAX). it is never shorter than the initial delay times, so they and the fallback for illegal delay times always fit
+    x->max_delay_ms = hsd_maxdelay(max_delay_ms, DELMAX, 2 * DEFAULT_TIME);
+
+    //creating the signal-outlets
+    outlet_new(&x->obj, gensym("signal"));
+    if (x->multi) {
+        for (k=1; k<x->combs; k++) {
+            outlet_new(&x->obj, gensym("signal"));
+        }
+    }
+
+    // getting sample rate
+    x->sr = sys_getsr();
+
+    x->lines.buffer = NULL;
+    x->lines.lines = x->combs;
+    x->lines.length = 0;
+    x->lines.mask = 0;
+    x->lines.bytes = 0;
+    x->lines.write_index = 0;
+
+    /* the initial delay times are spread from 10ms to 20ms, the feedback is 0.5 for all combs */
+    for (k=0; k<x->combs; k++) {
+        x->delay_ms[k] = DEFAULT_TIME;
+        SETFLOAT(delays + k, DEFAULT_TIME + (t_float)DEFAULT_TIME * k / x->combs);
+        x->feedback[k] = 0.5;
+        x->out_vec[k] = NULL;
+    }
+
+    /* Allocating the delay-lines, just long enough for the initial delay times */
+    hsd_combbank_delays(x, gensym("delays"), x->combs, delays);
+    if (x->lines.buffer == NULL) {
+        error("hsd_combbank~: cannot allocate memory for the delay-lines");
+        return NULL;
+    }
+
+    return x;
+}
+
+/* setup routine */
+void hsd_combbank_tilde_setup(void){
+
+    hsd_combbank_class = class_new(gensym("hsd_combbank~"),
+                                   (t_newmethod)hsd_combbank_new,
+                                   (t_method)hsd_combbank_free,
+                                   sizeof(t_hsd_combbank),
+                                   0,
+                                   A_GIMME,
+                                   0);
+
+    CLASS_MAINSIGNALIN(hsd_combbank_class, t_hsd_combbank, x_f);
+
+
+    class_addmethod(hsd_combbank_class,
+                    (t_method)hsd_combbank_dsp,
+                    gensym("dsp"),
+                    0);
+
+    class_addmethod(hsd_combbank_class,
+                    (t_method)hsd_combbank_delays,
+                    gensym("delays"),
+                    A_GIMME,
+                    0);
+
+    class_addmethod(hsd_combbank_class,
+                    (t_method)hsd_combbank_feedback,
+                    gensym("feedback"),
+                    A_GIMME,
+                    0);
+
+    class_addbang(hsd_combbank_class, hsd_combbank_bang);
+
+    class_addmethod(hsd_combbank_class,
+                    (t_method)hsd_combbank_stats,
+                    gensym("stats"),
+                    0);
+
+
+    post ("hsd_combbank~ from the hsd_library, HS Duesseldorf ");
+
+}
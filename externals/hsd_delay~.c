@@ -36,11 +36,13 @@
                  (output)                    (input)
  
  
- To allocate memory for a huge array as it is used here, the function "getbytes()" from m_pd.h is used. It reserves a certain amount of bytes and returns a pointer to the start of the array. This pointer is stored in the *delay_line and can be accessed like a regular array. It is important to keep track of the size of the array.
-    -> for resizing: the length of the delay line depends on the sample rate. So everytime the sample-rate of pd changes, the delay line need to have another length and has to be resized. This is done by the function "resizebytes()", which needs the the new AND the old number of bytes
-    -> for deallocating: it is very important to free the memory allocated with "getbytes()" at the end of runtime, because puredata won´t do it by itself. for this purpose, a free-function has to be defined (hsd_delay_free()). This function is passed with the "class-new"-function call. It is called when puredata shuts down or the object is deleted. Here you can call the function "freebytes()"
+ The memory for the array doesn´t come from "getbytes()" of m_pd.h, but from an arena that is shared by all objects of the library (hsd_arena_alloc(), see hsd_library.h): it reserves large, aligned blocks from the operating system and hands out pieces of them, so the delay-lines of many objects lie close together and a new delay-line doesn´t need a call to the system every time. It is important to keep track of the size of the array, because it has to be given back to the arena with the same size.
+    -> the ring-buffer itself is shared code of the library (t_hsd_delayline, see hsd_library.h), because all delay-based externals use the same delay-line. Its length is always a power of two, so the pointers can be wrapped with a bitwise AND instead of an if-statement.
+    -> the maximum delay time is set by the second creation argument (default 100ms). The delay-line is NOT allocated for the maximum delay time, but only for the delay times that have been used so far. When a longer delay time arrives at the delay time inlet, the delay-line grows. This never happens in the perform-routine: the perform-routine limits the delay to what the delay-line can do right now and sets a clock, which lets the delay-line grow right after the current DSP tick (see hsd_delay_grow()).
+    -> for resizing: the length of the delay line depends on the sample rate. So everytime the sample-rate of pd changes, the delay line need to have another length and has to be resized. The old content is useless then, so hsd_delayline_reset() doesn´t copy it: a delay-line that is long enough is cleared with memset(), a shorter one is replaced by a new, already zeroed block from the arena.
+    -> for deallocating: it is very important to give the memory of the delay-line back at the end of runtime, because puredata won´t do it by itself. for this purpose, a free-function has to be defined (hsd_delay_free()). This function is passed with the "class-new"-function call. It is called when puredata shuts down or the object is deleted. Here hsd_delayline_free() gives the ring-buffer back to the arena (the vector for the delay times is freed with "freebytes()", like any other memory from "getbytes()")
  
- The offset of the pointers is calculated with the delay-time in ms (-> sr*delay_ms / 1000). If the offset is a noninteger value, the read-pointer has to read the next possible two integer values and interpolate between them to generate the output sample.
+ The offset of the pointers is calculated with the delay-time in ms (-> sr*delay_ms / 1000). The delay time is a signal, so it can be modulated sample by sample (tape-delay effects, doppler). If the delay time doesn´t change within a block (a float sent to the inlet or a constant signal), the conversion to samples is done only once for the whole block. Otherwise all delay times of the block are converted to samples in a separate loop first, which the compiler can vectorize, before the samples are read from the delay-line. If the offset is a noninteger value, the read-pointer has to read the next possible two integer values and interpolate between them to generate the output sample. Reading and interpolating is done by hsd_delayline_read() (see hsd_library.h). Besides the linear interpolation between two samples, it offers higher order interpolations (message "interpolation lagrange / hermite / allpass"), which keep the high frequencies of the delayed signal.
  
  
  The delay-line introduced here is used in other hsd-externals and can be used for further development.
@@ -51,9 +53,10 @@
 
 #include "m_pd.h"
 #include "math.h"
+#include "hsd_library.h"
 
 /* defaults */
-#define DELMAX 100
+#define DELMAX 100  //default maximum delay time in ms
 #define DEFAULT_TIME 10  //10ms
 
 /* data struct */
@@ -65,24 +68,29 @@ typedef struct _hsd_delay{
     /* sample rate */
     t_float sr;
     
-    /* the length of the complete delay-line in samples. the maximum delay time is defined by DELMAX 100 milliseconds, therefore the delayline is always allocated with enough samples to store 100ms of audio. this value is always in dependance of the samplerate and has to be recalculated when the sample rate changes */
-    t_float delay_line_length;
+    /* the delay-line: the pointer to the ring-buffer, its length in samples (always a power of two) and in bytes, and the current position of the write-pointer. the write-pointer is incremented with every sample-tick in the dsp-loop. it indicates the position, where the input is written to the delay-line. (see hsd_library.h) */
+    t_hsd_delayline delay_line;
     
-    /* the length of the delay-line in bytes. it is proportional to delay_line_length, which is just mulitplied by the byte-size of a float variable. it is important to store the bytes, because when the object is destroyed at the end of runtime, the allocated memory has to be freed again */
-    t_float delay_bytes;
+    /* the maximum delay time in ms, set by the second creation argument. the delay-line is only allocated as long as the current delay time needs it, but it may grow up to this length */
+    t_float max_delay_ms;
     
-    /* the pointer to the delay-line itself. when the memory of the delay-line is allocated, a pointer to this memory (to the first entry) is returned and stored in this variable. */
-    t_float *delay_line;
-    
-    /* the paramter that is set from outside and indicates the time the audio-signal is delayed. this value needs to be converted to the amount of samples needed for the delay_length (NOT delay-line length) to determine the displacement between read- and write pointer*/
+    /* the longest delay time in ms the delay-line has been allocated for so far. the delay time itself comes from the signal inlet */
     t_float delay_time_ms;
-    t_float delay_length;
     
-    /* the current position of the write-pointer. it is incremented with every sample-tick in the dsp-loop. it indicates the position, where the input is written to the delay-line. */
-    t_int write_index;
+    /* the delay in samples for every sample of the current block. it determines the displacement between the read- and writepointer. it can be a noninteger value, the delay-line is then interpolated. allocated in the dsp-init-routine for the block size */
+    t_float *delay_vec;
+    t_int delay_vec_n;
+    
+    /* the signal inlet for the delay time. the message "delaytime" sets its value, if no signal is connected */
+    t_inlet *delay_inlet;
+    
+    /* the clock that lets the delay-line grow after the DSP tick, and the delay time in ms it should grow for (see hsd_delay_grow()) */
+    t_clock *grow_clock;
+    t_float grow_ms;
     
-    /* the current position of the read-pointer. it "follows" the write pointer skimming thorugh the delay-line with a displacement of delay_length. this displacement is achieved by subtracting the delay_length from the write-pointer */
-    t_int read_index;
+    /* the interpolation mode (HSD_INTERP_LINEAR ...) and the filter state of the allpass interpolation (see hsd_library.h) */
+    int interpolation;
+    t_float interp_state;
     
     /* dummy float for CLASS_MAINSIGNALIN */
     t_float x_f;
@@ -94,27 +102,49 @@ static t_class *hsd_delay_class;
 
 
 /* function prototypes */
-void *hsd_delay_new (t_floatarg f);
+void *hsd_delay_new (t_floatarg f1, t_floatarg f2);
 void hsd_delay_dsp(t_hsd_delay *x, t_signal **sp);
 t_int *hsd_delay_perform(t_int *w);
 void hsd_delay_free(t_hsd_delay *x);
-void hsd_delay_delaytime(t_hsd_delay *x, t_floatarg f);
+void hsd_delay_stats(t_hsd_delay *x);
+void hsd_delay_grow(t_hsd_delay *x);
 void hsd_delay_bang(t_hsd_delay *x);
+void hsd_delay_interpolation(t_hsd_delay *x, t_symbol *s);
+void hsd_delay_delaytime(t_hsd_delay *x, t_floatarg f);
 
 
 
-/* function for setting the delay time, called by the second inlet, perofmrs sanity checking */
+/* function for setting the delay time with the message "delaytime <ms>", performs sanity checking. this was the float inlet for the delay time in older versions, so old patches still work. the value is sent to the signal inlet of the delay time, like a float at this inlet (the delay-line grows in the next DSP tick, if needed) */
 void hsd_delay_delaytime(t_hsd_delay *x, t_floatarg f){
     
     t_float delay_time_ms = f;
     
     // sanity checking
-    if(delay_time_ms > DELMAX || delay_time_ms <=0.0){
+    if(delay_time_ms > x->max_delay_ms || delay_time_ms <=0.0){
         error("hsd_delay~: illegal delay time: %f. delay time set to 10ms", delay_time_ms);
         delay_time_ms=10.0;
     }
-    // calculate the delay length in bytes
-    x->delay_length = x->sr * delay_time_ms/1000;
+    pd_float((t_pd *)x->delay_inlet, delay_time_ms);
+}
+
+/* function for letting the delay-line grow, called by the clock. the perform-routine sets the clock, if the delay time inlet asks for a longer delay than the delay-line can do at the moment. because the clock function is called after the DSP tick (like a message-function), the memory can be allocated here without disturbing the audio */
+void hsd_delay_grow(t_hsd_delay *x){
+    
+    t_float delay_time_ms = x->grow_ms;
+    
+    // sanity checking
+    if(delay_time_ms > x->max_delay_ms){
+        delay_time_ms = x->max_delay_ms;
+    }
+    if(delay_time_ms <= x->delay_time_ms){
+        return;
+    }
+    
+    // let the delay-line grow
+    if(!hsd_delayline_grow(&x->delay_line, hsd_delayline_samples(x->sr, delay_time_ms))){
+        error("hsd_delay~: cannot allocate memory for a delay time of %f ms", delay_time_ms);
+        return;
+    }
     x->delay_time_ms = delay_time_ms;
     
 }
@@ -122,13 +152,32 @@ void hsd_delay_delaytime(t_hsd_delay *x, t_floatarg f){
 /* function for resetting the delay line, executed when a bang message is received by any inlet */
 void hsd_delay_bang(t_hsd_delay *x){
     
-    t_int i;
-    // set all values of the delay line to zero
-    for (i=0; i<x->delay_line_length; i++) {
-        x->delay_line[i] =0.0;
+    // set all values of the delay line to zero and reset the write pointer
+    hsd_delayline_clear(&x->delay_line);
+    x->interp_state = 0;
+    
+}
+
+/* function for selecting the interpolation mode, executed when an "interpolation" message is received */
+void hsd_delay_interpolation(t_hsd_delay *x, t_symbol *s){
+    
+    int interpolation = hsd_interp_mode(s);
+    
+    // sanity checking
+    if(interpolation < 0){
+        error("hsd_delay~: unknown interpolation mode: %s. use linear, lagrange, hermite or allpass", s->s_name);
+        return;
     }
-    // reset the write pointer
-    x->write_index = 0;
+    x->interpolation = interpolation;
+    x->interp_state = 0;
+    
+}
+
+
+/* prints how much memory the delay-lines of the whole library take, executed when a "stats" message is received */
+void hsd_delay_stats(t_hsd_delay *x){
+    
+    hsd_arena_stats("hsd_delay~");
     
 }
 
@@ -138,39 +187,35 @@ void hsd_delay_dsp(t_hsd_delay *x, t_signal **sp)
     /* check if samplerate has changed */
     if(x->sr != sp[0]->s_sr){
         
-        
-        t_int i;
-        /* store the size of the delay-line. if the length of the delay-line needs to be changed, you need the new size and the old size */
-        t_int oldbytes = x->delay_bytes;
-        
         /* store the new sample rate */
         x->sr = sp[0]->s_sr;
         
-        /* reallocate the delay-line. this process is similar to the one in the new-instance-routine except the function "resizebytes()" instead of "getbytes()" */
-        t_int delay_line_length = (t_int)(x->sr * DELMAX/1000 + 1);
-        x->delay_bytes = delay_line_length * sizeof(t_float);
-        x->delay_line = (t_float*)resizebytes((void*)x->delay_line,oldbytes, x->delay_bytes);
-        if(x->delay_line == NULL){
-            error("hsd_delay~: cannot reallocate %f bytes of memory", x->delay_bytes);
+        /* the delay-line needs more samples for the same delay time at a higher sample rate. the old content doesn´t fit to the new sample rate anyway, so the delay-line is reset instead of grown: it is cleared with a single memset or replaced by a fresh (already zeroed) one, nothing is copied */
+        if(!hsd_delayline_reset(&x->delay_line, hsd_delayline_samples(x->sr, x->delay_time_ms))){
+            error("hsd_delay~: cannot reallocate the delay-line");
+            // the old delay-line is gone: forget the sample rate, so the next DSP start tries again instead of running without delay-line
+            x->sr = 0;
             return;
         }
-        for (i=0; i<delay_line_length; i++) {
-            x->delay_line[i] =0.0;
-        }
-        x->delay_line_length = delay_line_length;
-        x->write_index = 0;
-        
-        //renew the offset between read and write pointer
-        x->delay_length = x->sr * x->delay_time_ms/1000 + 1;
         
     }
     
+    /* check if the block size has changed and (re)allocate the vector for the delay times in samples */
+    if(x->delay_vec_n != sp[0]->s_n){
+        if(x->delay_vec){
+            freebytes(x->delay_vec, x->delay_vec_n * sizeof(t_float));
+        }
+        x->delay_vec_n = sp[0]->s_n;
+        x->delay_vec = (t_float*)getbytes(x->delay_vec_n * sizeof(t_float));
+    }
+    
     /* add the objects signal processing to the signal-chain of puredata */
     dsp_add(hsd_delay_perform,
-            4,
+            5,
             x,
             sp[0]->s_vec,
             sp[1]->s_vec,
+            sp[2]->s_vec,
             sp[0]->s_n);
 }
 
@@ -180,134 +225,164 @@ t_int *hsd_delay_perform(t_int *w)
 {
     t_hsd_delay *x = (t_hsd_delay *) (w[1]);            //object data
     t_float *input = (t_float *) (w[2]);                //input-vector
-    t_float *output = (t_float *) (w[3]);               //output-vector
-    t_int n = w[4];                                     //buffer-size
+    t_float *delay_in = (t_float *) (w[3]);             //delay time-vector (ms)
+    t_float *output = (t_float *) (w[4]);               //output-vector
+    t_int n = w[5];                                     //buffer-size
     
     /* get needed data from data struct */
-    t_float *delay_line = x->delay_line;
-    t_int read_index = x->read_index;
-    t_int write_index = x->write_index;
-    t_int delay_length = x->delay_length;
-    t_int delay_line_length = (int)(x->delay_line_length);
-    
-    /* init variables need for interpolation */
-    
-    // the next lower integer-value of the delay-length. -> the next accessable array-position
-    t_int idelay;
-    
-    // the factor for the interpolation -> the offset between the real delay-length and the next smaller integer value of the delay-length
-    t_float fraction;
+    t_float *delay_line = x->delay_line.buffer;
+    t_int write_index = x->delay_line.write_index;
+    t_int mask = x->delay_line.mask;
+    int interpolation = x->interpolation;
+    t_float interp_state = x->interp_state;
+    t_float *delay_vec = x->delay_vec;
+    
+    // factor for converting ms to samples
+    t_float ms2samples = x->sr / 1000;
+    
+    // the longest delay in samples: what the delay-line can do right now (without the guard samples for the interpolation), but never more than the maximum delay time
+    t_float limit = x->delay_line.length - HSD_DELAYLINE_GUARD;
+    t_float max_delay = x->max_delay_ms * ms2samples;
+    if (limit > max_delay) {
+        limit = max_delay;
+    }
     
-    // the sample that is stored in the next lower accessable array-position
-    t_float samp1;
+    // the longest delay that was asked for in this block
+    t_float longest = 0;
     
-    // the sample that is stored in the next higher accessable array-position
-    t_float samp2;
-
-    /* variable for storing the outputsample */
-    t_float out_sample;
+    /* variables for storing the delay and the outputsample */
+    t_float delay_length, out_sample;
+    t_int i;
     
-    //the second read index, used to read out the second sample used for interpolation
-    t_int read_index2;
     
+    // check if the delay time is constant for the whole block
+    for (i=1; i<n; i++) {
+        if (delay_in[i] != delay_in[0]) {
+            break;
+        }
+    }
     
-    /* DSP-Loop */
-    while (n--) {
-        
-        // truncate the delay-length, so an array-entry can be accessed with it. (truncate -> round to next lower integer value)
-        idelay = trunc(delay_length);
+    if (i >= n) {
         
-        // calculate the factor for interpolation
-        fraction = delay_length - idelay;
+        /* fast path: the delay time doesn´t change within the block, so it is converted and checked only once */
         
-        //set the offset between read & write; wrap it into legal space if needed
-        read_index = write_index - idelay;
-        read_index2 = read_index - 1;
-        while (read_index < 0) {
-            read_index += delay_line_length;
+        longest = delay_length = delay_in[0] * ms2samples;
+        if (delay_length > limit) {
+            delay_length = limit;
         }
-        while (read_index2 < 0) {
-            read_index2 += delay_line_length;
-        }
-        
-        // read the two samples for interpolation
-        samp1 = delay_line[read_index];
-        samp2 = delay_line[read_index2];
         
-        //quick buffer delayline-output before reading the input sample, so in case of shared input- and output-buffers, the input sample won´t be the recent written output-sample
-        
-        out_sample = samp1 * fraction + samp2 * (1.0-fraction);
-
+        /* DSP-Loop */
+        for (i=0; i<n; i++) {
+            
+            // read the delayed sample, interpolated with the selected interpolation mode (see hsd_library.h)
+            //quick buffer delayline-output before reading the input sample, so in case of shared input- and output-buffers, the input sample won´t be the recent written output-sample
+            out_sample = hsd_delayline_read(delay_line, mask, write_index, delay_length, interpolation, &interp_state);
+            
+            // write the input of the delay line
+            delay_line[write_index] = input[i];
+            
+            output[i] = out_sample;
+            
+            //increment and wrap the write_index
+            write_index = (write_index + 1) & mask;
+        }
         
-        // write the input of the delay line
-        delay_line[write_index++] = *input++;
+    }else{
         
-        *output++ = out_sample;
+        /* modulated delay: convert all delay times of the block to samples first. this loop has no dependencies between the samples, so the compiler can vectorize it. the delay time vector may be the same as the output vector, so it has to be completely read before the first output sample is written */
+        for (i=0; i<n; i++) {
+            delay_length = delay_in[i] * ms2samples;
+            longest = (delay_length > longest) ? delay_length : longest;
+            delay_vec[i] = (delay_length > limit) ? limit : delay_length;
+        }
         
-        //reset the write_index
-        if(write_index >= delay_line_length){
-            write_index -= delay_line_length;
+        /* DSP-Loop */
+        for (i=0; i<n; i++) {
+            
+            // read the delayed sample, interpolated with the selected interpolation mode (see hsd_library.h)
+            out_sample = hsd_delayline_read(delay_line, mask, write_index, delay_vec[i], interpolation, &interp_state);
+            
+            // write the input of the delay line
+            delay_line[write_index] = input[i];
+            
+            output[i] = out_sample;
+            
+            //increment and wrap the write_index
+            write_index = (write_index + 1) & mask;
         }
     }
-    x->write_index = write_index;
     
-    return w+5;
+    x->interp_state = interp_state;
+    x->delay_line.write_index = write_index;
+    
+    // the delay-line is too short for the delay time: let it grow right after this DSP tick
+    if (longest > limit && limit < max_delay) {
+        x->grow_ms = longest / ms2samples;
+        clock_delay(x->grow_clock, 0);
+    }
+    
+    return w+6;
 }
 
 
 /* free function that is called when the object is destroyed */
 void hsd_delay_free(t_hsd_delay *x)
 {
-    freebytes(x->delay_line, x->delay_bytes);
+    hsd_delayline_free(&x->delay_line);
+    if(x->delay_vec){
+        freebytes(x->delay_vec, x->delay_vec_n * sizeof(t_float));
+    }
+    clock_free(x->grow_clock);
 }
 
 
 
 
 /* new-instance routine */
-void *hsd_delay_new(t_floatarg f)
+void *hsd_delay_new(t_floatarg f1, t_floatarg f2)
 {
     // set the initial delay time either by default or creation argument
     t_float delay_time_ms;
-    if (f) {
-        delay_time_ms=f;
+    if (f1) {
+        delay_time_ms=f1;
     }else{
         delay_time_ms = DEFAULT_TIME;
     }
     
     t_hsd_delay *x = (t_hsd_delay *)pd_new(hsd_delay_class);
     
-    // creating the active inlet. the function specified in the last argument is called, when the inlet receives a message
-    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("delaytime"));    
-    //creating the signal-outlet
-    outlet_new(&x->obj, gensym("signal"));
-    
     // getting sample rate
     x->sr = sys_getsr();
     
-    if(delay_time_ms > DELMAX || delay_time_ms<=0.0){
+    // the maximum delay time is the second creation argument (default DELMAX)
+    x->max_delay_ms = hsd_maxdelay(f2, DELMAX, delay_time_ms);
+    
+    if(delay_time_ms > x->max_delay_ms || delay_time_ms<=0.0){
         error("hsd_delay~: illegal delay time: %f. delay time set to 10ms", delay_time_ms);
         delay_time_ms=10.0;
     }
     x->delay_time_ms = delay_time_ms;
-    x->delay_length = x->sr * delay_time_ms/1000 + 1;
     
+    // creating the signal inlet for the delay time. if no signal is connected, it takes floats, starting with the initial delay time
+    x->delay_inlet = signalinlet_new(&x->obj, delay_time_ms);
+    
+    //creating the signal-outlet
+    outlet_new(&x->obj, gensym("signal"));
     
-    //Allocating the DelayLine
-    t_int delay_line_length = (t_int)(x->sr * DELMAX/1000 + 1);
-    x->delay_bytes = delay_line_length * sizeof(t_float);
-    x->delay_line = (t_float*)getbytes(x->delay_bytes);
-    if(x->delay_line == NULL){
-        error("hsd_delay~: cannot allocate %f bytes of memory", x->delay_bytes);
+    // the vector for the delay times is allocated in the dsp-init-routine, the clock lets the delay-line grow
+    x->delay_vec = NULL;
+    x->delay_vec_n = 0;
+    x->grow_clock = clock_new(x, (t_method)hsd_delay_grow);
+    x->grow_ms = 0;
+    x->interpolation = HSD_INTERP_LINEAR;
+    x->interp_state = 0;
+    
+    
+    //Allocating the DelayLine, just long enough for the initial delay time
+    if(!hsd_delayline_grow(&x->delay_line, hsd_delayline_samples(x->sr, delay_time_ms))){
+        error("hsd_delay~: cannot allocate memory for the delay-line");
         return NULL;
     }
-    t_int i;
-    for (i=0; i<delay_line_length; i++) {
-        x->delay_line[i] =0.0;
-    }
-    
-    x->delay_line_length = delay_line_length;
-    x->write_index=0;
     
     return x;
 }
@@ -321,16 +396,26 @@ void hsd_delay_tilde_setup(void){
                                sizeof(t_hsd_delay),
                                0,
                                A_DEFFLOAT,
+                               A_DEFFLOAT,
                                0);
     
     CLASS_MAINSIGNALIN(hsd_delay_class, t_hsd_delay, x_f);
     
+    // calculate the coefficient table of the interpolation
+    hsd_interp_init();
+    
     
     class_addmethod(hsd_delay_class,
                     (t_method)hsd_delay_dsp,
                     gensym("dsp"),
                     0);
     
+    class_addmethod(hsd_delay_class,
+                    (t_method)hsd_delay_interpolation,
+                    gensym("interpolation"),
+                    A_SYMBOL,
+                    0);
+
     class_addmethod(hsd_delay_class,
                     (t_method)hsd_delay_delaytime,
                     gensym("delaytime"),
@@ -339,6 +424,11 @@ void hsd_delay_tilde_setup(void){
 
     class_addbang(hsd_delay_class, hsd_delay_bang);
     
+    class_addmethod(hsd_delay_class,
+                    (t_method)hsd_delay_stats,
+                    gensym("stats"),
+                    0);
+    
     
     post ("hsd_delay~ by David Bau, HS Duesseldorf ");
     
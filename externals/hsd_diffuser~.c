@@ -0,0 +1,493 @@
+/* hsd_diffuser~ external from the HSD-Library, University of Applied Science Duesseldorf
+ Created 18.10.2026
+
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This is a diffuser: a chain of up to 16 allpass filters (see hsd_allpass~). Allpass filters don´t change the frequency response of a signal, but smear it in time. A short click becomes a dense cloud of small echoes, which is why diffusers are put in front of (or into) reverbs: the reverb then doesn´t start with single, audible echoes.
+
+
+ Series (default):
+
+        —>x      ___________      ___________              ___________      y—>
+        o——————>|allpass 1  |———>|allpass 2  |———> ... ———>|allpass N  |———>o
+                 ‾‾‾‾‾‾‾‾‾‾‾      ‾‾‾‾‾‾‾‾‾‾‾               ‾‾‾‾‾‾‾‾‾‾‾
+
+
+ Nested (creation argument "nested"):
+
+ The allpass filters are used in pairs. The second allpass of a pair sits inside the delay-path of the first one ("nested allpass" after Gardner), so the echoes of the outer allpass are diffused again by the inner one every time they go around the loop. The pairs are in series, with an odd number of stages the last one is a normal allpass.
+
+             -----------------------(*g1)<-------------------------
+            |                                                      |
+     —>x    v        ________________      ______________________  |             y—>
+     o—————(+)—-o——>|_____z-D1_______|———>|allpass 2 (g2, D2)    |—-o-—(+)---———>o
+                |                          ‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾      ^
+                |                                                      |
+                 ------------------------>(*-g1)-----------------------
+
+
+ Compared to a chain of hsd_allpass~ objects:
+
+    -> all delay-lines lie in one block of memory (a delay-bank, see hsd_library.h) with one write-pointer.
+    -> the whole chain is calculated in one perform-routine. the signal vector is processed in chunks (at most HSD_DIFFUSER_CHUNK samples, never more than the shortest delay). the signal of a chunk is kept in one small array that every allpass filters in place, so it never leaves the cache between the stages, and no signal vectors of pd are needed between the stages.
+    -> because a chunk is never longer than the delays, an allpass only reads samples that were written before the chunk started. the loops over the chunk have no dependencies between the samples and are calculated with SIMD instructions by the compiler.
+
+
+ Messages:
+
+    -> "delays <list>": the delay times of the allpass filters in ms, the first value for the first allpass and so on. a single value sets all allpass filters.
+    -> "gains <list>": the gains of the allpass filters (-1...1, not including -1 and 1), the same way.
+    -> "bang": clears all delay-lines.
+
+ */
+
+#include "m_pd.h"
+#include "math.h"
+#include "hsd_library.h"
+
+/* the maximum number of allpass filters */
+#define HSD_DIFFUSER_MAX 16
+
+/* the longest chunk of samples that is processed in one go */
+#define HSD_DIFFUSER_CHUNK 64
+
+/* defaults */
+#define DELMAX 100  //default maximum delay time in ms
+#define DEFAULT_TIME 10  //illegal delay times are set to 10ms
+
+/* the default delay times in ms. the first four are the input diffusers of the plate reverb of Jon Dattorro ("Effect Design, Part 1", 1997) */
+static const t_float diffuser_times_ms[HSD_DIFFUSER_MAX] = {4.771, 3.595, 12.735, 9.307, 2.293, 6.109, 7.919, 10.711, 1.709, 5.297, 8.513, 11.317, 13.907, 14.891, 15.733, 16.301};
+
+/* data struct */
+typedef struct _hsd_diffuser{
+
+    /* the object data itself */
+    t_object obj;
+
+    /* sample rate */
+    t_float sr;
+
+    /* the number of allpass filters */
+    int stages;
+
+    /* 1 if the allpass filters are nested in pairs, 0 if they are all in series */
+    int nested;
+
+    /* the maximum delay time in ms */
+    t_float max_delay_ms;
+
+    /* the delay-lines of all allpass filters in one block of memory */
+    t_hsd_delaybank lines;
+
+    /* the parameters of every allpass filter: delay time in ms, the delay split into whole samples and fraction, and the gain */
+    t_float delay_ms[HSD_DIFFUSER_MAX];
+    t_int idelay[HSD_DIFFUSER_MAX];
+    t_float fraction[HSD_DIFFUSER_MAX];
+    t_float gain[HSD_DIFFUSER_MAX];
+
+    /* the number of samples that are processed in one chunk */
+    t_int chunk;
+
+    /* dummy float for CLASS_MAINSIGNALIN */
+    t_float x_f;
+
+}t_hsd_diffuser;
+
+static t_class *hsd_diffuser_class;
+
+
+/* function prototypes */
+void *hsd_diffuser_new(t_symbol *s, short argc, t_atom *argv);
+void hsd_diffuser_dsp(t_hsd_diffuser *x, t_signal **sp);
+t_int *hsd_diffuser_perform(t_int *w);
+void hsd_diffuser_free(t_hsd_diffuser *x);
+void hsd_diffuser_stats(t_hsd_diffuser *x);
+void hsd_diffuser_delays(t_hsd_diffuser *x, t_symbol *s, short argc, t_atom *argv);
+void hsd_diffuser_gains(t_hsd_diffuser *x, t_symbol *s, short argc, t_atom *argv);
+void hsd_diffuser_bang(t_hsd_diffuser *x);
+void hsd_diffuser_update(t_hsd_diffuser *x);
+
+
+/* calculates the delays in samples from the delay times in ms and the length of the chunks. called whenever a delay time or the sample rate changes */
+void hsd_diffuser_update(t_hsd_diffuser *x){
+
+    int k;
+    t_float delay;
+
+    x->chunk = HSD_DIFFUSER_CHUNK;
+
+    for (k=0; k<x->stages; k++) {
+
+        delay = x->sr * x->delay_ms[k]/1000;
+
+        // the linear interpolation needs at least one sample of delay
+        if (delay < 1) {
+            delay = 1;
+        }
+        x->idelay[k] = (t_int)delay;
+        x->fraction[k] = delay - x->idelay[k];
+
+        // a chunk must not be longer than the shortest delay, otherwise samples would be read that are written in the same chunk
+        if (x->idelay[k] < x->chunk) {
+            x->chunk = x->idelay[k];
+        }
+    }
+}
+
+/* function for setting the delay times in ms, executed when a "delays" message is received */
+void hsd_diffuser_delays(t_hsd_diffuser *x, t_symbol *s, short argc, t_atom *argv){
+
+    int k;
+    t_float delay_time_ms;
+    t_float longest = 0;
+
+    if (argc < 1) {
+        return;
+    }
+
+    for (k=0; k<x->stages && (k<argc || argc==1); k++) {
+
+        delay_time_ms = atom_getfloatarg((argc==1) ? 0 : k, argc, argv);
+
+        // sanity checking
+        if(delay_time_ms > x->max_delay_ms || delay_time_ms <= 0.0){
+            error("hsd_diffuser~: illegal delay time for allpass %d: %f. delay time set to %dms", k+1, delay_time_ms, DEFAULT_TIME);
+            delay_time_ms = DEFAULT_TIME;
+        }
+        x->delay_ms[k] = delay_time_ms;
+    }
+
+    for (k=0; k<x->stages; k++) {
+        if (x->delay_ms[k] > longest) {
+            longest = x->delay_ms[k];
+        }
+    }
+
+    // let the delay-lines grow, if they are too short for the new delay times
+    if(!hsd_delaybank_grow(&x->lines, hsd_delayline_samples(x->sr, longest))){
+        error("hsd_diffuser~: cannot allocate memory for a delay time of %f ms", longest);
+        return;
+    }
+
+    hsd_diffuser_update(x);
+}
+
+/* function for setting the gains, executed when a "gains" message is received */
+void hsd_diffuser_gains(t_hsd_diffuser *x, t_symbol *s, short argc, t_atom *argv){
+
+    int k;
+    t_float g;
+
+    if (argc < 1) {
+        return;
+    }
+
+    for (k=0; k<x->stages && (k<argc || argc==1); k++) {
+
+        g = atom_getfloatarg((argc==1) ? 0 : k, argc, argv);
+
+        // sanity checking. with a gain of 1 the allpass would never stop ringing
+        if (g >= 1 || g <= -1) {
+            error("hsd_diffuser~: illegal gain for allpass %d: %f. gain set to 0.5", k+1, g);
+            g = 0.5;
+        }
+        x->gain[k] = g;
+    }
+}
+
+/* function for clearing the delay-lines, executed when a bang message is received */
+void hsd_diffuser_bang(t_hsd_diffuser *x){
+
+    hsd_delaybank_clear(&x->lines);
+}
+
+/* prints how much memory the delay-lines of the whole library take, executed when a "stats" message is received */
+void hsd_diffuser_stats(t_hsd_diffuser *x){
+
+    hsd_arena_stats("hsd_diffuser~");
+
+}
+
+
+/* the dsp-init-routine */
+void hsd_diffuser_dsp(t_hsd_diffuser *x, t_signal **sp)
+{
+    int k;
+    t_float longest = 0;
+
+    /* check for sample rate change. the old content doesn´t fit to the new sample rate, so the delay-lines are reset instead of grown (one memset or a fresh, already zeroed block) */
+    if(x->sr != sp[0]->s_sr){
+
+        x->sr = sp[0]->s_sr;
+
+        for (k=0; k<x->stages; k++) {
+            if (x->delay_ms[k] > longest) {
+                longest = x->delay_ms[k];
+            }
+        }
+
+        if(!hsd_delaybank_reset(&x->lines, hsd_delayline_samples(x->sr, longest))){
+            error("hsd_diffuser~: cannot reallocate the delay-lines");
+            // the old delay-lines is gone: forget the sample rate, so the next DSP start tries again instead of running without delay-lines
+            x->sr = 0;
+            return;
+        }
+
+        hsd_diffuser_update(x);
+    }
+
+    /* add the objects signal processing to the signal-chain of puredata */
+    dsp_add(hsd_diffuser_perform,
+            4,
+            x,
+            sp[0]->s_vec,
+            sp[1]->s_vec,
+            sp[0]->s_n);
+}
+
+
+/* the perform routine */
+t_int *hsd_diffuser_perform(t_int *w)
+{
+    t_hsd_diffuser *x = (t_hsd_diffuser *) (w[1]);      //object data
+    t_float *input = (t_float *) (w[2]);                //input-vector
+    t_float *output = (t_float *) (w[3]);               //output-vector
+    t_int n = w[4];                                     //buffer-size
+
+    /* get needed data from data struct */
+    t_float *memory = x->lines.buffer;
+    int stages = x->stages;
+    int nested = x->nested;
+    t_int length = x->lines.length;
+    t_int mask = x->lines.mask;
+    t_int write_index = x->lines.write_index;
+
+    // the signal of the current chunk, which is filtered in place by one allpass after the other, and the outputs of the delay-lines of the outer and inner allpass
+    t_float sig[HSD_DIFFUSER_CHUNK];
+    t_float outer[HSD_DIFFUSER_CHUNK];
+    t_float inner[HSD_DIFFUSER_CHUNK];
+
+    t_float *line, *write, g, xDL;
+    t_int chunk, i;
+    int k;
+
+    /* DSP-Loop, one chunk after the other */
+    while (n > 0) {
+
+        chunk = (n < x->chunk) ? n : x->chunk;
+
+        // the chunk must not run over the end of the delay-lines, so the samples of a chunk are written to one contiguous piece of memory
+        if (chunk > length - write_index) {
+            chunk = length - write_index;
+        }
+
+        for (i=0; i<chunk; i++) {
+            sig[i] = input[i];
+        }
+
+        for (k=0; k<stages; k++) {
+
+            line = memory + k * length;
+            write = line + write_index;
+
+            // output of the delay-line yDL
+            hsd_delaybank_read(line, mask, write_index, x->idelay[k], x->fraction[k], outer, chunk);
+
+            /* nested: the output of the delay-line of this allpass goes through the next allpass before it is used */
+            if (nested && k+1 < stages) {
+
+                t_float *inner_line = memory + (k+1) * length;
+                t_float *inner_write = inner_line + write_index;
+                t_float inner_g = x->gain[k+1];
+
+                hsd_delaybank_read(inner_line, mask, write_index, x->idelay[k+1], x->fraction[k+1], inner, chunk);
+
+                for (i=0; i<chunk; i++) {
+                    // xDL = x(n) + g*yDL, the input of the inner allpass is the output of the outer delay-line
+                    xDL = outer[i] + inner_g * inner[i];
+                    inner_write[i] = xDL;
+                    // y(n) = yDL - g*xDL
+                    outer[i] = inner[i] - inner_g * xDL;
+                }
+            }
+
+            /* the (outer) allpass, filtering the chunk in place */
+            g = x->gain[k];
+            for (i=0; i<chunk; i++) {
+                // xDL = x(n) + g*yDL
+                xDL = sig[i] + g * outer[i];
+                write[i] = xDL;
+                // y(n) = yDL - g*xDL
+                sig[i] = outer[i] - g * xDL;
+            }
+
+            // the inner allpass is done
+            if (nested && k+1 < stages) {
+                k++;
+            }
+        }
+
+        for (i=0; i<chunk; i++) {
+            output[i] = sig[i];
+        }
+
+        write_index = (write_index + chunk) & mask;
+
+        input += chunk;
+        output += chunk;
+        n -= chunk;
+    }
+
+    x->lines.write_index = write_index;
+
+    return w+5;
+}
+
+
+/* free function that is called when the object is destroyed */
+void hsd_diffuser_free(t_hsd_diffuser *x)
+{
+    hsd_delaybank_free(&x->lines);
+}
+
+
+/* new-instance routine */
+void *hsd_diffuser_new(t_symbol *s, short argc, t_atom *argv)
+{
+    // set default values
+    t_float stages = 4;
+    t_float max_delay_ms = 0;
+    t_float longest;
+    t_atom delays[HSD_DIFFUSER_MAX];
+    int i, k, floats = 0;
+
+    t_hsd_diffuser *x = (t_hsd_diffuser *)pd_new(hsd_diffuser_class);
+
+    x->nested = 0;
+
+    /* getting creation arguments: the number of allpass filters and the maximum delay time. the symbol "nested" nests the allpass filters in pairs */
+    for (i=0; i<argc; i++) {
+        if (argv[i].a_type == A_SYMBOL) {
+            if (atom_getsymbol(argv + i) == gensym("nested")) {
+                x->nested = 1;
+            }
+            else {
+                error("hsd_diffuser~: unknown argument %s", atom_getsymbol(argv + i)->s_name);
+            }
+        }
+        else {
+            if (floats == 0) {
+                stages = atom_getfloat(argv + i);
+            }
+            else if (floats == 1) {
+                max_delay_ms = atom_getfloat(argv + i);
+            }
+            floats++;
+        }
+    }
+
+    // sanity checking
+    if (stages < 1 || stages > HSD_DIFFUSER_MAX) {
+        error("hsd_diffuser~: illegal number of allpass filters: %f. number set to 4", stages);
+        stages = 4;
+    }
+    x->stages = stages;
+
+    /* the maximum delay time (default DELMAX). it is never shorter than the initial delay times of the stages in use and the fallback for illegal delay times, so they always fit */
+    longest = DEFAULT_TIME;
+    for (k=0; k<x->stages; k++) {
+        if (diffuser_times_ms[k] > longest) {
+            longest = diffuser_times_ms[k];
+        }
+    }
+    x->max_delay_ms = hsd_maxdelay(max_delay_ms, DELMAX, longest);
+
+    //creating the signal-outlet
+    outlet_new(&x->obj, gensym("signal"));
+
+    // getting sample rate
+    x->sr = sys_getsr();
+
+    x->lines.buffer = NULL;
+    x->lines.lines = x->stages;
+    x->lines.length = 0;
+    x->lines.mask = 0;
+    x->lines.bytes = 0;
+    x->lines.write_index = 0;
+
+    /* the initial delay times come from the table above, the gains are 0.7 */
+    for (k=0; k<x->stages; k++) {
+        x->delay_ms[k] = diffuser_times_ms[k];
+        SETFLOAT(delays + k, diffuser_times_ms[k]);
+        x->gain[k] = 0.7;
+    }
+
+    /* Allocating the delay-lines, just long enough for the initial delay times */
+    hsd_diffuser_delays(x, gensym("delays"), x->stages, delays);
+    if (x->lines.buffer == NULL) {
+        error("hsd_diffuser~: cannot allocate memory for the delay-lines");
+        return NULL;
+    }
+
+    return x;
+}
+
+/* setup routine */
+void hsd_diffuser_tilde_setup(void){
+
+    hsd_diffuser_class = class_new(gensym("hsd_diffuser~"),
+                                   (t_newmethod)hsd_diffuser_new,
+                                   (t_method)hsd_diffuser_free,
+                                   sizeof(t_hsd_diffuser),
+                                   0,
+                                   A_GIMME,
+                                   0);
+
+    CLASS_MAINSIGNALIN(hsd_diffuser_class, t_hsd_diffuser, x_f);
+
+
+    class_addmethod(hsd_diffuser_class,
+                    (t_method)hsd_diffuser_dsp,
+                    gensym("dsp"),
+                    0);
+
+    class_addmethod(hsd_diffuser_class,
+                    (t_method)hsd_diffuser_delays,
+                    gensym("delays"),
+                    A_GIMME,
+                    0);
+
+    class_addmethod(hsd_diffuser_class,
+                    (t_method)hsd_diffuser_gains,
+                    gensym("gains"),
+                    A_GIMME,
+                    0);
+
+    class_addbang(hsd_diffuser_class, hsd_diffuser_bang);
+
+    class_addmethod(hsd_diffuser_class,
+                    (t_method)hsd_diffuser_stats,
+                    gensym("stats"),
+                    0);
+
+
+    post ("hsd_diffuser~ from the hsd_library, HS Duesseldorf ");
+
+}
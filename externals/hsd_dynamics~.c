@@ -0,0 +1,882 @@
+/* hsd_dynamics~ external from the HSD-Library, University of Applied Science Duesseldorf
+ Created 18.10.2026
+
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This is a compressor / limiter with lookahead for up to 16 channels. It does the work of a patch with hsd_peakf~ or hsd_rmsf~ (level detection), hsd_delay~ (lookahead) and several arithmetic objects for the gain calculation, in one perform-routine. The structure is the one of the compressor in the DAFX book by Udo Zoelzer, but the gain is calculated and smoothed in dB (log domain):
+
+
+    input --+--------------------------------------------> lookahead delay ---> (x) ---> output
+            |                                                                    ^
+    (sidechain)                                                                  |
+            |                                                                    |
+            +--> level detection --> dB --> linking --> gain computer --> hold --> smoothing (attack/release) --> + makeup --> linear gain
+
+
+ Level detection: the level is measured either as the absolute value of the samples ("detector peak", the rectifier of hsd_peakf~) or as the mean square over the averaging time ("detector rms", the formula of hsd_rmsf~):
+
+    x^2(n) = (1-TAV) * x^2(n-1) + TAV * x(n) * x(n)
+
+ and converted to dB with the fast logarithm of the library (hsd_db_block(), see hsd_library.h), with a floor of -120 dB.
+
+ Gain computer: above the threshold T, the level L is reduced by the ratio R. The gain in dB is
+
+    G = 0                                   for L < T
+    G = (1/R - 1) * (L - T)                 for L > T
+
+ With a knee of width W (in dB), the change from G = 0 to the full ratio is smooth, in the range T - W/2 ... T + W/2 the gain is
+
+    G = (1/R - 1) * (L - T + W/2)^2 / (2*W)
+
+ A ratio of 0 stands for an infinite ratio (limiter): the level never exceeds the threshold.
+
+ Smoothing: the gain follows G with the attack time, if more reduction is needed, and with the release time otherwise, like the envelope followers of the library:
+
+    g(n) = g(n-1) + AT * (G(n) - g(n-1))      -> if G(n) < g(n-1) (attack)
+    g(n) = g(n-1) + RT * (G(n) - g(n-1))      -> otherwise (release)
+
+ Lookahead: the signal itself is delayed by the lookahead time, the level detection gets the signal without the delay. So the gain is already reduced when a peak arrives at the output. Before the smoothing, G is replaced by the lowest G of the last lookahead time (hold): a peak that lasts only a few samples (e.g. the top of a sine wave) keeps the gain going down until it arrives at the output, and the gain doesn´t rise again in between. The lowest value of a sliding window is found with a queue (the "monotonic queue"): a new G removes all values at the end of the queue that are not lower than itself (they can never be the lowest value again), and the value at the front of the queue is removed when it is older than the window. So the front of the queue is always the lowest value of the window, and every G is added and removed only once, no matter how long the window is. With an attack time shorter than the lookahead time, fast transients pass a limiter without overshoot. The delay is a ring-buffer of the library (t_hsd_delayline, see hsd_delay~.c), the whole delay of the object (its latency) is exactly the lookahead time.
+
+ Sidechain: with the third creation argument 1, the object gets a second signal inlet for every channel. The level detection then uses these signals instead of the inputs (e.g. ducking: music at the inputs, the voice at the sidechain inlets).
+
+ Linking: if every channel is compressed on its own, the stereo image moves when only one side is loud. With "link 1", all channels use the highest level of all channels (in dB), so all channels get the same gain. Values between 0 and 1 mix the own level and the highest level.
+
+
+ Compared to a patch of single objects, the fused object saves a lot of work:
+
+    -> there is only one dsp_add() entry for all channels, and the signals between the stages are not written to signal vectors of Pd, but to a scratch buffer of the object.
+    -> the stages run one after the other over the whole block. only the rms-averaging and the hold and smoothing of the gain depend on the sample before, all other stages (rectifier, logarithm, linking, gain computer, dB to linear gain, lookahead delay) are loops without dependencies, which the compiler calculates with SIMD instructions. inside these loops, the selection between the cases of the gain computer and the maximum of the levels are written without "if" or "?:" (see hsd_meter~.c).
+    -> the gain is converted from dB to a linear factor with a fast exponential function (hsd_gain_block(), see hsd_library.h), there is no call of log() or pow() per sample.
+    -> the lookahead delay has a fixed length, so it is written and read in contiguous pieces with memcpy() and simple loops, not sample by sample with wrapped pointers.
+
+
+ Inlets: the signals of all channels, then the sidechain signals of all channels (only with the sidechain argument). The left inlet also takes the messages.
+
+ Outlets: the signals of all channels, and on the right a control outlet for the messages "latency <samples> <ms>" (sent when the DSP is switched on, when the lookahead time changes, and after the message "latency") and "reduction <dB>..." (the gain reduction of all channels, every <interval> blocks).
+
+ Arguments: the number of channels (default 1), the lookahead time in ms (default 5) and the sidechain flag (default 0).
+
+
+ Messages:
+
+    -> "threshold <dB>" (default -20), "ratio <R>" (default 4, 0 = limiter), "knee <dB>" (default 0), "makeup <dB>" (default 0)
+    -> "attack <ms>" (default 5), "release <ms>" (default 100): the times of the gain smoothing
+    -> "detector peak" or "detector rms" (default peak), "time <ms>": the averaging time of the rms-detection (default 10)
+    -> "link <0...1>": channel linking (default 1)
+    -> "lookahead <ms>": the lookahead time (maximum 1000 ms)
+    -> "interval <blocks>": the number of blocks between two "reduction" messages (default 0 = no reduction messages)
+    -> "latency": sends the latency
+    -> "bang": clears the lookahead delay and sets all levels and gains back
+
+ */
+
+#include "m_pd.h"
+#include <math.h>
+#include "hsd_library.h"
+
+/* the maximum number of channels */
+#define HSD_DYNAMICS_MAX 16
+
+/* the longest lookahead time in ms */
+#define HSD_DYNAMICS_LOOKAHEAD_MAX 1000
+
+/* the floor of the level detection in dB */
+#define HSD_DYNAMICS_FLOOR -120
+
+/* the range of the makeup gain in dB */
+#define HSD_DYNAMICS_MAKEUP_MAX 60
+
+/* default values */
+#define DEFAULT_CHANNELS 1
+#define DEFAULT_LOOKAHEAD_MS 5
+#define DEFAULT_THRESHOLD -20
+#define DEFAULT_RATIO 4
+#define DEFAULT_ATTACK_MS 5
+#define DEFAULT_RELEASE_MS 100
+#define DEFAULT_RMS_MS 10
+
+#define EULER 2.718281828459045
+
+/* the detection modes */
+#define HSD_DYNAMICS_PEAK 0
+#define HSD_DYNAMICS_RMS 1
+
+/* data struct */
+typedef struct _hsd_dynamics{
+
+    /* the object data itself */
+    t_object obj;
+
+    /* sample rate and block size */
+    t_float sr;
+    t_int n;
+
+    /* the number of channels, and whether there are sidechain inlets */
+    int channels;
+    int sidechain;
+
+    /* the parameters of the gain computer in dB, and the ratio (0 = limiter) */
+    t_float threshold;
+    t_float ratio;
+    t_float knee;
+    t_float makeup;
+
+    /* attack, release and rms times in ms, and the time coefficients */
+    t_float t_a;
+    t_float t_r;
+    t_float t_rms;
+    t_float AT, RT, TAV;
+
+    /* the detection mode (HSD_DYNAMICS_PEAK or HSD_DYNAMICS_RMS) and the amount of linking (0...1) */
+    int detector;
+    t_float link;
+
+    /* the lookahead time in ms and in samples (the latency of the object) */
+    t_float lookahead_ms;
+    t_int lookahead;
+
+    /* the lookahead delay-lines of all channels, and whether they could be allocated */
+    t_hsd_delayline line[HSD_DYNAMICS_MAX];
+    int ready;
+
+    /* the squared rms-levels and the smoothed gains in dB of all channels */
+    t_float rms2[HSD_DYNAMICS_MAX];
+    t_float gain[HSD_DYNAMICS_MAX];
+
+    /* the queues for the lowest gain of the lookahead time (hold): for every channel a ring-buffer of queue_size (a power of two) gains and the sample-ticks they belong to, and the positions of the front and the end of the queue. the counters may wrap around, only their differences are used */
+    t_float *queue_value;
+    uint32_t *queue_time;
+    t_int queue_size;
+    uint32_t queue_head[HSD_DYNAMICS_MAX];
+    uint32_t queue_tail[HSD_DYNAMICS_MAX];
+    uint32_t now;
+
+    /* the signal vectors of the channels, set by the dsp-init-routine */
+    t_float *in_vec[HSD_DYNAMICS_MAX];
+    t_float *sc_vec[HSD_DYNAMICS_MAX];
+    t_float *out_vec[HSD_DYNAMICS_MAX];
+
+    /* the scratch buffer for the levels and gains of all channels and the highest level (channels+1 vectors of the block size), allocated in the dsp-init-routine */
+    t_float *scratch;
+    t_int scratch_size;
+
+    /* the control outlet, the clock that sends the messages after the DSP tick, the number of blocks between two "reduction" messages and since the last one, the reduction list, and whether the latency has to be sent */
+    t_outlet *control_out;
+    t_clock *clock;
+    int interval;
+    int block_count;
+    int send_reduction;
+    int send_latency;
+    t_atom reduction_list[HSD_DYNAMICS_MAX];
+
+    /* dummy float for CLASS_MAINSIGNALIN */
+    t_float x_f;
+
+}t_hsd_dynamics;
+
+static t_class *hsd_dynamics_class;
+
+
+/* function prototypes */
+void *hsd_dynamics_new(t_symbol *s, short argc, t_atom *argv);
+void hsd_dynamics_free(t_hsd_dynamics *x);
+void hsd_dynamics_dsp(t_hsd_dynamics *x, t_signal **sp);
+t_int *hsd_dynamics_perform(t_int *w);
+void hsd_dynamics_tick(t_hsd_dynamics *x);
+void hsd_dynamics_coefficients(t_hsd_dynamics *x);
+int hsd_dynamics_allocate(t_hsd_dynamics *x, int reset);
+void hsd_dynamics_free_queues(t_hsd_dynamics *x);
+void hsd_dynamics_threshold(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_ratio(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_knee(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_makeup(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_attack(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_release(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_time(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_detector(t_hsd_dynamics *x, t_symbol *s);
+void hsd_dynamics_link(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_lookahead(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_interval(t_hsd_dynamics *x, t_floatarg f);
+void hsd_dynamics_latency(t_hsd_dynamics *x);
+void hsd_dynamics_bang(t_hsd_dynamics *x);
+void hsd_dynamics_write(t_hsd_delayline *d, const t_float *in, t_int n);
+void hsd_dynamics_read(t_hsd_delayline *d, t_int delay, const t_float *gain, t_float *out, t_int n);
+
+
+/* calculates the time coefficients for the current times and sample rate */
+void hsd_dynamics_coefficients(t_hsd_dynamics *x){
+
+    x->AT = 1 - pow(EULER, -2.2/(x->sr * x->t_a * 0.001));
+    x->RT = 1 - pow(EULER, -2.2/(x->sr * x->t_r * 0.001));
+    x->TAV = 1 - pow(EULER, -2.2/(x->sr * x->t_rms * 0.001));
+}
+
+/* makes the lookahead delay-lines long enough for the lookahead time and one block: a whole block is written before it is read (see hsd_dynamics_perform()). with reset, the content is thrown away (sample rate change). returns 0 if the memory could not be allocated. the perform-routine only runs if the delay-lines and the scratch buffer are there. must not be called in the perform-routine */
+int hsd_dynamics_allocate(t_hsd_dynamics *x, int reset){
+
+    t_int samples = x->lookahead + x->n;
+    t_int size;
+    int c, ok = 1;
+
+    for (c=0; c<x->channels; c++) {
+        if (reset) {
+            ok = ok && hsd_delayline_reset(&x->line[c], samples);
+        }else{
+            ok = ok && hsd_delayline_grow(&x->line[c], samples);
+        }
+    }
+
+    /* the queues of the hold hold the gains of lookahead+1 sample-ticks, and the new gain before the oldest one leaves the queue */
+    size = hsd_nextpow2(x->lookahead + 2);
+    if (size > x->queue_size) {
+        hsd_dynamics_free_queues(x);
+        x->queue_value = (t_float*)getbytes(x->channels * size * sizeof(t_float));
+        x->queue_time = (uint32_t*)getbytes(x->channels * size * sizeof(uint32_t));
+        x->queue_size = size;
+        if (x->queue_value == NULL || x->queue_time == NULL) {
+            hsd_dynamics_free_queues(x);
+            ok = 0;
+        }
+    }
+    for (c=0; c<HSD_DYNAMICS_MAX; c++) {
+        x->queue_head[c] = 0;
+        x->queue_tail[c] = 0;
+    }
+
+    if (!ok) {
+        error("hsd_dynamics~: cannot allocate memory for a lookahead time of %f ms", x->lookahead_ms);
+    }
+    x->ready = ok && (x->scratch != NULL);
+    return ok;
+}
+
+/* frees the queues of the hold */
+void hsd_dynamics_free_queues(t_hsd_dynamics *x){
+
+    if (x->queue_value) {
+        freebytes(x->queue_value, x->channels * x->queue_size * sizeof(t_float));
+    }
+    if (x->queue_time) {
+        freebytes(x->queue_time, x->channels * x->queue_size * sizeof(uint32_t));
+    }
+    x->queue_value = NULL;
+    x->queue_time = NULL;
+    x->queue_size = 0;
+}
+
+/* functions for setting the parameters of the gain computer */
+void hsd_dynamics_threshold(t_hsd_dynamics *x, t_floatarg f){
+
+    if (f < HSD_DYNAMICS_FLOOR) {
+        f = HSD_DYNAMICS_FLOOR;
+    }
+    x->threshold = f;
+}
+
+void hsd_dynamics_ratio(t_hsd_dynamics *x, t_floatarg f){
+
+    // 0 is the limiter, ratios between 0 and 1 would be an expander
+    if (f != 0 && f < 1) {
+        error("hsd_dynamics~: illegal ratio: %f. ratio set to 1", f);
+        f = 1;
+    }
+    x->ratio = f;
+}
+
+void hsd_dynamics_knee(t_hsd_dynamics *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->knee = f;
+}
+
+void hsd_dynamics_makeup(t_hsd_dynamics *x, t_floatarg f){
+
+    if (f < -HSD_DYNAMICS_MAKEUP_MAX) {
+        f = -HSD_DYNAMICS_MAKEUP_MAX;
+    }
+    if (f > HSD_DYNAMICS_MAKEUP_MAX) {
+        f = HSD_DYNAMICS_MAKEUP_MAX;
+    }
+    x->makeup = f;
+}
+
+/* functions for setting the attack, release and rms times. a time of 0 ms follows immediately */
+void hsd_dynamics_attack(t_hsd_dynamics *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_a = f;
+    hsd_dynamics_coefficients(x);
+}
+
+void hsd_dynamics_release(t_hsd_dynamics *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_r = f;
+    hsd_dynamics_coefficients(x);
+}
+
+void hsd_dynamics_time(t_hsd_dynamics *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_rms = f;
+    hsd_dynamics_coefficients(x);
+}
+
+/* function for selecting the level detection, executed when a "detector" message is received */
+void hsd_dynamics_detector(t_hsd_dynamics *x, t_symbol *s){
+
+    if (s == gensym("peak")) {
+        x->detector = HSD_DYNAMICS_PEAK;
+    }else if (s == gensym("rms")) {
+        x->detector = HSD_DYNAMICS_RMS;
+    }else{
+        error("hsd_dynamics~: unknown detector: %s. use peak or rms", s->s_name);
+    }
+}
+
+/* function for setting the amount of channel linking */
+void hsd_dynamics_link(t_hsd_dynamics *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    if (f > 1) {
+        f = 1;
+    }
+    x->link = f;
+}
+
+/* function for setting the lookahead time. the delay-lines grow here if needed, never in the perform-routine */
+void hsd_dynamics_lookahead(t_hsd_dynamics *x, t_floatarg f){
+
+    // sanity checking
+    if (f < 0) {
+        f = 0;
+    }
+    if (f > HSD_DYNAMICS_LOOKAHEAD_MAX) {
+        error("hsd_dynamics~: lookahead time too long: %f. lookahead time set to %d ms", f, HSD_DYNAMICS_LOOKAHEAD_MAX);
+        f = HSD_DYNAMICS_LOOKAHEAD_MAX;
+    }
+    x->lookahead_ms = f;
+    x->lookahead = (t_int)(x->sr * f * 0.001 + 0.5);
+
+    hsd_dynamics_allocate(x, 0);
+    hsd_dynamics_latency(x);
+}
+
+/* function for setting the number of blocks between two "reduction" messages, 0 switches them off */
+void hsd_dynamics_interval(t_hsd_dynamics *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->interval = f;
+    x->block_count = 0;
+}
+
+/* sends the latency of the object (the lookahead time) in samples and ms */
+void hsd_dynamics_latency(t_hsd_dynamics *x){
+
+    t_atom latency[2];
+
+    SETFLOAT(latency, x->lookahead);
+    SETFLOAT(latency + 1, x->lookahead * 1000 / x->sr);
+    outlet_anything(x->control_out, gensym("latency"), 2, latency);
+}
+
+/* function for clearing the lookahead delay and setting all levels and gains back, executed when a bang message is received */
+void hsd_dynamics_bang(t_hsd_dynamics *x){
+
+    int c;
+
+    for (c=0; c<HSD_DYNAMICS_MAX; c++) {
+        hsd_delayline_clear(&x->line[c]);
+        x->rms2[c] = 0;
+        x->gain[c] = 0;
+        x->queue_head[c] = 0;
+        x->queue_tail[c] = 0;
+    }
+}
+
+
+/* the clock function sends the messages after the DSP tick. outlets must not be used in the perform routine */
+void hsd_dynamics_tick(t_hsd_dynamics *x){
+
+    if (x->send_latency) {
+        x->send_latency = 0;
+        hsd_dynamics_latency(x);
+    }
+    if (x->send_reduction) {
+        x->send_reduction = 0;
+        outlet_anything(x->control_out, gensym("reduction"), x->channels, x->reduction_list);
+    }
+}
+
+
+/* writes a block to the lookahead delay-line, in at most two contiguous pieces */
+void hsd_dynamics_write(t_hsd_delayline *d, const t_float *in, t_int n){
+
+    t_int write_index = d->write_index;
+    t_int first = d->length - write_index;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(d->buffer + write_index, in, first * sizeof(t_float));
+    memcpy(d->buffer, in + first, (n - first) * sizeof(t_float));
+
+    d->write_index = (write_index + n) & d->mask;
+}
+
+/* reads the block that was written last, delayed by "delay" samples, and multiplies it with the gains. like the writing, the read-pointer wraps at most once, so the block is read in two contiguous pieces, and the loops can be calculated with SIMD instructions */
+void hsd_dynamics_read(t_hsd_delayline *d, t_int delay, const t_float *gain, t_float *out, t_int n){
+
+    const t_float *buffer = d->buffer;
+    t_int read_index = (d->write_index - n - delay) & d->mask;
+    t_int first = d->length - read_index;
+    t_int i;
+
+    if (first > n) {
+        first = n;
+    }
+    for (i=0; i<first; i++) {
+        out[i] = buffer[read_index + i] * gain[i];
+    }
+    for (i=first; i<n; i++) {
+        out[i] = buffer[i - first] * gain[i];
+    }
+}
+
+
+/* the dsp-init-routine */
+void hsd_dynamics_dsp(t_hsd_dynamics *x, t_signal **sp)
+{
+    int c, channels = x->channels;
+    int inlets = x->sidechain ? 2 * channels : channels;
+    int reset = 0;
+    t_int size;
+
+    /* check for sample-rate changes. the time coefficients and the lookahead in samples depend on the sample rate, the old content of the delay-lines doesn´t fit anymore */
+    if(x->sr != sp[0]->s_sr){
+        x->sr = sp[0]->s_sr;
+        hsd_dynamics_coefficients(x);
+        x->lookahead = (t_int)(x->sr * x->lookahead_ms * 0.001 + 0.5);
+        reset = 1;
+    }
+    x->n = sp[0]->s_n;
+
+    /* the scratch buffer: the levels of all channels and the highest level */
+    size = (channels + 1) * x->n;
+    if (x->scratch_size != size) {
+        if (x->scratch) {
+            freebytes(x->scratch, x->scratch_size * sizeof(t_float));
+        }
+        x->scratch = (t_float*)getbytes(size * sizeof(t_float));
+        x->scratch_size = x->scratch ? size : 0;
+        if (!x->scratch) {
+            error("hsd_dynamics~: cannot allocate memory for the block size %d", (int)x->n);
+        }
+    }
+    hsd_dynamics_allocate(x, reset);
+
+    // the signal vectors of all channels: first the inlets, then the sidechain inlets, then the outlets
+    for (c=0; c<channels; c++) {
+        x->in_vec[c] = sp[c]->s_vec;
+        x->sc_vec[c] = x->sidechain ? sp[channels + c]->s_vec : sp[c]->s_vec;
+        x->out_vec[c] = sp[inlets + c]->s_vec;
+    }
+
+    // report the latency right after the DSP has been switched on
+    x->send_latency = 1;
+    clock_delay(x->clock, 0);
+
+    /* add the objects signal processing to the signal-chain of puredata */
+    dsp_add(hsd_dynamics_perform,
+            2,
+            x,
+            sp[0]->s_n);
+}
+
+
+/* the perform routine */
+t_int *hsd_dynamics_perform(t_int *w)
+{
+    t_hsd_dynamics *x = (t_hsd_dynamics *) (w[1]);        //object data
+    t_int n = w[2];                                     //buffer-size
+
+    /* get needed data from data struct */
+    int channels = x->channels;
+    int rms = (x->detector == HSD_DYNAMICS_RMS);
+    t_float *highest = x->scratch + channels * n;
+    t_float link = (channels > 1) ? x->link : 0;
+
+    // the dB conversion: 20*log10() of the peak-level, or 10*log10() of the squared rms-level, both with the same floor
+    t_float factor = rms ? 10 : 20;
+    t_float floor = hsd_db_floor(HSD_DYNAMICS_FLOOR, factor);
+
+    /* the gain computer: the slope above the threshold (1/R - 1, -1 for the limiter) and the knee */
+    t_float threshold = x->threshold;
+    t_float slope = (x->ratio == 0) ? -1 : 1 / x->ratio - 1;
+    t_float half_knee = x->knee / 2;
+    t_float knee_scale = (x->knee > 0) ? slope / (2 * x->knee) : 0;
+    t_float makeup = x->makeup;
+
+    // the lowest gain before the makeup gain, so the gain in dB stays in the range of hsd_gain_block()
+    t_float lowest = HSD_DB_MIN - makeup;
+
+    t_float AT = x->AT;
+    t_float RT = x->RT;
+    t_float TAV = x->TAV;
+
+    uint32_t lookahead = x->lookahead;
+    t_int queue_mask = x->queue_size - 1;
+    t_float *queue_value;
+    uint32_t *queue_time, head, tail, now;
+
+    t_float *in, *level, a, r, over, G, hold, g, rate;
+    uint32_t bits, highest_bits;
+    int below, above, c;
+    t_int i;
+
+    // without delay-lines or scratch buffer (no memory), the output is silent
+    if (!x->ready) {
+        for (c=0; c<channels; c++) {
+            memset(x->out_vec[c], 0, n * sizeof(t_float));
+        }
+        return w+3;
+    }
+
+    /* first pass: all input signals are read before any output is written, because Pd may use the same signal vector for an inlet and an outlet. the levels are detected, and the input is written to the lookahead delay-line */
+    for (c=0; c<channels; c++) {
+
+        in = x->sc_vec[c];
+        level = x->scratch + c * n;
+
+        if (rms) {
+            // the averaging of hsd_rmsf~ depends on the sample before, so this loop runs sample by sample
+            r = x->rms2[c];
+            for (i=0; i<n; i++) {
+                r = (1-TAV) * r + TAV * in[i] * in[i];
+                level[i] = r;
+            }
+            x->rms2[c] = r;
+        }else{
+            // the rectifier of hsd_peakf~
+            for (i=0; i<n; i++) {
+                level[i] = fabs(in[i]);
+            }
+        }
+
+        hsd_dynamics_write(&x->line[c], x->in_vec[c], n);
+    }
+
+    /* the highest level of all channels for the linking. the levels are positive, so they can be compared as integers (see hsd_db_block()), which the compiler can do with SIMD instructions */
+    if (link > 0) {
+        memcpy(highest, x->scratch, n * sizeof(t_float));
+        for (c=1; c<channels; c++) {
+            level = x->scratch + c * n;
+            for (i=0; i<n; i++) {
+                memcpy(&bits, level + i, sizeof(bits));
+                memcpy(&highest_bits, highest + i, sizeof(highest_bits));
+                highest_bits = (bits > highest_bits) ? bits : highest_bits;
+                memcpy(highest + i, &highest_bits, sizeof(highest_bits));
+            }
+        }
+        hsd_db_block(highest, n, factor, floor);
+    }
+
+    /* second pass: the gains of all channels, and the output */
+    for (c=0; c<channels; c++) {
+
+        level = x->scratch + c * n;
+        hsd_db_block(level, n, factor, floor);
+
+        /* the linking and the gain computer for the whole block. all three cases of the gain computer are calculated and selected with the factors 1 and 0 (see hsd_meter~.c) */
+        for (i=0; i<n; i++) {
+
+            a = level[i];
+            a = a + link * (highest[i] - a);
+
+            over = a - threshold;
+            below = (over <= -half_knee);
+            above = (over >= half_knee);
+            G = above * slope * over + (1-above) * (1-below) * knee_scale * (over + half_knee) * (over + half_knee);
+
+            below = (G < lowest);
+            level[i] = below * lowest + (1-below) * G;
+        }
+
+        /* the hold and the smoothing of the gain depend on the sample before, so this loop runs sample by sample. it is short, because everything else has been calculated before. here the "?:" is the faster choice: without SIMD instructions, the compiler translates it into a conditional move, the factors 1 and 0 would only make the chain of calculations from one sample to the next longer */
+        queue_value = x->queue_value + c * x->queue_size;
+        queue_time = x->queue_time + c * x->queue_size;
+        head = x->queue_head[c];
+        tail = x->queue_tail[c];
+        now = x->now;
+        g = x->gain[c];
+        for (i=0; i<n; i++) {
+            G = level[i];
+
+            // the hold: G replaces all gains at the end of the queue that are not lower. the front of the queue leaves it when it is older than the lookahead time (only one gain per sample-tick can get too old). the front is then the lowest gain of the lookahead time
+            while (tail != head && queue_value[(tail - 1) & queue_mask] >= G) {
+                tail--;
+            }
+            queue_value[tail & queue_mask] = G;
+            queue_time[tail & queue_mask] = now;
+            tail++;
+            if (now - queue_time[head & queue_mask] > lookahead) {
+                head++;
+            }
+            hold = queue_value[head & queue_mask];
+            now++;
+
+            rate = (hold < g) ? AT : RT;
+            g = g + rate * (hold - g);
+            level[i] = g + makeup;
+        }
+        x->queue_head[c] = head;
+        x->queue_tail[c] = tail;
+        x->gain[c] = g;
+        SETFLOAT(x->reduction_list + c, g);
+
+        // from dB to linear gains, and the delayed input multiplied with them
+        hsd_gain_block(level, n);
+        hsd_dynamics_read(&x->line[c], x->lookahead, level, x->out_vec[c], n);
+    }
+
+    x->now += n;
+
+    /* send the gain reduction every "interval" blocks. the clock calls hsd_dynamics_tick() right after this DSP tick */
+    if (x->interval > 0 && ++x->block_count >= x->interval) {
+        x->block_count = 0;
+        x->send_reduction = 1;
+        clock_delay(x->clock, 0);
+    }
+
+    return w+3;
+}
+
+
+/* free function, the delay-lines, the scratch buffer, the queues and the clock have to be freed */
+void hsd_dynamics_free(t_hsd_dynamics *x)
+{
+    int c;
+
+    for (c=0; c<HSD_DYNAMICS_MAX; c++) {
+        hsd_delayline_free(&x->line[c]);
+    }
+    if (x->scratch) {
+        freebytes(x->scratch, x->scratch_size * sizeof(t_float));
+    }
+    hsd_dynamics_free_queues(x);
+    clock_free(x->clock);
+}
+
+
+/* new-instance routine */
+void *hsd_dynamics_new(t_symbol *s, short argc, t_atom *argv)
+{
+    // set default values
+    t_float channels = DEFAULT_CHANNELS;
+    t_float lookahead_ms = DEFAULT_LOOKAHEAD_MS;
+    int c;
+
+    t_hsd_dynamics *x = (t_hsd_dynamics *)pd_new(hsd_dynamics_class);
+
+    /* getting creation arguments: the number of channels, the lookahead time and the sidechain flag */
+    if (argc > 0) {
+        channels = atom_getfloatarg(0, argc, argv);
+    }
+    if (argc > 1) {
+        lookahead_ms = atom_getfloatarg(1, argc, argv);
+    }
+    x->sidechain = (argc > 2 && atom_getfloatarg(2, argc, argv) != 0);
+
+    // sanity checking
+    if (channels < 1 || channels > HSD_DYNAMICS_MAX) {
+        error("hsd_dynamics~: illegal number of channels: %f. number of channels set to %d", channels, DEFAULT_CHANNELS);
+        channels = DEFAULT_CHANNELS;
+    }
+    x->channels = channels;
+
+    // creating the signal-inlets (the first one is the main signal inlet) and the sidechain inlets
+    for (c=1; c<(x->sidechain ? 2 * x->channels : x->channels); c++) {
+        inlet_new(&x->obj, &x->obj.ob_pd, &s_signal, &s_signal);
+    }
+
+    // creating the signal-outlets, the control outlet and the clock that sends the messages
+    for (c=0; c<x->channels; c++) {
+        outlet_new(&x->obj, &s_signal);
+    }
+    x->control_out = outlet_new(&x->obj, 0);
+    x->clock = clock_new(x, (t_method)hsd_dynamics_tick);
+
+    // getting sample rate, the block size is known in the dsp-init-routine
+    x->sr = sys_getsr();
+    x->n = 0;
+
+    x->threshold = DEFAULT_THRESHOLD;
+    x->ratio = DEFAULT_RATIO;
+    x->knee = 0;
+    x->makeup = 0;
+    x->t_a = DEFAULT_ATTACK_MS;
+    x->t_r = DEFAULT_RELEASE_MS;
+    x->t_rms = DEFAULT_RMS_MS;
+    x->detector = HSD_DYNAMICS_PEAK;
+    x->link = 1;
+    hsd_dynamics_coefficients(x);
+
+    x->interval = 0;
+    x->block_count = 0;
+    x->send_reduction = 0;
+    x->send_latency = 0;
+    x->scratch = NULL;
+    x->scratch_size = 0;
+    x->queue_value = NULL;
+    x->queue_time = NULL;
+    x->queue_size = 0;
+    x->now = 0;
+    x->ready = 0;
+
+    for (c=0; c<HSD_DYNAMICS_MAX; c++) {
+        x->in_vec[c] = NULL;
+        x->sc_vec[c] = NULL;
+        x->out_vec[c] = NULL;
+        SETFLOAT(x->reduction_list + c, 0);
+    }
+    hsd_dynamics_bang(x);
+
+    // the delay-lines are allocated for the lookahead time here, and for the block size in the dsp-init-routine
+    if (lookahead_ms < 0 || lookahead_ms > HSD_DYNAMICS_LOOKAHEAD_MAX) {
+        error("hsd_dynamics~: illegal lookahead time: %f. lookahead time set to %d ms", lookahead_ms, DEFAULT_LOOKAHEAD_MS);
+        lookahead_ms = DEFAULT_LOOKAHEAD_MS;
+    }
+    x->lookahead_ms = lookahead_ms;
+    x->lookahead = (t_int)(x->sr * lookahead_ms * 0.001 + 0.5);
+    if (!hsd_dynamics_allocate(x, 0)) {
+        return NULL;
+    }
+
+    return x;
+}
+
+/* setup routine */
+void hsd_dynamics_tilde_setup(void){
+
+    hsd_dynamics_class = class_new(gensym("hsd_dynamics~"),
+                                   (t_newmethod)hsd_dynamics_new,
+                                   (t_method)hsd_dynamics_free,
+                                   sizeof(t_hsd_dynamics),
+                                   0,
+                                   A_GIMME,
+                                   0);
+
+    CLASS_MAINSIGNALIN(hsd_dynamics_class, t_hsd_dynamics, x_f);
+
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_dsp,
+                    gensym("dsp"),
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_threshold,
+                    gensym("threshold"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_ratio,
+                    gensym("ratio"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_knee,
+                    gensym("knee"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_makeup,
+                    gensym("makeup"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_attack,
+                    gensym("attack"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_release,
+                    gensym("release"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_time,
+                    gensym("time"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_detector,
+                    gensym("detector"),
+                    A_SYMBOL,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_link,
+                    gensym("link"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_lookahead,
+                    gensym("lookahead"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_interval,
+                    gensym("interval"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_dynamics_class,
+                    (t_method)hsd_dynamics_latency,
+                    gensym("latency"),
+                    0);
+
+    class_addbang(hsd_dynamics_class, hsd_dynamics_bang);
+
+
+    post ("hsd_dynamics~ from the hsd_library, HS Duesseldorf ");
+
+}
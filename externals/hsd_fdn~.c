@@ -0,0 +1,599 @@
+/* hsd_fdn~ external from the HSD-Library, University of Applied Science Duesseldorf
+ Created 18.10.2026
+
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This is a feedback delay network (FDN) reverberator after Jot and Chaigne (1991). Instead of a bank of separate comb filters (see hsd_reverb~), N delay-lines (8 or 16) feed back into each other: the outputs of all delay-lines are mixed by a feedback matrix, and every delay-line gets a mix of all outputs as its input.
+
+
+                 ------------------------------------------------------
+                |                                                      |
+                 --> [feedback] <-- [lowpass 1] <-- [delay-line 1] <--(+)<--
+                     [ matrix ] <-- [lowpass 2] <-- [delay-line 2] <--(+)<-- x
+                     [        ] <-- [   ...   ] <-- [    ...     ] <--(+)<--
+                     [        ] <-- [lowpass N] <-- [delay-line N] <--(+)<--
+                                         |
+                                          -----> sum of the even lines --> left output
+                                          -----> sum of the odd lines  --> right output
+
+
+    -> the matrix is orthogonal (it only "rotates" the signals, but doesn´t change their energy), so the network keeps on ringing forever without the gains in the delay-lines. every echo is spread to all delay-lines, so the density of the echoes grows very fast.
+    -> every delay-line has a gain, which is calculated from its length and the decay time (T60, the time until the reverb has decayed by 60 dB): g = 10^(-3 * delay / (T60 * sr)). this way all delay-lines decay at the same speed, no matter how long they are.
+    -> every delay-line has a one pole lowpass filter (like in hsd_comblp~) that lets the high frequencies decay faster. it is normalized (lowpass = (1-damping) * in + damping * z1), so it never adds gain.
+    -> the lengths of the delay-lines are prime numbers of samples at 44.1 kHz, so their echoes don´t pile up.
+
+
+ The feedback matrix
+
+ Multiplying the N outputs with an N x N matrix costs N*N multiplications per sample. Both matrices of this external can be applied much faster:
+
+    -> hadamard: the hadamard matrix of size N (a power of two) can be split into log2(N) stages of "butterflies". every butterfly takes two values a and b and replaces them by a+b and a-b. so N*log2(N) additions instead of N*N multiplications (the "fast walsh-hadamard transform"). at the end, everything is scaled by 1/sqrt(N) to make the matrix orthogonal.
+
+                a ---------(+)---> a + b
+                    \     /
+                     \   /
+                      \ /
+                      / \
+                     /   \
+                    /     \
+                b ---------(-)---> a - b
+
+    -> householder: the matrix I - 2/N * (a matrix full of ones). it subtracts 2/N times the sum of all outputs from every output, which costs only N additions and N subtractions. it mixes the lines less than the hadamard matrix, the echo density grows slower.
+
+
+ The block processing
+
+ The network is not calculated sample by sample, but in chunks of HSD_FDN_CHUNK samples (never more than the shortest delay-line, see hsd_reverb~). The outputs of all delay-lines for the whole chunk are read into a small local array with one row per delay-line. then every step works on whole rows:
+
+    -> the lowpass filters and gains are calculated for all lines side by side, so the filters of the different lines don´t have to wait for each other.
+    -> a butterfly of the hadamard transform adds and subtracts two complete rows. these loops have no dependencies between the samples, so the compiler can calculate them with SIMD instructions (SSE, NEON...) without any special code.
+    -> the rows are written back into the delay-lines together with the input. a chunk never runs over the end of the regions, so this is a plain copy into contiguous memory.
+
+ Like in hsd_reverb~, all delay-lines share one block of memory from the arena and one write-pointer.
+
+ */
+
+#include "m_pd.h"
+#include "math.h"
+#include <string.h>
+#include "hsd_library.h"
+
+/* the maximum number of delay-lines */
+#define HSD_FDN_MAX_LINES 16
+
+/* the longest chunk of samples that is processed in one go */
+#define HSD_FDN_CHUNK 64
+
+/* the feedback matrices */
+#define HSD_FDN_HADAMARD 0
+#define HSD_FDN_HOUSEHOLDER 1
+
+/* the lengths of the delay-lines in ms (prime numbers of samples at 44.1 kHz). with 8 lines, every second one is used */
+static const t_float fdn_times_ms[HSD_FDN_MAX_LINES] = {27.234, 28.957, 30.862, 32.812, 34.989, 37.120, 39.297, 41.882, 44.739, 47.188, 50.181, 53.311, 56.757, 60.249, 64.240, 68.050};
+
+/* data struct */
+typedef struct _hsd_fdn{
+
+    /* the object data itself */
+    t_object obj;
+
+    /* sample rate */
+    t_float sr;
+
+    /* the number of delay-lines (8 or 16) */
+    int lines;
+
+    /* the memory block for all delay-lines and its size in bytes */
+    t_float *memory;
+    size_t bytes;
+
+    /* the length of one region of the block (a power of two), the mask for wrapping and the common write-pointer */
+    t_int length;
+    t_int mask;
+    t_int write_index;
+
+    /* the delay of every line in samples */
+    t_int delay[HSD_FDN_MAX_LINES];
+
+    /* the number of samples that are processed in one chunk */
+    t_int chunk;
+
+    /* the gain of every delay-line, calculated from the decay time */
+    t_float gain[HSD_FDN_MAX_LINES];
+
+    /* the states of the lowpass filters */
+    t_float z1[HSD_FDN_MAX_LINES];
+
+    /* the feedback matrix (HSD_FDN_HADAMARD or HSD_FDN_HOUSEHOLDER) */
+    int matrix;
+
+    /* the parameters: decay time in seconds, damping from 0 to 1, the mix of dry and wet signal */
+    t_float decay;
+    t_float damp;
+    t_float dry, wet;
+
+    /* dummy float for CLASS_MAINSIGNALIN */
+    t_float x_f;
+
+}t_hsd_fdn;
+
+static t_class *hsd_fdn_class;
+
+
+/* function prototypes */
+void *hsd_fdn_new(t_symbol *s, short argc, t_atom *argv);
+void hsd_fdn_dsp(t_hsd_fdn *x, t_signal **sp);
+t_int *hsd_fdn_perform(t_int *w);
+void hsd_fdn_free(t_hsd_fdn *x);
+void hsd_fdn_stats(t_hsd_fdn *x);
+void hsd_fdn_decay(t_hsd_fdn *x, t_floatarg f);
+void hsd_fdn_damping(t_hsd_fdn *x, t_floatarg f);
+void hsd_fdn_drywet(t_hsd_fdn *x, t_floatarg f);
+void hsd_fdn_matrix(t_hsd_fdn *x, t_symbol *s);
+void hsd_fdn_bang(t_hsd_fdn *x);
+int hsd_fdn_allocate(t_hsd_fdn *x);
+
+
+/* function for (re)allocating the memory block for all delay-lines. called by the new-instance-routine and whenever the sample rate changes. returns 0 if the memory could not be allocated */
+int hsd_fdn_allocate(t_hsd_fdn *x){
+
+    int i;
+    int step = HSD_FDN_MAX_LINES / x->lines;
+    t_int longest = 0;
+
+    // calculate the delays in samples and find the longest and the shortest one
+    x->chunk = HSD_FDN_CHUNK;
+    for (i=0; i<x->lines; i++) {
+        x->delay[i] = (t_int)(x->sr * fdn_times_ms[i * step]/1000 + 0.5);
+        if (x->delay[i] > longest) {
+            longest = x->delay[i];
+        }
+        // a chunk must not be longer than the shortest delay, otherwise samples would be read that are written in the same chunk
+        if (x->delay[i] < x->chunk) {
+            x->chunk = x->delay[i];
+        }
+    }
+    if (x->chunk < 1) {
+        x->chunk = 1;
+    }
+    x->length = hsd_nextpow2(longest + 1);
+    x->mask = x->length - 1;
+
+    // free the old block and get a new one from the arena (already zeroed)
+    if (x->memory) {
+        hsd_arena_free(x->memory, x->bytes);
+        x->memory = NULL;
+    }
+    x->bytes = x->lines * x->length * sizeof(t_float);
+    x->memory = (t_float*)hsd_arena_alloc(x->bytes);
+    if (x->memory == NULL) {
+        x->bytes = 0;
+        return 0;
+    }
+
+    // the gains depend on the delays in samples
+    hsd_fdn_decay(x, x->decay);
+
+    hsd_fdn_bang(x);
+    return 1;
+}
+
+/* function for setting the decay time (T60) in seconds. the gain of every delay-line is calculated, so that its signal has decayed by 60 dB after this time */
+void hsd_fdn_decay(t_hsd_fdn *x, t_floatarg f){
+
+    int i;
+    t_float decay = f;
+
+    // sanity checking
+    if(decay < 0.01){
+        decay = 0.01;
+    }
+    if(decay > 100){
+        decay = 100;
+    }
+
+    x->decay = decay;
+
+    // g = 10^(-3 * delay / (T60 * sr)) --> -60 dB after T60 seconds
+    for (i=0; i<x->lines; i++) {
+        x->gain[i] = pow(10, -3.0 * x->delay[i] / (decay * x->sr));
+    }
+}
+
+/* function for setting the damping of high frequencies (0...1). it is used as coefficient of the lowpass filters */
+void hsd_fdn_damping(t_hsd_fdn *x, t_floatarg f){
+
+    t_float damping = f;
+
+    // sanity checking
+    if(damping < 0){
+        damping = 0;
+    }
+    if(damping > 1){
+        damping = 1;
+    }
+
+    // the lowpass must not become a pure integrator
+    x->damp = 0.95 * damping;
+}
+
+void hsd_fdn_drywet(t_hsd_fdn *x, t_floatarg f){
+
+    //create intermediate value
+    t_float dry_wet = f;
+
+    // sanity checking
+    if(dry_wet < 0){
+        dry_wet = 0;
+    }
+    if(dry_wet > 100){
+        dry_wet = 100;
+    }
+    // change parameter
+    x->wet = dry_wet/100.0;
+    x->dry = 1.0 - x->wet;
+}
+
+/* function for choosing the feedback matrix, executed when a "matrix" message is received */
+void hsd_fdn_matrix(t_hsd_fdn *x, t_symbol *s){
+
+    if (s == gensym("hadamard")) {
+        x->matrix = HSD_FDN_HADAMARD;
+    }
+    else if (s == gensym("householder")) {
+        x->matrix = HSD_FDN_HOUSEHOLDER;
+    }
+    else {
+        error("hsd_fdn~: unknown matrix %s (hadamard or householder)", s->s_name);
+    }
+}
+
+/* function for resetting all delay-lines and filter states, executed when a bang message is received */
+void hsd_fdn_bang(t_hsd_fdn *x){
+
+    int i;
+
+    if (x->memory) {
+        memset(x->memory, 0, x->bytes);
+    }
+    for (i=0; i<HSD_FDN_MAX_LINES; i++) {
+        x->z1[i] = 0;
+    }
+    x->write_index = 0;
+}
+
+/* prints how much memory the delay-lines of the whole library take, executed when a "stats" message is received */
+void hsd_fdn_stats(t_hsd_fdn *x){
+
+    hsd_arena_stats("hsd_fdn~");
+
+}
+
+
+/* the dsp-init-routine */
+void hsd_fdn_dsp(t_hsd_fdn *x, t_signal **sp)
+{
+    /* check if samplerate has changed. the delay-lines have to be recalculated, their old content is thrown away */
+    if(x->sr != sp[0]->s_sr){
+
+        x->sr = sp[0]->s_sr;
+
+        if(!hsd_fdn_allocate(x)){
+            error("hsd_fdn~: cannot reallocate the delay-lines");
+            // the old delay-lines is gone: forget the sample rate, so the next DSP start tries again instead of running without delay-lines
+            x->sr = 0;
+            return;
+        }
+    }
+
+    /* add the objects signal processing to the signal-chain of puredata */
+    dsp_add(hsd_fdn_perform,
+            5,
+            x,
+            sp[0]->s_vec,
+            sp[1]->s_vec,
+            sp[2]->s_vec,
+            sp[0]->s_n);
+}
+
+
+/* the perform routine */
+t_int *hsd_fdn_perform(t_int *w)
+{
+    t_hsd_fdn *x = (t_hsd_fdn *) (w[1]);                //object data
+    t_float *input = (t_float *) (w[2]);                //input-vector
+    t_float *out_left = (t_float *) (w[3]);             //left output-vector
+    t_float *out_right = (t_float *) (w[4]);            //right output-vector
+    t_int n = w[5];                                     //buffer-size
+
+    /* get needed data from data struct */
+    t_float *memory = x->memory;
+    int lines = x->lines;
+    t_int length = x->length;
+    t_int mask = x->mask;
+    t_int write_index = x->write_index;
+    t_float damp = x->damp;
+    t_float damp1 = 1 - damp;
+    t_float dry = x->dry;
+    t_float wet = x->wet;
+
+    // the outputs of all delay-lines in the current chunk, one row per delay-line
+    t_float rows[HSD_FDN_MAX_LINES][HSD_FDN_CHUNK];
+
+    // the input of the current chunk, the sums of the outputs and a row for the householder matrix
+    t_float in[HSD_FDN_CHUNK];
+    t_float left[HSD_FDN_CHUNK];
+    t_float right[HSD_FDN_CHUNK];
+    t_float sum[HSD_FDN_CHUNK];
+
+    // the input is spread to all lines and the outputs are summed, both scaled so the level stays about the same
+    t_float in_gain = 1.0 / sqrt(lines);
+    t_float out_gain = 2.0 / sqrt(lines);
+
+    // the factor of the householder matrix
+    t_float householder = 2.0 / lines;
+
+    // the scaling of the mixed rows when they are written back: this makes the hadamard matrix orthogonal, the householder matrix is already
+    t_float scale = (x->matrix == HSD_FDN_HADAMARD) ? 1.0 / sqrt(lines) : 1;
+
+    // local copies of the lowpass states and gains, so the compiler can keep them in registers
+    t_float z1[HSD_FDN_MAX_LINES];
+    t_float gain[HSD_FDN_MAX_LINES];
+
+    t_float *line, *a, *b, tmp;
+    t_int chunk, read_index, i;
+    int k, h, j;
+
+    for (k=0; k<lines; k++) {
+        z1[k] = x->z1[k];
+        gain[k] = x->gain[k];
+    }
+
+    /* DSP-Loop, one chunk after the other */
+    while (n > 0) {
+
+        chunk = (n < x->chunk) ? n : x->chunk;
+
+        // the chunk must not run over the end of the regions, so the samples of a chunk are written to one contiguous piece of memory
+        if (chunk > length - write_index) {
+            chunk = length - write_index;
+        }
+
+        /* read the outputs of all delay-lines */
+        for (k=0; k<lines; k++) {
+
+            line = memory + k * length;
+            read_index = write_index - x->delay[k];
+
+            for (i=0; i<chunk; i++) {
+                rows[k][i] = line[(read_index + i) & mask];
+            }
+        }
+
+        /* the lowpass filters and the gains of the delay-lines (decay time). every lowpass depends on its own last output, so the lines are calculated side by side: the filters of the different lines don´t have to wait for each other */
+        for (i=0; i<chunk; i++) {
+            for (k=0; k<lines; k++) {
+                z1[k] = damp1 * rows[k][i] + damp * z1[k];
+                rows[k][i] = z1[k] * gain[k];
+            }
+        }
+
+        /* the outputs: the even lines go to the left, the odd lines to the right. this is done before the matrix, which changes the rows in place */
+        for (i=0; i<chunk; i++) {
+            in[i] = input[i];
+            left[i] = 0;
+            right[i] = 0;
+        }
+        for (k=0; k<lines; k+=2) {
+            for (i=0; i<chunk; i++) {
+                left[i] += rows[k][i];
+                right[i] += rows[k+1][i];
+            }
+        }
+        for (i=0; i<chunk; i++) {
+            out_left[i] = dry * in[i] + wet * out_gain * left[i];
+            out_right[i] = dry * in[i] + wet * out_gain * right[i];
+        }
+
+        /* the feedback matrix */
+        if (x->matrix == HSD_FDN_HADAMARD) {
+
+            // fast walsh-hadamard transform: log2(lines) stages of butterflies. every butterfly works on two complete rows
+            for (h=1; h<lines; h*=2) {
+                for (k=0; k<lines; k+=2*h) {
+                    for (j=k; j<k+h; j++) {
+                        a = rows[j];
+                        b = rows[j+h];
+                        for (i=0; i<chunk; i++) {
+                            tmp = a[i];
+                            a[i] = tmp + b[i];
+                            b[i] = tmp - b[i];
+                        }
+                    }
+                }
+            }
+        }
+        else {
+
+            // householder matrix: subtract 2/N times the sum of all rows from every row
+            for (i=0; i<chunk; i++) {
+                sum[i] = 0;
+            }
+            for (k=0; k<lines; k++) {
+                for (i=0; i<chunk; i++) {
+                    sum[i] += rows[k][i];
+                }
+            }
+            for (k=0; k<lines; k++) {
+                for (i=0; i<chunk; i++) {
+                    rows[k][i] -= householder * sum[i];
+                }
+            }
+        }
+
+        /* write the mixed outputs and the input into the delay-lines */
+        for (k=0; k<lines; k++) {
+
+            line = memory + k * length + write_index;
+
+            for (i=0; i<chunk; i++) {
+                line[i] = in[i] * in_gain + rows[k][i] * scale;
+            }
+        }
+
+        write_index = (write_index + chunk) & mask;
+
+        input += chunk;
+        out_left += chunk;
+        out_right += chunk;
+        n -= chunk;
+    }
+
+    for (k=0; k<lines; k++) {
+        x->z1[k] = z1[k];
+    }
+    x->write_index = write_index;
+
+    return w+6;
+}
+
+
+/* free function that is called when the object is destroyed */
+void hsd_fdn_free(t_hsd_fdn *x)
+{
+    if (x->memory) {
+        hsd_arena_free(x->memory, x->bytes);
+    }
+}
+
+
+/* new-instance routine */
+void *hsd_fdn_new(t_symbol *s, short argc, t_atom *argv)
+{
+    // set default values
+    t_float lines = 8;
+    t_float decay = 2;
+    t_float damping = 0.3;
+    t_float dry_wet = 30;
+
+    t_hsd_fdn *x = (t_hsd_fdn *)pd_new(hsd_fdn_class);
+
+    // creating the active inlets. the functions specified in the last argument are called, when the inlet receives a message
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("decay"));
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("damping"));
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("drywet"));
+
+    //creating the signal-outlets
+    outlet_new(&x->obj, gensym("signal"));
+    outlet_new(&x->obj, gensym("signal"));
+
+    // getting sample rate
+    x->sr = sys_getsr();
+
+    /* getting creation arguments */
+    if (argc>=4) {
+        dry_wet = atom_getfloatarg(3, argc, argv);
+    }
+    if (argc>=3) {
+        damping = atom_getfloatarg(2, argc, argv);
+    }
+    if (argc>=2) {
+        decay = atom_getfloatarg(1, argc, argv);
+    }
+    if (argc>=1) {
+        lines = atom_getfloatarg(0, argc, argv);
+    }
+
+    // only 8 or 16 delay-lines are possible
+    if (lines != 8 && lines != 16) {
+        error("hsd_fdn~: the number of delay-lines must be 8 or 16, using %d", (lines > 8) ? 16 : 8);
+    }
+    x->lines = (lines > 8) ? 16 : 8;
+
+    x->matrix = HSD_FDN_HADAMARD;
+    x->decay = decay;
+    hsd_fdn_damping(x, damping);
+    hsd_fdn_drywet(x, dry_wet);
+
+    /* Allocating the delay-lines (this also sets the decay time) */
+    x->memory = NULL;
+    x->bytes = 0;
+    if(!hsd_fdn_allocate(x)){
+        error("hsd_fdn~: cannot allocate memory for the delay-lines");
+        return NULL;
+    }
+
+    return x;
+}
+
+/* setup routine */
+void hsd_fdn_tilde_setup(void){
+
+    hsd_fdn_class = class_new(gensym("hsd_fdn~"),
+                              (t_newmethod)hsd_fdn_new,
+                              (t_method)hsd_fdn_free,
+                              sizeof(t_hsd_fdn),
+                              0,
+                              A_GIMME,
+                              0);
+
+    CLASS_MAINSIGNALIN(hsd_fdn_class, t_hsd_fdn, x_f);
+
+
+    class_addmethod(hsd_fdn_class,
+                    (t_method)hsd_fdn_dsp,
+                    gensym("dsp"),
+                    0);
+
+    class_addmethod(hsd_fdn_class,
+                    (t_method)hsd_fdn_decay,
+                    gensym("decay"),
+                    A_DEFFLOAT,
+                    0);
+
+    class_addmethod(hsd_fdn_class,
+                    (t_method)hsd_fdn_damping,
+                    gensym("damping"),
+                    A_DEFFLOAT,
+                    0);
+
+    class_addmethod(hsd_fdn_class,
+                    (t_method)hsd_fdn_drywet,
+                    gensym("drywet"),
+                    A_DEFFLOAT,
+                    0);
+
+    class_addmethod(hsd_fdn_class,
+                    (t_method)hsd_fdn_matrix,
+                    gensym("matrix"),
+                    A_SYMBOL,
+                    0);
+
+    class_addbang(hsd_fdn_class, hsd_fdn_bang);
+
+    class_addmethod(hsd_fdn_class,
+                    (t_method)hsd_fdn_stats,
+                    gensym("stats"),
+                    0);
+
+
+    post ("hsd_fdn~ from the hsd_library, HS Duesseldorf ");
+
+}
@@ -23,10 +23,20 @@
  
  When a bang is sent to the object, it will send out n samples with a value 1, creating an impulse of the length n. n is determined by the parameter "length" and is set via creation arguments or a float inlet 
  
+ Sample accurate timing: messages in Pd are not calculated in between the samples of a block, but between two DSP ticks. If the impulse simply started with the next block, it would start up to one block too late (about 1.5 ms at a block size of 64), depending on when the bang arrived. But every message has a logical time (the time of the clock that triggered it, e.g. a metro or delay), which lies between the last DSP tick and the next one. So the bang function measures the time since the last DSP tick (clock_gettimesince()), converts it to samples and the impulse starts at this sample of the next block:
+ 
+        logical time:     |- DSP tick k -|-------- bang ------|- DSP tick k+1 -|
+                          |<---- offset ----->|
+        output:                                                |<---- offset ----->| impulse
+ 
+ Every impulse is delayed by exactly one block, but the distance between two impulses is exact to one sample, like with a "block~ 1" subpatch, which is much more expensive. The same works inside subpatches with other block sizes or sample rates: the offset is counted down over several blocks if the block is shorter than the offset. In a subpatch with a block longer than 64 samples, the perform-routine only runs every few scheduler ticks, so the offset can be up to one block long.
+ 
  */
  
  
 #include "m_pd.h"
+#include <math.h>
+#include <string.h>
 
 static t_class *hsd_impulse_class;
 
@@ -45,9 +55,17 @@ typedef struct _hsd_impulse
     /* impulse length in samples */
     t_int length;
     
-    /* running parameter. is set to "length", when a bang is received and is decremened by 1 every sample tick. as long as impulsecount is not zero, a sample-value of 1 will be send out to create a pulse */
+    /* running parameter. is set to "length", when an impulse starts and is decremened by 1 every sample tick. as long as impulsecount is not zero, a sample-value of 1 will be send out to create a pulse */
     t_int impulsecount;
     
+    /* the logical time of the last DSP tick, the number of samples of one scheduler tick and the block size (used for sanity checking the offset of a bang) */
+    double blocktime;
+    t_float ticksamples;
+    t_int blocksize;
+    
+    /* the number of samples from the start of the next block until the waiting impulse starts. -1 if no impulse is waiting */
+    t_int startcount;
+    
 }t_hsd_impulse;
 
 /* function prototypes */
@@ -56,6 +74,7 @@ void hsd_impulse_dsp(t_hsd_impulse *x, t_signal **sp, short *count);
 t_int *hsd_impulse_perform(t_int *w);
 void hsd_impulse_length(t_hsd_impulse *x, t_floatarg f);
 void hsd_impulse_bang(t_hsd_impulse *x);
+void hsd_impulse_fill(t_float *out, t_int ones, t_int end);
 
 
 /* setup routine */
@@ -110,6 +129,11 @@ void *hsd_impulse_new(t_floatarg f)
     }
     x->length = (int)f;
     x->impulsecount = 0;
+    x->startcount = -1;
+    x->sr = sys_getsr();
+    x->ticksamples = sys_getblksize();
+    x->blocksize = sys_getblksize();
+    x->blocktime = clock_getlogicaltime();
 
 
     
@@ -128,16 +152,32 @@ void hsd_impulse_length(t_hsd_impulse *x, t_floatarg f){
     
 }
 
-/* bang function for starting the impulse. when a bang is received, the impulsecount is set to the length-value. */
+/* bang function for starting the impulse. the time since the last DSP tick is the position of the impulse in the next block (see above). when the impulse starts, the impulsecount is set to the length-value. if there is already an impulse waiting, the new one replaces it */
 void hsd_impulse_bang(t_hsd_impulse *x){
     
-    x->impulsecount = x->length;
+    /* the offset in samples, rounded to the nearest sample */
+    double offset = floor(clock_gettimesince(x->blocktime) * x->sr / 1000 + 0.5);
+    
+    /* the longest possible offset: one scheduler tick, or one block if the block is longer (then the perform-routine only runs every few ticks) */
+    t_float maxoffset = (x->blocksize > x->ticksamples) ? x->blocksize : x->ticksamples;
+    
+    /* sanity checking: the offset can only be longer than that if the DSP is switched off. then the impulse starts with the next block, like without the offset */
+    if (offset < 0 || offset > maxoffset) {
+        offset = 0;
+    }
+    x->startcount = (t_int)offset;
     
 }
 
 /* the dsp-init-routine */
 void hsd_impulse_dsp(t_hsd_impulse *x, t_signal **sp, short *count)
 {
+    /* the sample rate and the samples of one scheduler tick (64 samples at the sample rate of Pd) at the sample rate of the signal, which is different in up- or downsampled subpatches */
+    x->sr = sp[0]->s_sr;
+    x->ticksamples = sys_getblksize() * sp[0]->s_sr / sys_getsr();
+    x->blocksize = sp[0]->s_n;
+    x->blocktime = clock_getlogicaltime();
+    
     /* add the objects signal processing to the signal-chain of puredata */
     dsp_add(hsd_impulse_perform,
             3,
@@ -146,6 +186,17 @@ void hsd_impulse_dsp(t_hsd_impulse *x, t_signal **sp, short *count)
             sp[0]->s_n);
 }
 
+/* writes "ones" samples with the value 1 and then zeros up to "end" to out. the loop for the ones has no dependencies and the zeros are written with memset(), so both are done with whole vector stores instead of one sample after the other */
+void hsd_impulse_fill(t_float *out, t_int ones, t_int end)
+{
+    t_int i;
+    
+    for (i=0; i<ones; i++) {
+        out[i] = 1;
+    }
+    memset(out + ones, 0, (end - ones) * sizeof(t_float));
+}
+
 /* the perform routine */
 t_int *hsd_impulse_perform(t_int *w)
 {
@@ -156,19 +207,42 @@ t_int *hsd_impulse_perform(t_int *w)
     
     /* get needed data from data struct */
     t_int impulsecount = x->impulsecount;
+    t_int startcount = x->startcount;
+    t_int start, ones;
+    
+    /* the logical time of this DSP tick, the offsets of the next bangs are measured from here */
+    x->blocktime = clock_getlogicaltime();
+    
+    /* the block is not calculated sample by sample, but in (at most) two runs: the rest of a running impulse up to the sample where a waiting impulse starts, and the new impulse from there to the end of the block. each run is a number of ones followed by zeros. most of the time, nothing happens at all and the whole block is a single memset() */
     
-    /* DSP Loop */
-    while (n--) {
+    // the sample where the waiting impulse starts, or the end of the block if it doesn´t start in this block
+    start = n;
+    if (startcount >= 0 && startcount < n) {
+        start = startcount;
+    }
+    
+    /* the running impulse up to the start */
+    ones = (impulsecount < start) ? impulsecount : start;
+    hsd_impulse_fill(out, ones, start);
+    impulsecount -= ones;
+    
+    if (start < n) {
         
-        if (impulsecount > 0) {
-            impulsecount--;
-            *out++ = 1;
-        }  else{
-            *out++ =  0;
-        }
+        /* the new impulse from the start to the end of the block */
+        impulsecount = x->length;
+        ones = (impulsecount < n - start) ? impulsecount : n - start;
+        hsd_impulse_fill(out + start, ones, n - start);
+        impulsecount -= ones;
+        startcount = -1;
         
+    }else if (startcount >= 0) {
+        
+        // the impulse starts in one of the next blocks
+        startcount -= n;
     }
+    
     x->impulsecount = impulsecount;
+    x->startcount = startcount;
     
     
     return w+4;
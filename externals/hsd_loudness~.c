@@ -0,0 +1,519 @@
+/* hsd_loudness~ external from the HSD-Library, University of Applied Science Duesseldorf
+ Created 18.10.2026
+
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This is a loudness meter after EBU R128 / ITU-R BS.1770 for up to 8 channels (one signal inlet per channel). It measures:
+
+    -> the momentary loudness: the loudness of the last 400 ms
+    -> the short-term loudness: the loudness of the last 3 s
+    -> the integrated loudness: the loudness of the whole programme since the start or the last "reset", with the gating of BS.1770
+
+ All values are in LUFS (loudness units relative to full scale: a full scale 1 kHz sine in one channel measures -3.01 LUFS, in two channels 0 LUFS). They are sent every 100 ms as the messages "momentary <LUFS>", "shortterm <LUFS>" and "integrated <LUFS>", which can be sorted out with [route]. Values below -120 LUFS (e.g. digital silence) are sent as -120.
+
+
+ The measurement:
+
+        x1 --> [shelf] --> [highpass] --> (.)^2 --> * w1 --
+                                                           |
+        x2 --> [shelf] --> [highpass] --> (.)^2 --> * w2 --(+)--> mean over 100 ms --> ring of the last 30 means
+        ...                                                |
+        xN --> [shelf] --> [highpass] --> (.)^2 --> * wN --
+
+    -> every channel is filtered by the "K-weighting": a high-shelf filter (+4 dB above 1.5 kHz, the acoustic effect of the head) and a highpass filter (38 Hz). Both are biquads in direct form 2, like in hsd_biquad~, but with the states in double precision, because the highpass is tuned very low compared to the sample rate. their coefficients are calculated for the current sample rate with the formulas of the standard filters (see hsd_loudness_coefficients()).
+    -> the squared outputs of all channels are weighted (message "weights <list>": 1.0 for the front channels, 1.41 for the surround channels) and summed. the mean of this sum over 100 ms is stored in a ring of the last 30 means. the mean of the last 4 values is the energy of the last 400 ms (momentary), the mean of all 30 values the energy of the last 3 s (short-term). the loudness is -0.691 + 10*log10(energy).
+    -> the energies of 400 ms, which are calculated every 100 ms, are the "gating blocks" for the integrated loudness (400 ms long with an overlap of 75%). BS.1770 first leaves out all blocks below -70 LUFS (absolute gate), then all blocks that are more than 10 LU below the loudness of the remaining blocks (relative gate). the integrated loudness is the loudness of the mean energy of the blocks that are left.
+
+
+ The whole signal processing runs in one perform-routine: the two filters, the squaring and the weighted sum of a channel are calculated in one loop over the samples, so the filtered signals are never written to memory. The signal vector is split where a period of 100 ms ends, so the periods are sample-accurate for any block size.
+
+
+ The gating needs all blocks since the start, but over hours of programme that would be a lot of memory, and the relative gate changes with every new block. Therefore the blocks are not stored, but counted in a histogram: one bin per 0.1 LU from -70 to +30 LUFS, with the number of blocks and the sum of their energies in every bin. The integrated loudness is calculated from the 1000 bins, so the memory and the time needed for it stay the same, no matter how long the measurement runs. The relative gate is rounded to the next bin (0.1 LU), the energies themselves are summed exactly.
+
+
+ Messages:
+
+    -> "weights <list>": the weights of the channels, the first value for the first channel and so on. a single value sets all channels. the default is 1.0 for all channels, and 1, 1, 1, 1.41, 1.41 for 5 channels (L, R, C, Ls, Rs).
+    -> "reset": starts a new measurement of the integrated loudness.
+
+ */
+
+#include "m_pd.h"
+#include <math.h>
+
+/* the maximum number of channels */
+#define HSD_LOUDNESS_MAX 8
+
+/* the number of 100 ms periods in the ring (3 s for the short-term loudness) and in the momentary loudness (400 ms) */
+#define HSD_LOUDNESS_SHORTTERM 30
+#define HSD_LOUDNESS_MOMENTARY 4
+
+/* the histogram of the gating blocks: HSD_LOUDNESS_BINS bins of 0.1 LU, starting at the absolute gate */
+#define HSD_LOUDNESS_BINS 1000
+#define HSD_LOUDNESS_GATE -70
+#define HSD_LOUDNESS_RELATIVE_GATE -10
+
+/* the lowest loudness that is sent out */
+#define HSD_LOUDNESS_FLOOR -120
+
+/* default number of channels */
+#define DEFAULT_CHANNELS 2
+
+#define PI 3.14159265358979
+
+/* data struct */
+typedef struct _hsd_loudness{
+
+    /* the object data itself */
+    t_object obj;
+
+    /* sample rate */
+    t_float sr;
+
+    /* the number of channels and their weights */
+    int channels;
+    t_float weight[HSD_LOUDNESS_MAX];
+
+    /* the coefficients of the two filters of the K-weighting (0 = b0, 1 = b1, 2 = b2, 3 = a1, 4 = a2, like in hsd_biquad~) */
+    double shelf[5];
+    double highpass[5];
+
+    /* the states of the filters of every channel, z1 and z2 of the shelf, then z1 and z2 of the highpass */
+    double state[HSD_LOUDNESS_MAX][4];
+
+    /* the input vectors of the channels, set by the dsp-init-routine */
+    t_float *in_vec[HSD_LOUDNESS_MAX];
+
+    /* the current period of 100 ms: its length in samples, the number of samples that are already summed, and the weighted sum of the squared samples */
+    t_int period;
+    t_int period_count;
+    double period_sum;
+
+    /* the mean energies of the last 30 periods, the position of the oldest one, and the number of periods since the start or the last reset (up to 30) */
+    double ring[HSD_LOUDNESS_SHORTTERM];
+    int ring_index;
+    int periods;
+
+    /* the histogram of the gating blocks: the number of blocks and the sum of their energies in every bin, and of all bins */
+    t_int bin_count[HSD_LOUDNESS_BINS];
+    double bin_energy[HSD_LOUDNESS_BINS];
+    t_int total_count;
+    double total_energy;
+
+    /* the energies of the last 400 ms and 3 s, the outlet and the clock that sends the loudness after the DSP tick */
+    double momentary;
+    double shortterm;
+    t_outlet *out;
+    t_clock *clock;
+
+    /* dummy float for CLASS_MAINSIGNALIN */
+    t_float x_f;
+
+}t_hsd_loudness;
+
+static t_class *hsd_loudness_class;
+
+
+/* function prototypes */
+void *hsd_loudness_new(t_symbol *s, short argc, t_atom *argv);
+void hsd_loudness_free(t_hsd_loudness *x);
+void hsd_loudness_dsp(t_hsd_loudness *x, t_signal **sp);
+t_int *hsd_loudness_perform(t_int *w);
+void hsd_loudness_coefficients(t_hsd_loudness *x);
+void hsd_loudness_period(t_hsd_loudness *x);
+void hsd_loudness_tick(t_hsd_loudness *x);
+void hsd_loudness_weights(t_hsd_loudness *x, t_symbol *s, short argc, t_atom *argv);
+void hsd_loudness_reset(t_hsd_loudness *x);
+t_float hsd_loudness_lufs(double energy);
+
+
+/* calculates the coefficients of the K-weighting for the current sample rate, and the length of a period of 100 ms. the filters are the ones of BS.1770, the formulas give the coefficients of the standard for 48 kHz, and the same filters for any other sample rate */
+void hsd_loudness_coefficients(t_hsd_loudness *x){
+
+    double K, Q, a0, Vh, Vb;
+
+    // the high-shelf: +4 dB above 1681.97 Hz
+    K = tan(PI * 1681.974450955533 / x->sr);
+    Q = 0.7071752369554196;
+    Vh = pow(10, 3.999843853973347 / 20);
+    Vb = pow(Vh, 0.4996667741545416);
+    a0 = 1 + K / Q + K * K;
+    x->shelf[0] = (Vh + Vb * K / Q + K * K) / a0;
+    x->shelf[1] = 2 * (K * K - Vh) / a0;
+    x->shelf[2] = (Vh - Vb * K / Q + K * K) / a0;
+    x->shelf[3] = 2 * (K * K - 1) / a0;
+    x->shelf[4] = (1 - K / Q + K * K) / a0;
+
+    // the highpass at 38.14 Hz. the feedforward coefficients are 1, -2, 1 like in the standard (the gain of the passband is not normalized)
+    K = tan(PI * 38.13547087602444 / x->sr);
+    Q = 0.5003270373238773;
+    a0 = 1 + K / Q + K * K;
+    x->highpass[0] = 1;
+    x->highpass[1] = -2;
+    x->highpass[2] = 1;
+    x->highpass[3] = 2 * (K * K - 1) / a0;
+    x->highpass[4] = (1 - K / Q + K * K) / a0;
+
+    x->period = (t_int)(x->sr * 0.1 + 0.5);
+}
+
+/* function for setting the weights of the channels, executed when a "weights" message is received */
+void hsd_loudness_weights(t_hsd_loudness *x, t_symbol *s, short argc, t_atom *argv){
+
+    int c;
+    t_float weight;
+
+    if (argc < 1) {
+        return;
+    }
+
+    for (c=0; c<x->channels && (c<argc || argc==1); c++) {
+
+        weight = atom_getfloatarg((argc==1) ? 0 : c, argc, argv);
+
+        // sanity checking
+        if (weight < 0) {
+            error("hsd_loudness~: illegal weight for channel %d: %f. weight set to 1", c+1, weight);
+            weight = 1;
+        }
+        x->weight[c] = weight;
+    }
+}
+
+/* function for starting a new measurement, executed when a "reset" message is received. the states of the filters are kept, they belong to the signal and not to the measurement */
+void hsd_loudness_reset(t_hsd_loudness *x){
+
+    int k;
+
+    x->period_count = 0;
+    x->period_sum = 0;
+
+    for (k=0; k<HSD_LOUDNESS_SHORTTERM; k++) {
+        x->ring[k] = 0;
+    }
+    x->ring_index = 0;
+    x->periods = 0;
+
+    for (k=0; k<HSD_LOUDNESS_BINS; k++) {
+        x->bin_count[k] = 0;
+        x->bin_energy[k] = 0;
+    }
+    x->total_count = 0;
+    x->total_energy = 0;
+
+    x->momentary = 0;
+    x->shortterm = 0;
+}
+
+
+/* returns the loudness in LUFS of a (weighted) mean energy */
+t_float hsd_loudness_lufs(double energy){
+
+    double lufs;
+
+    if (energy <= 0) {
+        return HSD_LOUDNESS_FLOOR;
+    }
+    lufs = -0.691 + 10 * log10(energy);
+
+    return (lufs < HSD_LOUDNESS_FLOOR) ? HSD_LOUDNESS_FLOOR : lufs;
+}
+
+
+/* called by the perform routine at the end of every period of 100 ms: stores the mean energy of the period in the ring, calculates the energies of the last 400 ms and 3 s, and counts the 400 ms block in the histogram. the integrated loudness is not calculated here, but in the clock function */
+void hsd_loudness_period(t_hsd_loudness *x){
+
+    int k, bin;
+    double momentary = 0, shortterm = 0;
+    t_float lufs;
+
+    x->ring[x->ring_index] = x->period_sum / x->period;
+    x->ring_index = (x->ring_index + 1) % HSD_LOUDNESS_SHORTTERM;
+    x->period_sum = 0;
+    x->period_count = 0;
+    if (x->periods < HSD_LOUDNESS_SHORTTERM) {
+        x->periods++;
+    }
+
+    // the ring index points to the oldest period now, the newest ones are in front of it
+    for (k=1; k<=HSD_LOUDNESS_MOMENTARY; k++) {
+        momentary += x->ring[(x->ring_index + HSD_LOUDNESS_SHORTTERM - k) % HSD_LOUDNESS_SHORTTERM];
+    }
+    for (k=0; k<HSD_LOUDNESS_SHORTTERM; k++) {
+        shortterm += x->ring[k];
+    }
+    x->momentary = momentary / HSD_LOUDNESS_MOMENTARY;
+    x->shortterm = shortterm / HSD_LOUDNESS_SHORTTERM;
+
+    /* the gating block of the last 400 ms. the first blocks are left out until 400 ms have been measured. blocks below the absolute gate are not counted at all */
+    if (x->periods >= HSD_LOUDNESS_MOMENTARY) {
+        lufs = hsd_loudness_lufs(x->momentary);
+        if (lufs >= HSD_LOUDNESS_GATE) {
+            bin = (int)((lufs - HSD_LOUDNESS_GATE) * 10);
+            if (bin >= HSD_LOUDNESS_BINS) {
+                bin = HSD_LOUDNESS_BINS - 1;
+            }
+            x->bin_count[bin]++;
+            x->bin_energy[bin] += x->momentary;
+            x->total_count++;
+            x->total_energy += x->momentary;
+        }
+    }
+
+    clock_delay(x->clock, 0);
+}
+
+
+/* the clock function calculates the integrated loudness from the histogram and sends the loudness values after the DSP tick. outlets must not be used in the perform routine */
+void hsd_loudness_tick(t_hsd_loudness *x){
+
+    t_atom value;
+    t_float integrated = HSD_LOUDNESS_FLOOR;
+    t_float gate;
+    double energy = 0;
+    t_int count = 0;
+    int k, start;
+
+    /* the relative gate is 10 LU below the loudness of all blocks above the absolute gate. only the bins from the gate upwards are summed */
+    if (x->total_count > 0) {
+
+        gate = hsd_loudness_lufs(x->total_energy / x->total_count) + HSD_LOUDNESS_RELATIVE_GATE;
+        start = (int)ceil((gate - HSD_LOUDNESS_GATE) * 10);
+        if (start < 0) {
+            start = 0;
+        }
+
+        for (k=start; k<HSD_LOUDNESS_BINS; k++) {
+            count += x->bin_count[k];
+            energy += x->bin_energy[k];
+        }
+        if (count > 0) {
+            integrated = hsd_loudness_lufs(energy / count);
+        }
+    }
+
+    SETFLOAT(&value, hsd_loudness_lufs(x->momentary));
+    outlet_anything(x->out, gensym("momentary"), 1, &value);
+    SETFLOAT(&value, hsd_loudness_lufs(x->shortterm));
+    outlet_anything(x->out, gensym("shortterm"), 1, &value);
+    SETFLOAT(&value, integrated);
+    outlet_anything(x->out, gensym("integrated"), 1, &value);
+}
+
+
+/* the dsp-init-routine */
+void hsd_loudness_dsp(t_hsd_loudness *x, t_signal **sp)
+{
+    int c, k;
+
+    /* check for sample-rate changes. the filters are calculated again, and the measurement starts again (the periods have a different length now) */
+    if(x->sr != sp[0]->s_sr){
+        x->sr = sp[0]->s_sr;
+        hsd_loudness_coefficients(x);
+        hsd_loudness_reset(x);
+        for (c=0; c<HSD_LOUDNESS_MAX; c++) {
+            for (k=0; k<4; k++) {
+                x->state[c][k] = 0;
+            }
+        }
+    }
+
+    // the input vectors of all channels
+    for (c=0; c<x->channels; c++) {
+        x->in_vec[c] = sp[c]->s_vec;
+    }
+
+    /* add the objects signal processing to the signal-chain of puredata */
+    dsp_add(hsd_loudness_perform,
+            2,
+            x,
+            sp[0]->s_n);
+}
+
+
+/* the perform routine */
+t_int *hsd_loudness_perform(t_int *w)
+{
+    t_hsd_loudness *x = (t_hsd_loudness *) (w[1]);      //object data
+    t_int n = w[2];                                     //buffer-size
+
+    /* get needed data from data struct */
+    int channels = x->channels;
+    double b0 = x->shelf[0], b1 = x->shelf[1], b2 = x->shelf[2], a1 = x->shelf[3], a2 = x->shelf[4];
+    double c1 = x->highpass[3], c2 = x->highpass[4];
+
+    t_float *in;
+    double *state;
+    double z1, z2, z3, z4, u, y, energy, sum;
+    t_int done = 0, length, i;
+    int c;
+
+    /* DSP-Loop, split where a period of 100 ms ends */
+    while (done < n) {
+
+        length = x->period - x->period_count;
+        if (length > n - done) {
+            length = n - done;
+        }
+
+        sum = 0;
+
+        /* the channels, one after the other */
+        for (c=0; c<channels; c++) {
+
+            in = x->in_vec[c] + done;
+            state = x->state[c];
+            z1 = state[0];
+            z2 = state[1];
+            z3 = state[2];
+            z4 = state[3];
+            energy = 0;
+
+            for (i=0; i<length; i++) {
+
+                // the high-shelf, direct form 2 like in hsd_biquad~
+                u = in[i] - a1 * z1 - a2 * z2;
+                y = b0 * u + b1 * z1 + b2 * z2;
+                z2 = z1;
+                z1 = u;
+
+                // the highpass (b0 = 1, b1 = -2, b2 = 1)
+                u = y - c1 * z3 - c2 * z4;
+                y = u - 2 * z3 + z4;
+                z4 = z3;
+                z3 = u;
+
+                energy += y * y;
+            }
+
+            state[0] = z1;
+            state[1] = z2;
+            state[2] = z3;
+            state[3] = z4;
+
+            sum += x->weight[c] * energy;
+        }
+
+        x->period_sum += sum;
+        x->period_count += length;
+        done += length;
+
+        // the end of a period of 100 ms
+        if (x->period_count >= x->period) {
+            hsd_loudness_period(x);
+        }
+    }
+
+    return w+3;
+}
+
+
+/* free function, the clock has to be freed */
+void hsd_loudness_free(t_hsd_loudness *x)
+{
+    clock_free(x->clock);
+}
+
+
+/* new-instance routine */
+void *hsd_loudness_new(t_symbol *s, short argc, t_atom *argv)
+{
+    // set default values
+    t_float channels = DEFAULT_CHANNELS;
+    int c, k;
+
+    t_hsd_loudness *x = (t_hsd_loudness *)pd_new(hsd_loudness_class);
+
+    /* getting creation argument: the number of channels */
+    if (argc > 0) {
+        channels = atom_getfloatarg(0, argc, argv);
+    }
+
+    // sanity checking
+    if (channels < 1 || channels > HSD_LOUDNESS_MAX) {
+        error("hsd_loudness~: illegal number of channels: %f. number of channels set to %d", channels, DEFAULT_CHANNELS);
+        channels = DEFAULT_CHANNELS;
+    }
+    x->channels = channels;
+
+    // creating the signal-inlets, the first one is the main signal inlet
+    for (c=1; c<x->channels; c++) {
+        inlet_new(&x->obj, &x->obj.ob_pd, &s_signal, &s_signal);
+    }
+
+    // the outlet for the loudness messages and the clock that sends them
+    x->out = outlet_new(&x->obj, 0);
+    x->clock = clock_new(x, (t_method)hsd_loudness_tick);
+
+    /* the weights of the channels: 1.0 for all, the surround channels of a 5 channel signal (L, R, C, Ls, Rs) get 1.41 */
+    for (c=0; c<HSD_LOUDNESS_MAX; c++) {
+        x->weight[c] = 1;
+        x->in_vec[c] = NULL;
+        for (k=0; k<4; k++) {
+            x->state[c][k] = 0;
+        }
+    }
+    if (x->channels == 5) {
+        x->weight[3] = 1.41;
+        x->weight[4] = 1.41;
+    }
+
+    // getting sample rate, calculating the filters
+    x->sr = sys_getsr();
+    hsd_loudness_coefficients(x);
+    hsd_loudness_reset(x);
+
+    return x;
+}
+
+/* setup routine */
+void hsd_loudness_tilde_setup(void){
+
+    hsd_loudness_class = class_new(gensym("hsd_loudness~"),
+                                   (t_newmethod)hsd_loudness_new,
+                                   (t_method)hsd_loudness_free,
+                                   sizeof(t_hsd_loudness),
+                                   0,
+                                   A_GIMME,
+                                   0);
+
+    CLASS_MAINSIGNALIN(hsd_loudness_class, t_hsd_loudness, x_f);
+
+
+    class_addmethod(hsd_loudness_class,
+                    (t_method)hsd_loudness_dsp,
+                    gensym("dsp"),
+                    0);
+
+    class_addmethod(hsd_loudness_class,
+                    (t_method)hsd_loudness_weights,
+                    gensym("weights"),
+                    A_GIMME,
+                    0);
+
+    class_addmethod(hsd_loudness_class,
+                    (t_method)hsd_loudness_reset,
+                    gensym("reset"),
+                    0);
+
+
+    post ("hsd_loudness~ from the hsd_library, HS Duesseldorf ");
+
+}
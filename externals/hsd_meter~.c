@@ -0,0 +1,441 @@
+/* hsd_meter~ external from the HSD-Library, University of Applied Science Duesseldorf
+ Created 18.10.2026
+
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This is a level meter for up to 64 channels. For every channel, it calculates the peak-level (like hsd_peakf~) and the rms-level (like hsd_rmsf~) with the same formulas (DAFX, Zoelzer):
+
+    y(n) = (1-AT) * y(n-1) + AT * |x(n)|      -> peak, if the signal-level is rising (attack-phase)
+    y(n) = (1-RT) * y(n-1)                    -> peak, if the signal-level is falling (release-phase)
+
+    y^2(n) = (1-TAV) * y^2(n-1) + TAV * x(n) * x(n)     -> rms
+
+ Every channel has its own signal inlet. The levels are not sent as signals, but as two lists with one value per channel: the peak-levels to the left outlet and the rms-levels to the right outlet, once every <interval> sample blocks.
+
+
+ Compared to lots of hsd_peakf~ and hsd_rmsf~ objects, the meter saves a lot of work:
+
+    -> an envelope follower can´t be calculated for several samples at a time, every sample depends on the one before. but the channels don´t depend on each other, so the meter calculates all channels of one sample at a time. the signal vectors are copied in chunks to a buffer, where the absolute values of the channels of one sample lie next to each other. the loop over the channels then runs over contiguous memory and the compiler can calculate several channels at a time with SIMD instructions.
+    -> the "if (a > xpeak_z1)" of hsd_peakf~ would stop this, so both formulas are calculated and the right one is selected without a branch: the result of the comparison (1 or 0) is used as a factor, and the compiler translates it into a compare/mask instruction for all lanes.
+    -> the root of the rms-level is only extracted once per list, not for every sample, and no output signals have to be written.
+    -> the time coefficients are only calculated when a time or the sample rate changes, and ramped within one block like in hsd_peakf~.
+
+
+ Messages:
+
+    -> "attack <ms>", "release <ms>": the attack- and release time of the peak-levels.
+    -> "time <ms>": the averaging time of the rms-levels.
+    -> "interval <blocks>": the number of sample blocks between two lists (default 1).
+    -> "bang": sets all levels to 0.
+
+ */
+
+#include "m_pd.h"
+#include <math.h>
+
+/* the maximum number of channels */
+#define HSD_METER_MAX 64
+
+/* the size of the buffer for the transposed samples. a chunk has HSD_METER_SCRATCH/channels samples */
+#define HSD_METER_SCRATCH 4096
+
+/* default number of channels, attack-, release- and rms-times */
+#define DEFAULT_CHANNELS 2
+#define DEFAULT_ATTACK_MS 1
+#define DEFAULT_RELEASE_MS 20
+#define DEFAULT_RMS_MS 4
+
+#define EULER 2.718281828459045
+
+/* data struct */
+typedef struct _hsd_meter{
+
+    /* the object data itself */
+    t_object obj;
+
+    /* sample rate */
+    t_float sr;
+
+    /* the number of channels */
+    int channels;
+
+    /* attack, release and rms times in ms */
+    t_float t_a;
+    t_float t_r;
+    t_float t_rms;
+
+    /* the time coefficients used in the last block, and the ones for the current times that are reached by the end of the next block */
+    t_float AT, RT, TAV;
+    t_float AT_target, RT_target, TAV_target;
+
+    /* the peak-levels and the squared rms-levels of all channels */
+    t_float peak[HSD_METER_MAX];
+    t_float rms2[HSD_METER_MAX];
+
+    /* the input vectors of the channels, set by the dsp-init-routine */
+    t_float *in_vec[HSD_METER_MAX];
+
+    /* the absolute values of a chunk of samples, the channels of one sample next to each other */
+    t_float scratch[HSD_METER_SCRATCH];
+
+    /* the number of blocks between two lists, the number of blocks since the last list, the list outlets, the clock that sends the lists after the DSP tick, and the lists */
+    int interval;
+    int block_count;
+    t_outlet *peak_out;
+    t_outlet *rms_out;
+    t_clock *clock;
+    t_atom peak_list[HSD_METER_MAX];
+    t_atom rms_list[HSD_METER_MAX];
+
+    /* dummy float for CLASS_MAINSIGNALIN */
+    t_float x_f;
+
+}t_hsd_meter;
+
+static t_class *hsd_meter_class;
+
+
+/* function prototypes */
+void *hsd_meter_new(t_symbol *s, short argc, t_atom *argv);
+void hsd_meter_free(t_hsd_meter *x);
+void hsd_meter_dsp(t_hsd_meter *x, t_signal **sp);
+t_int *hsd_meter_perform(t_int *w);
+void hsd_meter_tick(t_hsd_meter *x);
+void hsd_meter_coefficients(t_hsd_meter *x);
+void hsd_meter_attack(t_hsd_meter *x, t_floatarg f);
+void hsd_meter_release(t_hsd_meter *x, t_floatarg f);
+void hsd_meter_time(t_hsd_meter *x, t_floatarg f);
+void hsd_meter_interval(t_hsd_meter *x, t_floatarg f);
+void hsd_meter_bang(t_hsd_meter *x);
+
+
+/* calculates the time coefficients for the current times and sample rate. the perform routine ramps to them within the next block */
+void hsd_meter_coefficients(t_hsd_meter *x){
+
+    x->AT_target = 1 - pow(EULER, -2.2/(x->sr * x->t_a * 0.001));
+    x->RT_target = 1 - pow(EULER, -2.2/(x->sr * x->t_r * 0.001));
+    x->TAV_target = 1 - pow(EULER, -2.2/(x->sr * x->t_rms * 0.001));
+}
+
+/* functions for setting the attack, release and rms times. a time of 0 ms follows the input immediately */
+void hsd_meter_attack(t_hsd_meter *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_a = f;
+    hsd_meter_coefficients(x);
+}
+
+void hsd_meter_release(t_hsd_meter *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_r = f;
+    hsd_meter_coefficients(x);
+}
+
+void hsd_meter_time(t_hsd_meter *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_rms = f;
+    hsd_meter_coefficients(x);
+}
+
+/* function for setting the number of blocks between two lists */
+void hsd_meter_interval(t_hsd_meter *x, t_floatarg f){
+
+    if (f < 1) {
+        f = 1;
+    }
+    x->interval = f;
+    x->block_count = 0;
+}
+
+/* function for setting all levels to 0, executed when a bang message is received */
+void hsd_meter_bang(t_hsd_meter *x){
+
+    int c;
+
+    for (c=0; c<HSD_METER_MAX; c++) {
+        x->peak[c] = 0;
+        x->rms2[c] = 0;
+    }
+}
+
+
+/* the clock function sends the lists after the DSP tick, right to left. outlets must not be used in the perform routine */
+void hsd_meter_tick(t_hsd_meter *x){
+
+    outlet_list(x->rms_out, &s_list, x->channels, x->rms_list);
+    outlet_list(x->peak_out, &s_list, x->channels, x->peak_list);
+}
+
+
+/* the dsp-init-routine */
+void hsd_meter_dsp(t_hsd_meter *x, t_signal **sp)
+{
+    int c;
+
+    /* check for sample-rate changes. the time coefficients depend on the sample rate, they are used at once, without ramping */
+    if(x->sr != sp[0]->s_sr){
+        x->sr = sp[0]->s_sr;
+        hsd_meter_coefficients(x);
+        x->AT = x->AT_target;
+        x->RT = x->RT_target;
+        x->TAV = x->TAV_target;
+    }
+
+    // the input vectors of all channels
+    for (c=0; c<x->channels; c++) {
+        x->in_vec[c] = sp[c]->s_vec;
+    }
+
+    /* add the objects signal processing to the signal-chain of puredata */
+    dsp_add(hsd_meter_perform,
+            2,
+            x,
+            sp[0]->s_n);
+}
+
+
+/* the perform routine */
+t_int *hsd_meter_perform(t_int *w)
+{
+    t_hsd_meter *x = (t_hsd_meter *) (w[1]);            //object data
+    t_int n = w[2];                                     //buffer-size
+
+    /* get needed data from data struct */
+    int channels = x->channels;
+    t_float *scratch = x->scratch;
+    t_int chunk = HSD_METER_SCRATCH / channels;
+
+    // the levels of all channels. local copies, so the compiler knows that the scratch buffer doesn´t overlap them
+    t_float peak[HSD_METER_MAX];
+    t_float rms2[HSD_METER_MAX];
+
+    t_float *in, *s, a, p, attack, release;
+    int rising;
+    t_int done = 0, i, length;
+    int c;
+
+    /* the time-constants of the last block. if a time has changed, they are ramped to the new value within this block (the increments are zero otherwise) */
+    t_float AT = x->AT;
+    t_float RT = x->RT;
+    t_float TAV = x->TAV;
+    t_float AT_inc = (x->AT_target - AT) / n;
+    t_float RT_inc = (x->RT_target - RT) / n;
+    t_float TAV_inc = (x->TAV_target - TAV) / n;
+    x->AT = x->AT_target;
+    x->RT = x->RT_target;
+    x->TAV = x->TAV_target;
+
+    for (c=0; c<channels; c++) {
+        peak[c] = x->peak[c];
+        rms2[c] = x->rms2[c];
+    }
+
+    /* DSP-Loop, one chunk after the other */
+    while (done < n) {
+
+        length = n - done;
+        if (length > chunk) {
+            length = chunk;
+        }
+
+        // copy the absolute values of the chunk to the scratch buffer, the channels of one sample next to each other
+        for (c=0; c<channels; c++) {
+            in = x->in_vec[c] + done;
+            for (i=0; i<length; i++) {
+                scratch[i * channels + c] = fabs(in[i]);
+            }
+        }
+
+        /* the envelope followers, one sample after the other, but all channels of a sample at once */
+        for (i=0; i<length; i++) {
+
+            // ramp the time-constants
+            AT += AT_inc;
+            RT += RT_inc;
+            TAV += TAV_inc;
+
+            s = scratch + i * channels;
+
+            for (c=0; c<channels; c++) {
+                a = s[c];
+                p = peak[c];
+
+                // both the attack- and the release-formula are calculated, the rising or falling level selects one of them. the selection is written as a sum with the factors 1 and 0, an "if" or "?:" would keep the compiler from using SIMD instructions (the comparison might raise a floating-point exception)
+                attack = (1-AT) * p + AT * a;
+                release = (1-RT) * p;
+                rising = (a > p);
+                peak[c] = rising * attack + (1-rising) * release;
+
+                rms2[c] = (1-TAV) * rms2[c] + TAV * a * a;
+            }
+        }
+
+        done += length;
+    }
+
+    for (c=0; c<channels; c++) {
+        x->peak[c] = peak[c];
+        x->rms2[c] = rms2[c];
+    }
+
+    /* send the lists every "interval" blocks. the clock calls hsd_meter_tick() right after this DSP tick */
+    if (++x->block_count >= x->interval) {
+        x->block_count = 0;
+        for (c=0; c<channels; c++) {
+            SETFLOAT(x->peak_list + c, peak[c]);
+            SETFLOAT(x->rms_list + c, sqrt(rms2[c]));
+        }
+        clock_delay(x->clock, 0);
+    }
+
+    return w+3;
+}
+
+
+/* free function, the clock has to be freed */
+void hsd_meter_free(t_hsd_meter *x)
+{
+    clock_free(x->clock);
+}
+
+
+/* new-instance routine */
+void *hsd_meter_new(t_symbol *s, short argc, t_atom *argv)
+{
+    // set default values
+    t_float channels = DEFAULT_CHANNELS;
+    int c;
+
+    t_hsd_meter *x = (t_hsd_meter *)pd_new(hsd_meter_class);
+
+    x->t_a = DEFAULT_ATTACK_MS;
+    x->t_r = DEFAULT_RELEASE_MS;
+    x->t_rms = DEFAULT_RMS_MS;
+    x->interval = 1;
+
+    /* getting creation arguments: the number of channels, attack-, release- and rms-time, and the interval */
+    if (argc > 0) {
+        channels = atom_getfloatarg(0, argc, argv);
+    }
+    if (argc > 1 && atom_getfloatarg(1, argc, argv)) {
+        x->t_a = atom_getfloatarg(1, argc, argv);
+    }
+    if (argc > 2 && atom_getfloatarg(2, argc, argv)) {
+        x->t_r = atom_getfloatarg(2, argc, argv);
+    }
+    if (argc > 3 && atom_getfloatarg(3, argc, argv)) {
+        x->t_rms = atom_getfloatarg(3, argc, argv);
+    }
+
+    // sanity checking
+    if (channels < 1 || channels > HSD_METER_MAX) {
+        error("hsd_meter~: illegal number of channels: %f. number of channels set to %d", channels, DEFAULT_CHANNELS);
+        channels = DEFAULT_CHANNELS;
+    }
+    x->channels = channels;
+
+    // creating the signal-inlets, the first one is the main signal inlet
+    for (c=1; c<x->channels; c++) {
+        inlet_new(&x->obj, &x->obj.ob_pd, &s_signal, &s_signal);
+    }
+
+    // the list outlets and the clock that sends the lists
+    x->peak_out = outlet_new(&x->obj, &s_list);
+    x->rms_out = outlet_new(&x->obj, &s_list);
+    x->clock = clock_new(x, (t_method)hsd_meter_tick);
+
+    hsd_meter_interval(x, (argc > 4) ? atom_getfloatarg(4, argc, argv) : 1);
+
+    // getting sample rate
+    x->sr = sys_getsr();
+
+    /* calculate the time coefficients, the first block starts with them without ramping */
+    hsd_meter_coefficients(x);
+    x->AT = x->AT_target;
+    x->RT = x->RT_target;
+    x->TAV = x->TAV_target;
+
+    hsd_meter_bang(x);
+    for (c=0; c<HSD_METER_MAX; c++) {
+        SETFLOAT(x->peak_list + c, 0);
+        SETFLOAT(x->rms_list + c, 0);
+        x->in_vec[c] = NULL;
+    }
+
+    return x;
+}
+
+/* setup routine */
+void hsd_meter_tilde_setup(void){
+
+    hsd_meter_class = class_new(gensym("hsd_meter~"),
+                                (t_newmethod)hsd_meter_new,
+                                (t_method)hsd_meter_free,
+                                sizeof(t_hsd_meter),
+                                0,
+                                A_GIMME,
+                                0);
+
+    CLASS_MAINSIGNALIN(hsd_meter_class, t_hsd_meter, x_f);
+
+
+    class_addmethod(hsd_meter_class,
+                    (t_method)hsd_meter_dsp,
+                    gensym("dsp"),
+                    0);
+
+    class_addmethod(hsd_meter_class,
+                    (t_method)hsd_meter_attack,
+                    gensym("attack"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_meter_class,
+                    (t_method)hsd_meter_release,
+                    gensym("release"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_meter_class,
+                    (t_method)hsd_meter_time,
+                    gensym("time"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_meter_class,
+                    (t_method)hsd_meter_interval,
+                    gensym("interval"),
+                    A_FLOAT,
+                    0);
+
+    class_addbang(hsd_meter_class, hsd_meter_bang);
+
+
+    post ("hsd_meter~ from the hsd_library, HS Duesseldorf ");
+
+}
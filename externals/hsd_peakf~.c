@@ -26,22 +26,48 @@
 
  where AT/RT are the time coefficients. 
  
- NOTE: the time constants are calculated every sample block. It might be more efficient to calculate them in another function*/
+ The time constants are not calculated every sample block, but only when the attack or release time (active inlets) or the sample rate changes (see hsd_peakf_coefficients()). A new time constant is not used at once, but ramped linearly from the old one within the next block, so fast changes of the times don´t cause zipper noise.
+ 
+ Control-rate output: for meters and control logic, a full-rate envelope signal is usually thrown away again by snapshot~ or similar objects. With the message "interval <blocks>" (or the third creation argument), the object sends the peak-value as a float to its right outlet, once every <blocks> sample blocks. The peak-value is still calculated for every sample, but the signal outlet only carries the value at the end of each block (a decimated signal). "interval 0" switches back to the full-rate signal output.
+ 
+ dB output: with the message "db 1", the peak-value is sent in dB (20*log10, 0 dB = 1.0) instead of the linear value, both at the signal outlet and the float outlet, so no conversion object is needed behind the envelope follower. The logarithm is the fast approximation of the library (see hsd_db_block() in hsd_library.h), which converts the whole output vector in one loop. Levels below the floor (message "floor <dB>", default -100 dB) are sent as the floor.
+ 
+ True-peak: the peak of the sample values is not always the peak of the analog signal. Between two samples, the reconstructed signal can be higher than both of them (inter-sample peaks), e.g. a sine at a quarter of the sample rate with the samples at +-45° shows only 0.707 of its amplitude. With the message "truepeak 1", the input is oversampled 4 times before the peak is measured, like in ITU-R BS.1770:
+ 
+        x(n) --> [FIR, phase 0] --> |y0| --
+             --> [FIR, phase 1] --> |y1| --|
+             --> [FIR, phase 2] --> |y2| --(max)--> a(n) --> attack/release (see above)
+             --> [FIR, phase 3] --> |y3| --
+ 
+ The oversampling filter is a lowpass with 48 taps (a windowed sinc) at 4 times the sample rate. As only every 4th sample of the oversampled signal is not zero, it is split into 4 "phases" of 12 taps (polyphase filter), and every phase calculates one of the 4 oversampled values between two input samples. The taps are calculated once for all objects (see hsd_peakf_truepeak_init()). The filter runs over the whole block before the envelope follower: the loops over the samples for one tap don´t depend on each other, so the compiler calculates them with SIMD instructions. The filter delays the envelope by 6 samples. */
 
 
 
 #include "m_pd.h"
 #include <math.h>
+#include "hsd_library.h"
 
 /* default attack- and release times */
 #define DEFAULT_ATTACK_MS 1
 #define DEFAULT_RELEASE_MS 20
 
+/* default floor of the dB output */
+#define DEFAULT_FLOOR_DB -100
+
+/* the oversampling of the true-peak mode: the number of phases (the oversampling factor) and the number of taps per phase */
+#define HSD_PEAKF_PHASES 4
+#define HSD_PEAKF_TAPS 12
+
+#define PI 3.14159265358979
+
 #define EULER 2.718281828459045
 
 
 static t_class *hsd_peakf_class;
 
+/* the taps of the oversampling filter, one row per phase. the taps of a row are reversed, so tap j belongs to the input sample x(n - HSD_PEAKF_TAPS + 1 + j) */
+static t_float hsd_peakf_taps[HSD_PEAKF_PHASES][HSD_PEAKF_TAPS];
+
 /* Data Struct */
 typedef struct _hsd_peakf
 {
@@ -55,18 +81,53 @@ typedef struct _hsd_peakf
     t_float t_a;
     t_float t_r;
     
+    /* the time coefficients used in the last block, and the ones for the current times that are reached by the end of the next block */
+    t_float AT, RT;
+    t_float AT_target, RT_target;
+    
     /* sampledelay-element. the output of the envelope follower is stored in this variable and is used for calculating the output value of the following sample */
     t_float xpeak_z1;
     
     /* samplerate */
     t_float sr;
+    
+    /* the control-rate output: the number of blocks between two floats (0 = full-rate signal output), the number of blocks since the last float, the float outlet, the clock that sends the float after the DSP tick, and the value it sends */
+    int interval;
+    int block_count;
+    t_outlet *float_out;
+    t_clock *clock;
+    t_float control_value;
+    
+    /* 1 if the output is in dB, and the floor of the dB output as a linear value */
+    int db;
+    t_float db_floor;
+    
+    /* the true-peak mode: 1 if it is switched on, the block size the buffers are allocated for, and one block of memory for the buffers: the last HSD_PEAKF_TAPS-1 input samples followed by the input block, the output of one phase of the filter, and the maximum of all phases (the input of the envelope follower) */
+    int truepeak;
+    t_int truepeak_size;
+    t_float *truepeak_memory;
+    t_float *truepeak_in;
+    t_float *truepeak_phase;
+    t_float *truepeak_out;
 
 }t_hsd_peakf;
 
 /* function prototypes */
-void *hsd_peakf_new (t_floatarg f1, t_floatarg f2);
+void *hsd_peakf_new (t_floatarg f1, t_floatarg f2, t_floatarg f3);
+void hsd_peakf_free(t_hsd_peakf *x);
 void hsd_peakf_dsp(t_hsd_peakf *x, t_signal **sp, short *count);
 t_int *hsd_peakf_perform(t_int *w);
+void hsd_peakf_interval(t_hsd_peakf *x, t_floatarg f);
+void hsd_peakf_tick(t_hsd_peakf *x);
+void hsd_peakf_coefficients(t_hsd_peakf *x);
+void hsd_peakf_attack(t_hsd_peakf *x, t_floatarg f);
+void hsd_peakf_release(t_hsd_peakf *x, t_floatarg f);
+void hsd_peakf_db(t_hsd_peakf *x, t_floatarg f);
+void hsd_peakf_floor(t_hsd_peakf *x, t_floatarg f);
+void hsd_peakf_truepeak(t_hsd_peakf *x, t_floatarg f);
+void hsd_peakf_truepeak_init(void);
+int hsd_peakf_truepeak_resize(t_hsd_peakf *x, t_int n);
+void hsd_peakf_truepeak_block(t_hsd_peakf *x, t_float *in, t_int n);
 
 
 /* setup routine */
@@ -74,11 +135,12 @@ void hsd_peakf_tilde_setup(void)
 {
     hsd_peakf_class = class_new(gensym("hsd_peakf~"),
                             (t_newmethod)hsd_peakf_new,
-                            0,
+                            (t_method)hsd_peakf_free,
                             sizeof(t_hsd_peakf),
                             CLASS_DEFAULT,
                             A_DEFFLOAT,
                             A_DEFFLOAT,
+                            A_DEFFLOAT,
                             0);
     
     CLASS_MAINSIGNALIN(hsd_peakf_class,
@@ -90,22 +152,66 @@ void hsd_peakf_tilde_setup(void)
                     gensym("dsp"),
                     0);
     
+    class_addmethod(hsd_peakf_class,
+                    (t_method)hsd_peakf_attack,
+                    gensym("attack"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_peakf_class,
+                    (t_method)hsd_peakf_release,
+                    gensym("release"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_peakf_class,
+                    (t_method)hsd_peakf_interval,
+                    gensym("interval"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_peakf_class,
+                    (t_method)hsd_peakf_db,
+                    gensym("db"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_peakf_class,
+                    (t_method)hsd_peakf_floor,
+                    gensym("floor"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_peakf_class,
+                    (t_method)hsd_peakf_truepeak,
+                    gensym("truepeak"),
+                    A_FLOAT,
+                    0);
+    
+    hsd_peakf_truepeak_init();
+    
     post("hsd_peakf~ by David Bau, University of Applied Sciences Duessldorf");
     
 }
 
 
 /* new-instance routine */
-void *hsd_peakf_new (t_floatarg f1, t_floatarg f2)
+void *hsd_peakf_new (t_floatarg f1, t_floatarg f2, t_floatarg f3)
 {
     t_hsd_peakf *x = (t_hsd_peakf*)pd_new(hsd_peakf_class);
     
-    /* creation of passive float inlets. the attack and release times are accessed by a passive inlet, so no sanity checking is used  */
-    floatinlet_new(&x->obj, &x->t_a);
-    floatinlet_new(&x->obj, &x->t_r);
+    /* creation of active float inlets. the function specified in the last argument is called, when the inlet receives a float message, so the time coefficients are only calculated when a time changes */
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("attack"));
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("release"));
     
     outlet_new(&x->obj, gensym("signal"));
     
+    /* the outlet for the control-rate output and the clock that sends it */
+    x->float_out = outlet_new(&x->obj, gensym("float"));
+    x->clock = clock_new(x, (t_method)hsd_peakf_tick);
+    x->block_count = 0;
+    x->control_value = 0;
+    
     /* init samplerate, delay element and default values */
     x->sr = sys_getsr();
     x->xpeak_z1 = 0;
@@ -121,16 +227,229 @@ void *hsd_peakf_new (t_floatarg f1, t_floatarg f2)
         x->t_r = f2;
     }
     
+    /* calculate the time coefficients, the first block starts with them without ramping */
+    hsd_peakf_attack(x, x->t_a);
+    hsd_peakf_release(x, x->t_r);
+    x->AT = x->AT_target;
+    x->RT = x->RT_target;
+    
+    x->interval = 0;
+    hsd_peakf_interval(x, f3);
+    
+    x->db = 0;
+    hsd_peakf_floor(x, DEFAULT_FLOOR_DB);
+    
+    /* the buffers of the true-peak mode are allocated by the dsp-init-routine, when the block size is known */
+    x->truepeak = 0;
+    x->truepeak_size = 0;
+    x->truepeak_memory = NULL;
+    
     return x;
 }
 
 
+/* free function, the clock and the buffers of the true-peak mode have to be freed */
+void hsd_peakf_free(t_hsd_peakf *x)
+{
+    clock_free(x->clock);
+    hsd_peakf_truepeak_resize(x, 0);
+}
+
+
+/* calculates the time coefficients for the current attack and release times and sample rate. the perform routine ramps to them within the next block */
+void hsd_peakf_coefficients(t_hsd_peakf *x)
+{
+    x->AT_target = 1 - pow(EULER, -2.2/(x->sr * x->t_a * 0.001));
+    x->RT_target = 1 - pow(EULER, -2.2/(x->sr * x->t_r * 0.001));
+}
+
+
+/* functions for setting the attack and release times, called by the active inlets. a time of 0 ms follows the input immediately */
+void hsd_peakf_attack(t_hsd_peakf *x, t_floatarg f)
+{
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_a = f;
+    hsd_peakf_coefficients(x);
+}
+
+void hsd_peakf_release(t_hsd_peakf *x, t_floatarg f)
+{
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_r = f;
+    hsd_peakf_coefficients(x);
+}
+
+
+/* function for setting the number of blocks between two floats of the control-rate output. 0 switches back to the full-rate signal output */
+void hsd_peakf_interval(t_hsd_peakf *x, t_floatarg f)
+{
+    if (f < 0) {
+        f = 0;
+    }
+    x->interval = f;
+    x->block_count = 0;
+}
+
+
+/* function for switching the dB output on (1) and off (0) */
+void hsd_peakf_db(t_hsd_peakf *x, t_floatarg f)
+{
+    x->db = (f != 0);
+}
+
+
+/* function for setting the floor of the dB output in dB. the peak-value is an amplitude, so the linear floor is 10^(floor/20) */
+void hsd_peakf_floor(t_hsd_peakf *x, t_floatarg f)
+{
+    x->db_floor = hsd_db_floor(f, 20);
+}
+
+
+/* function for switching the true-peak mode on (1) and off (0) */
+void hsd_peakf_truepeak(t_hsd_peakf *x, t_floatarg f)
+{
+    x->truepeak = (f != 0);
+}
+
+
+/* calculates the taps of the oversampling filter, called by the setup routine. the filter is a sinc with the cutoff at the original nyquist frequency, at 4 times the sample rate, with a blackman window. the taps of every phase are scaled to a sum of 1, so a constant signal keeps its level in all phases */
+void hsd_peakf_truepeak_init(void)
+{
+    int p, j, k;
+    double t, window, sum;
+    double length = HSD_PEAKF_PHASES * HSD_PEAKF_TAPS;
+    double h[HSD_PEAKF_PHASES * HSD_PEAKF_TAPS];
+    
+    for (k=0; k<length; k++) {
+        t = (k - (length - 1) / 2) / HSD_PEAKF_PHASES;
+        window = 0.42 - 0.5 * cos(2 * PI * (k + 0.5) / length) + 0.08 * cos(4 * PI * (k + 0.5) / length);
+        h[k] = (t == 0) ? window : window * sin(PI * t) / (PI * t);
+    }
+    
+    /* phase p gets the taps p, p+4, p+8 ..., tap p + 4*j belongs to the input sample x(n-j) */
+    for (p=0; p<HSD_PEAKF_PHASES; p++) {
+        sum = 0;
+        for (j=0; j<HSD_PEAKF_TAPS; j++) {
+            sum += h[p + HSD_PEAKF_PHASES * j];
+        }
+        for (j=0; j<HSD_PEAKF_TAPS; j++) {
+            hsd_peakf_taps[p][HSD_PEAKF_TAPS - 1 - j] = h[p + HSD_PEAKF_PHASES * j] / sum;
+        }
+    }
+}
+
+
+/* allocates the buffers of the true-peak mode for blocks of n samples (n = 0 frees them). the old input samples are thrown away. returns 0 if the memory could not be allocated */
+int hsd_peakf_truepeak_resize(t_hsd_peakf *x, t_int n)
+{
+    t_int size;
+    
+    if (n == x->truepeak_size) {
+        return 1;
+    }
+    
+    if (x->truepeak_memory != NULL) {
+        freebytes(x->truepeak_memory, (3 * x->truepeak_size + HSD_PEAKF_TAPS - 1) * sizeof(t_float));
+        x->truepeak_memory = NULL;
+        x->truepeak_size = 0;
+    }
+    if (n == 0) {
+        return 1;
+    }
+    
+    // getbytes() returns zeroed memory, so the filter starts with silence
+    size = 3 * n + HSD_PEAKF_TAPS - 1;
+    x->truepeak_memory = (t_float *)getbytes(size * sizeof(t_float));
+    if (x->truepeak_memory == NULL) {
+        return 0;
+    }
+    x->truepeak_size = n;
+    x->truepeak_in = x->truepeak_memory;
+    x->truepeak_phase = x->truepeak_in + n + HSD_PEAKF_TAPS - 1;
+    x->truepeak_out = x->truepeak_phase + n;
+    
+    return 1;
+}
+
+
+/* the oversampling filter: writes the maximum of the absolute values of the 4 phases for every sample of the input block to truepeak_out */
+void hsd_peakf_truepeak_block(t_hsd_peakf *x, t_float *in, t_int n)
+{
+    t_float *buffer = x->truepeak_in;
+    t_float *phase = x->truepeak_phase;
+    t_float *out = x->truepeak_out;
+    t_float tap, a;
+    t_int i;
+    int p, j;
+    
+    // the input block behind the last input samples of the previous block
+    for (i=0; i<n; i++) {
+        buffer[HSD_PEAKF_TAPS - 1 + i] = in[i];
+    }
+    
+    for (p=0; p<HSD_PEAKF_PHASES; p++) {
+        
+        /* one tap after the other for the whole block. the loop over the samples has no dependencies, so it runs with SIMD instructions */
+        for (i=0; i<n; i++) {
+            phase[i] = 0;
+        }
+        for (j=0; j<HSD_PEAKF_TAPS; j++) {
+            tap = hsd_peakf_taps[p][j];
+            for (i=0; i<n; i++) {
+                phase[i] += tap * buffer[i + j];
+            }
+        }
+        
+        // the maximum of the absolute values of the phases
+        if (p == 0) {
+            for (i=0; i<n; i++) {
+                out[i] = fabs(phase[i]);
+            }
+        }
+        else {
+            for (i=0; i<n; i++) {
+                a = fabs(phase[i]);
+                if (a > out[i]) {
+                    out[i] = a;
+                }
+            }
+        }
+    }
+    
+    // keep the last input samples for the next block
+    for (i=0; i<HSD_PEAKF_TAPS - 1; i++) {
+        buffer[i] = buffer[n + i];
+    }
+}
+
+
+/* the clock function sends the control-rate output after the DSP tick. outlets must not be used in the perform routine */
+void hsd_peakf_tick(t_hsd_peakf *x)
+{
+    outlet_float(x->float_out, x->control_value);
+}
+
+
 /* the dsp-init-routine */
 void hsd_peakf_dsp(t_hsd_peakf *x, t_signal **sp, short *count)
 {
     /* check for sample-rate changes */
     if(x->sr != sp[0]->s_sr){
         x->sr = sp[0]->s_sr;
+        
+        /* the time coefficients depend on the sample rate. they are used at once, without ramping */
+        hsd_peakf_coefficients(x);
+        x->AT = x->AT_target;
+        x->RT = x->RT_target;
+    }
+    
+    /* the buffers of the true-peak mode, allocated in any case, so the mode can be switched on while the DSP is running */
+    if (!hsd_peakf_truepeak_resize(x, sp[0]->s_n)) {
+        error("hsd_peakf~: cannot allocate memory for the true-peak mode");
     }
     
     /* add the objects signal processing to the signal-chain of puredata */
@@ -155,14 +474,65 @@ t_int *hsd_peakf_perform(t_int *w)
     t_float xpeak_z1 = x->xpeak_z1;
     
     t_float a;
+    t_float value;
+    
+    /* the time-constants of the last block. if a time has changed, they are ramped to the new value within this block (the increments are zero otherwise) */
+    t_float AT = x->AT;
+    t_float RT = x->RT;
+    t_float AT_inc = (x->AT_target - AT) / n;
+    t_float RT_inc = (x->RT_target - RT) / n;
+    x->AT = x->AT_target;
+    x->RT = x->RT_target;
+    
+    /* true-peak mode: the envelope follower gets the oversampled peaks of the block instead of the input samples. they are positive already, so the fabs() below doesn´t change them */
+    if (x->truepeak && x->truepeak_size == n) {
+        hsd_peakf_truepeak_block(x, in, n);
+        in = x->truepeak_out;
+    }
     
-    /* calulate the time-constants */
-    t_float AT = 1 - pow(EULER, -2.2/(x->sr * x->t_a * 0.001));
-    t_float RT = 1 - pow(EULER, -2.2/(x->sr * x->t_r * 0.001));
+    /* control-rate output: the peak-value is calculated for every sample, but only written to the outlet at the end of the block */
+    if (x->interval) {
+        
+        /* DSP Loop */
+        while (n--) {
+            AT += AT_inc;
+            RT += RT_inc;
+            a = fabs(*in++);
+            if (a > xpeak_z1) {
+                xpeak_z1 = (1-AT) * xpeak_z1 + AT * a;
+            }else{
+                xpeak_z1 = (1-RT) * xpeak_z1;
+            }
+        }
+        
+        // the decimated signal: the peak-value at the end of the block for the whole block, converted to dB only once
+        value = xpeak_z1;
+        if (x->db) {
+            hsd_db_block(&value, 1, 20, x->db_floor);
+        }
+        n = w[4];
+        while (n--) {
+            *out++ = value;
+        }
+        
+        // send the value every "interval" blocks. the clock calls hsd_peakf_tick() right after this DSP tick
+        if (++x->block_count >= x->interval) {
+            x->block_count = 0;
+            x->control_value = value;
+            clock_delay(x->clock, 0);
+        }
+        
+        x->xpeak_z1 = xpeak_z1;
+        return w+5;
+    }
     
     /* DSP Loop */
     while (n--) {
         
+        // ramp the time-constants
+        AT += AT_inc;
+        RT += RT_inc;
+        
         // get input sample (absolute value)
         a = fabs(*in++);
         
@@ -177,6 +547,11 @@ t_int *hsd_peakf_perform(t_int *w)
         *out++ = xpeak_z1;
     }
     
+    /* dB output: the whole output vector is converted in one loop */
+    if (x->db) {
+        hsd_db_block((t_float *) (w[3]), w[4], 20, x->db_floor);
+    }
+    
     /* store the values that are needed for the next buffer */
     x->xpeak_z1 = xpeak_z1;
     
@@ -0,0 +1,515 @@
+/* hsd_reverb~ external from the HSD-Library, University of Applied Science Duesseldorf
+ Created 18.10.2026
+
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This is a reverberator after James A. Moorer ("About this Reverberation Business", 1979). It consists of a bank of comb filters with a lowpass filter in their feedback paths (see hsd_comblp~), which run in parallel, followed by allpass filters (see hsd_allpass~) in series.
+
+
+                   --> [comblp 1] --
+                  |                 |
+                  |--> [comblp 2] --|
+        —>x       |                 |
+        o—————————|--> [  ...   ] --(+)——>[allpass 1]——>[allpass 2]——> ... ——>(wet)——(+)——>o y—>
+            |     |                 |                                                  ^
+            |      --> [comblp 8] --                                                   |
+            |                                                                          |
+             ---------------------------------------------------------------------(dry)
+
+
+    -> the comb filters model the dense reflections of the room. their delay times are chosen so that they have no common divisors, otherwise the echoes would pile up and sound "metallic". the lowpass filters in the feedback paths let the high frequencies decay faster than the low ones, like in a real room.
+    -> the allpass filters don´t change the frequency response, but smear every echo of the combs in time, so the reverb gets denser.
+
+ The delay times are the ones of the "Freeverb" by Jezar at Dreampoint, which is a well known tuning of the Moorer reverberator.
+
+
+ In pd, the same network can be built with 8 hsd_comblp~ and 4 hsd_allpass~ objects. But then every filter has its own delay-line somewhere in memory, its own perform-routine and the outputs of the combs have to be summed by +~ objects. hsd_reverb~ does everything in one perform-routine:
+
+    -> all delay-lines are placed in ONE block of memory. the 8 comb filters get 8 regions of the same length (a power of two) and share a single write-pointer, the same goes for the 4 allpass filters. so there is only one pointer to increment and one mask for wrapping per group.
+    -> the signal vector is processed in chunks (at most HSD_REVERB_CHUNK samples, but never more than the shortest delay of all filters). every filter calculates the whole chunk in a tight loop before the next filter is calculated, the outputs of the combs are summed into a small local array that the allpass filters then filter in place. because the delay of every filter is longer than the chunk, the samples that are read were all written in earlier chunks, so the reading and writing positions of one chunk never overlap. the loops only touch contiguous memory and a handful of variables that stay in registers, instead of jumping between 12 delay-lines for every single sample.
+    -> the delay times of the filters are fixed, so they are rounded to whole samples and no interpolation is needed.
+
+
+ The lowpass filters in the feedback paths are normalized (lowpass = (1-damping) * comb-output + damping * z1), unlike the one of hsd_comblp~. This way the gain of the feedback path at low frequencies is always the feedback gain itself, so room size and damping can be set independently without the risk of instability.
+
+ */
+
+#include "m_pd.h"
+#include "math.h"
+#include <string.h>
+#include "hsd_library.h"
+
+/* the number of filters. they are fixed, so the compiler knows the length of the loops over the comb filters */
+#define NUM_COMBS 8
+#define NUM_ALLPASSES 4
+
+/* the longest chunk of samples that is processed by one filter before the next filter is calculated */
+#define HSD_REVERB_CHUNK 64
+
+/* the gain of the allpass filters */
+#define ALLPASS_GAIN 0.5
+
+/* the delay times of the comb and allpass filters in ms (the samples of the freeverb at 44.1 kHz) */
+static const t_float comb_times_ms[NUM_COMBS] = {25.306, 26.939, 28.957, 30.748, 32.245, 33.810, 35.306, 36.667};
+static const t_float allpass_times_ms[NUM_ALLPASSES] = {12.608, 10.000, 7.732, 5.102};
+
+/* data struct */
+typedef struct _hsd_reverb{
+
+    /* the object data itself */
+    t_object obj;
+
+    /* sample rate */
+    t_float sr;
+
+    /* the memory block for all delay-lines: first the regions of the comb filters, then the regions of the allpass filters. its size in bytes is needed for freeing it */
+    t_float *memory;
+    size_t bytes;
+
+    /* the comb filters: the start of their regions, the length of one region (a power of two) and the mask for wrapping, the common write-pointer and the delay of every comb in samples */
+    t_float *comb_lines;
+    t_int comb_length;
+    t_int comb_mask;
+    t_int comb_write_index;
+    t_int comb_delay[NUM_COMBS];
+
+    /* the states of the lowpass filters in the feedback paths */
+    t_float comb_z1[NUM_COMBS];
+
+    /* the allpass filters, the same as for the comb filters */
+    t_float *allpass_lines;
+    t_int allpass_length;
+    t_int allpass_mask;
+    t_int allpass_write_index;
+    t_int allpass_delay[NUM_ALLPASSES];
+
+    /* the number of samples that are processed in one chunk: HSD_REVERB_CHUNK, but never more than the shortest delay */
+    t_int chunk;
+
+    /* the parameters as they are set from outside: room size and damping from 0 to 1, dry/wet mix from 0 to 100 */
+    t_float roomsize;
+    t_float damping;
+
+    /* the coefficients derived from the parameters: feedback gain of the combs, damping of the lowpass filters and mix of dry and wet signal */
+    t_float feedback;
+    t_float damp;
+    t_float dry, wet;
+
+    /* dummy float for CLASS_MAINSIGNALIN */
+    t_float x_f;
+
+}t_hsd_reverb;
+
+static t_class *hsd_reverb_class;
+
+
+/* function prototypes */
+void *hsd_reverb_new(t_symbol *s, short argc, t_atom *argv);
+void hsd_reverb_dsp(t_hsd_reverb *x, t_signal **sp);
+t_int *hsd_reverb_perform(t_int *w);
+void hsd_reverb_free(t_hsd_reverb *x);
+void hsd_reverb_stats(t_hsd_reverb *x);
+void hsd_reverb_roomsize(t_hsd_reverb *x, t_floatarg f);
+void hsd_reverb_damping(t_hsd_reverb *x, t_floatarg f);
+void hsd_reverb_drywet(t_hsd_reverb *x, t_floatarg f);
+void hsd_reverb_bang(t_hsd_reverb *x);
+int hsd_reverb_allocate(t_hsd_reverb *x);
+
+
+/* function for (re)allocating the memory block for all delay-lines. the lengths depend on the sample rate, so this is called by the new-instance-routine and whenever the sample rate changes. returns 0 if the memory could not be allocated */
+int hsd_reverb_allocate(t_hsd_reverb *x){
+
+    int i;
+    t_int longest = 0;
+
+    // calculate the delays in samples and find the longest one of each group
+    for (i=0; i<NUM_COMBS; i++) {
+        x->comb_delay[i] = (t_int)(x->sr * comb_times_ms[i]/1000 + 0.5);
+        if (x->comb_delay[i] > longest) {
+            longest = x->comb_delay[i];
+        }
+    }
+    x->comb_length = hsd_nextpow2(longest + 1);
+
+    longest = 0;
+    for (i=0; i<NUM_ALLPASSES; i++) {
+        x->allpass_delay[i] = (t_int)(x->sr * allpass_times_ms[i]/1000 + 0.5);
+        if (x->allpass_delay[i] > longest) {
+            longest = x->allpass_delay[i];
+        }
+    }
+    x->allpass_length = hsd_nextpow2(longest + 1);
+
+    // a chunk must not be longer than the shortest delay, otherwise a filter would read samples that are written in the same chunk
+    x->chunk = HSD_REVERB_CHUNK;
+    for (i=0; i<NUM_COMBS; i++) {
+        if (x->comb_delay[i] < x->chunk) {
+            x->chunk = x->comb_delay[i];
+        }
+    }
+    for (i=0; i<NUM_ALLPASSES; i++) {
+        if (x->allpass_delay[i] < x->chunk) {
+            x->chunk = x->allpass_delay[i];
+        }
+    }
+    if (x->chunk < 1) {
+        x->chunk = 1;
+    }
+
+    // free the old block and get a new one from the arena (already zeroed)
+    if (x->memory) {
+        hsd_arena_free(x->memory, x->bytes);
+        x->memory = NULL;
+    }
+    x->bytes = (NUM_COMBS * x->comb_length + NUM_ALLPASSES * x->allpass_length) * sizeof(t_float);
+    x->memory = (t_float*)hsd_arena_alloc(x->bytes);
+    if (x->memory == NULL) {
+        x->bytes = 0;
+        return 0;
+    }
+
+    // place the regions of the filters in the block
+    x->comb_lines = x->memory;
+    x->comb_mask = x->comb_length - 1;
+    x->allpass_lines = x->memory + NUM_COMBS * x->comb_length;
+    x->allpass_mask = x->allpass_length - 1;
+
+    hsd_reverb_bang(x);
+    return 1;
+}
+
+/* function for setting the room size (0...1). it is mapped to the feedback gain of the comb filters (0.7...0.98) */
+void hsd_reverb_roomsize(t_hsd_reverb *x, t_floatarg f){
+
+    t_float roomsize = f;
+
+    // sanity checking
+    if(roomsize < 0){
+        roomsize = 0;
+    }
+    if(roomsize > 1){
+        roomsize = 1;
+    }
+
+    x->roomsize = roomsize;
+    x->feedback = 0.7 + 0.28 * roomsize;
+}
+
+/* function for setting the damping of high frequencies (0...1). it is used as coefficient of the lowpass filters in the feedback paths */
+void hsd_reverb_damping(t_hsd_reverb *x, t_floatarg f){
+
+    t_float damping = f;
+
+    // sanity checking
+    if(damping < 0){
+        damping = 0;
+    }
+    if(damping > 1){
+        damping = 1;
+    }
+
+    x->damping = damping;
+    // the lowpass must not become a pure integrator
+    x->damp = 0.95 * damping;
+}
+
+void hsd_reverb_drywet(t_hsd_reverb *x, t_floatarg f){
+
+    //create intermediate value
+    t_float dry_wet = f;
+
+    // sanity checking
+    if(dry_wet < 0){
+        dry_wet = 0;
+    }
+    if(dry_wet > 100){
+        dry_wet = 100;
+    }
+    // change parameter
+    x->wet = dry_wet/100.0;
+    x->dry = 1.0 - x->wet;
+}
+
+/* function for resetting all delay-lines and filter states, executed when a bang message is received */
+void hsd_reverb_bang(t_hsd_reverb *x){
+
+    int i;
+
+    if (x->memory) {
+        memset(x->memory, 0, x->bytes);
+    }
+    for (i=0; i<NUM_COMBS; i++) {
+        x->comb_z1[i] = 0;
+    }
+    x->comb_write_index = 0;
+    x->allpass_write_index = 0;
+}
+
+/* prints how much memory the delay-lines of the whole library take, executed when a "stats" message is received */
+void hsd_reverb_stats(t_hsd_reverb *x){
+
+    hsd_arena_stats("hsd_reverb~");
+
+}
+
+
+/* the dsp-init-routine */
+void hsd_reverb_dsp(t_hsd_reverb *x, t_signal **sp)
+{
+    /* check if samplerate has changed. the delay-lines have to be recalculated, their old content is thrown away */
+    if(x->sr != sp[0]->s_sr){
+
+        x->sr = sp[0]->s_sr;
+
+        if(!hsd_reverb_allocate(x)){
+            error("hsd_reverb~: cannot reallocate the delay-lines");
+            // the old delay-lines is gone: forget the sample rate, so the next DSP start tries again instead of running without delay-lines
+            x->sr = 0;
+            return;
+        }
+    }
+
+    /* add the objects signal processing to the signal-chain of puredata */
+    dsp_add(hsd_reverb_perform,
+            4,
+            x,
+            sp[0]->s_vec,
+            sp[1]->s_vec,
+            sp[0]->s_n);
+}
+
+
+/* the perform routine */
+t_int *hsd_reverb_perform(t_int *w)
+{
+    t_hsd_reverb *x = (t_hsd_reverb *) (w[1]);          //object data
+    t_float *input = (t_float *) (w[2]);                //input-vector
+    t_float *output = (t_float *) (w[3]);               //output-vector
+    t_int n = w[4];                                     //buffer-size
+
+    /* get needed data from data struct */
+    t_float *comb_lines = x->comb_lines;
+    t_int comb_length = x->comb_length;
+    t_int comb_mask = x->comb_mask;
+    t_int comb_write_index = x->comb_write_index;
+    t_float *allpass_lines = x->allpass_lines;
+    t_int allpass_length = x->allpass_length;
+    t_int allpass_mask = x->allpass_mask;
+    t_int allpass_write_index = x->allpass_write_index;
+    t_float feedback = x->feedback;
+    t_float damp = x->damp;
+    t_float damp1 = 1 - damp;
+    t_float dry = x->dry;
+    t_float wet = x->wet;
+
+    // the input of the comb filters is scaled down, so the sum of all combs doesn´t clip
+    t_float in_gain = 1.0 / NUM_COMBS;
+
+    // the (scaled) input of the combs and the wet signal of the current chunk
+    t_float in[HSD_REVERB_CHUNK];
+    t_float sum[HSD_REVERB_CHUNK];
+
+    t_float *line, z1, comb_out, yDL, xDL;
+    t_int chunk, read_index, i;
+    int k;
+
+    /* DSP-Loop, one chunk after the other */
+    while (n > 0) {
+
+        chunk = (n < x->chunk) ? n : x->chunk;
+
+        for (i=0; i<chunk; i++) {
+            in[i] = input[i] * in_gain;
+            sum[i] = 0;
+        }
+
+        /* the comb filters, one after the other */
+        for (k=0; k<NUM_COMBS; k++) {
+
+            line = comb_lines + k * comb_length;
+            read_index = comb_write_index - x->comb_delay[k];
+            z1 = x->comb_z1[k];
+
+            for (i=0; i<chunk; i++) {
+
+                // output of the delay-line
+                comb_out = line[(read_index + i) & comb_mask];
+
+                // lowpass filter in the feedback path
+                z1 = damp1 * comb_out + damp * z1;
+
+                // input of the delay-line --> x(n) + g * lowpass
+                line[(comb_write_index + i) & comb_mask] = in[i] + z1 * feedback;
+
+                // sum of all combs
+                sum[i] += comb_out;
+            }
+
+            x->comb_z1[k] = z1;
+        }
+
+        comb_write_index = (comb_write_index + chunk) & comb_mask;
+
+
+        /* the allpass filters in series (see hsd_allpass~), each one filters the whole chunk */
+        for (k=0; k<NUM_ALLPASSES; k++) {
+
+            line = allpass_lines + k * allpass_length;
+            read_index = allpass_write_index - x->allpass_delay[k];
+
+            for (i=0; i<chunk; i++) {
+
+                // output of the delay-line
+                yDL = line[(read_index + i) & allpass_mask];
+
+                // input of the delay line --> x(n) + g*yDL
+                xDL = sum[i] + ALLPASS_GAIN * yDL;
+                line[(allpass_write_index + i) & allpass_mask] = xDL;
+
+                // output y(n) = yDL - g * xDL, which is the input of the next allpass
+                sum[i] = yDL - ALLPASS_GAIN * xDL;
+            }
+        }
+
+        allpass_write_index = (allpass_write_index + chunk) & allpass_mask;
+
+
+        // mix the dry and wet signal
+        for (i=0; i<chunk; i++) {
+            output[i] = dry * input[i] + wet * sum[i];
+        }
+
+        input += chunk;
+        output += chunk;
+        n -= chunk;
+    }
+
+    x->comb_write_index = comb_write_index;
+    x->allpass_write_index = allpass_write_index;
+
+    return w+5;
+}
+
+
+/* free function that is called when the object is destroyed */
+void hsd_reverb_free(t_hsd_reverb *x)
+{
+    if (x->memory) {
+        hsd_arena_free(x->memory, x->bytes);
+    }
+}
+
+
+/* new-instance routine */
+void *hsd_reverb_new(t_symbol *s, short argc, t_atom *argv)
+{
+    // set default values
+    t_float roomsize = 0.5;
+    t_float damping = 0.5;
+    t_float dry_wet = 30;
+
+    t_hsd_reverb *x = (t_hsd_reverb *)pd_new(hsd_reverb_class);
+
+    // creating the active inlets. the functions specified in the last argument are called, when the inlet receives a message
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("roomsize"));
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("damping"));
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("drywet"));
+
+    //creating the signal-outlet
+    outlet_new(&x->obj, gensym("signal"));
+
+    // getting sample rate
+    x->sr = sys_getsr();
+
+    /* getting creation arguments */
+    if (argc>=3) {
+        dry_wet = atom_getfloatarg(2, argc, argv);
+    }
+    if (argc>=2) {
+        damping = atom_getfloatarg(1, argc, argv);
+    }
+    if (argc>=1) {
+        roomsize = atom_getfloatarg(0, argc, argv);
+    }
+
+    // the parameter functions do the sanity checking
+    hsd_reverb_roomsize(x, roomsize);
+    hsd_reverb_damping(x, damping);
+    hsd_reverb_drywet(x, dry_wet);
+
+    /* Allocating the delay-lines */
+    x->memory = NULL;
+    x->bytes = 0;
+    if(!hsd_reverb_allocate(x)){
+        error("hsd_reverb~: cannot allocate memory for the delay-lines");
+        return NULL;
+    }
+
+    return x;
+}
+
+/* setup routine */
+void hsd_reverb_tilde_setup(void){
+
+    hsd_reverb_class = class_new(gensym("hsd_reverb~"),
+                                 (t_newmethod)hsd_reverb_new,
+                                 (t_method)hsd_reverb_free,
+                                 sizeof(t_hsd_reverb),
+                                 0,
+                                 A_GIMME,
+                                 0);
+
+    CLASS_MAINSIGNALIN(hsd_reverb_class, t_hsd_reverb, x_f);
+
+
+    class_addmethod(hsd_reverb_class,
+                    (t_method)hsd_reverb_dsp,
+                    gensym("dsp"),
+                    0);
+
+    class_addmethod(hsd_reverb_class,
+                    (t_method)hsd_reverb_roomsize,
+                    gensym("roomsize"),
+                    A_DEFFLOAT,
+                    0);
+
+    class_addmethod(hsd_reverb_class,
+                    (t_method)hsd_reverb_damping,
+                    gensym("damping"),
+                    A_DEFFLOAT,
+                    0);
+
+    class_addmethod(hsd_reverb_class,
+                    (t_method)hsd_reverb_drywet,
+                    gensym("drywet"),
+                    A_DEFFLOAT,
+                    0);
+
+    class_addbang(hsd_reverb_class, hsd_reverb_bang);
+
+    class_addmethod(hsd_reverb_class,
+                    (t_method)hsd_reverb_stats,
+                    gensym("stats"),
+                    0);
+
+
+    post ("hsd_reverb~ from the hsd_library, HS Duesseldorf ");
+
+}
@@ -21,16 +21,32 @@
     This external generetes an envelope signal of an incoming audio signal. It uses one parameter, the averager-time in milliseconds. The computation of the rms-signal is done by the formula (DAFX, Zoelzer)
  
         y^2(n) = (1-TAV) * y^2(n-1) + TAV * x(n) * x(n);
-    where y^2 is the squared output and TAV the time coefficient. From the squared output, the root is extracted before sending the signal to the outlet */
+    where y^2 is the squared output and TAV the time coefficient. From the squared output, the root is extracted before sending the signal to the outlet
+ 
+    The time coefficient is not calculated every sample block, but only when the averager time (active inlet) or the sample rate changes (see hsd_rmsf_coefficient()). A new coefficient is ramped linearly from the old one within the next block, so fast changes of the time don´t cause zipper noise.
+ 
+    Control-rate output: for meters and control logic, a full-rate envelope signal is usually thrown away again by snapshot~ or similar objects. With the message "interval <blocks>" (or the second creation argument), the object sends the rms-value as a float to its right outlet, once every <blocks> sample blocks. The rms-value is still calculated for every sample, but the root is only extracted once per block, and the signal outlet carries this value for the whole block (a decimated signal). "interval 0" switches back to the full-rate signal output.
+ 
+    dB output: with the message "db 1", the rms-value is sent in dB (0 dB = 1.0) instead of the linear value, both at the signal outlet and the float outlet. The root is not extracted at all in this mode: the dB value is calculated directly from the squared rms-value (10*log10(y^2) = 20*log10(y)). The logarithm is the fast approximation of the library (see hsd_db_block() in hsd_library.h), which converts the whole output vector in one loop, so the envelope follower with dB output costs less than the plain one with its root for every sample. Levels below the floor (message "floor <dB>", default -100 dB) are sent as the floor.
+ 
+    Rectangular window (true rms): the exponential averager weights the past samples less and less, but for loudness measurements and broadcast meters the rms-value over a fixed window (e.g. 50...400 ms) is needed, where every sample in the window has the same weight:
+ 
+        y^2(n) = 1/W * ( x(n)^2 + x(n-1)^2 + ... + x(n-W+1)^2 )
+ 
+    With the message "window <ms>", the object switches to this mode ("window 0" switches back to the exponential averager). The squared input samples are written to a ring-buffer (the delay-line of the library, see hsd_library.h), and the sum is not calculated again for every sample, but kept as a running sum: the newest squared sample is added and the one that falls out of the window is subtracted. So the cost per sample doesn´t depend on the length of the window. Adding and subtracting lets rounding errors pile up in the running sum, therefore it is a double and it is calculated again from the ring-buffer once per second (or once per window, if the window is longer). When the window is switched on, or made longer than the ring-buffer, the ring-buffer starts from silence, so the rms-value needs one window length to fill in (like a meter that was just switched on); a shorter window is correct at once. The averager time has no effect in this mode, the control-rate and dB outputs work the same way. */
 
 
 
 #include "m_pd.h"
 #include <math.h>
+#include "hsd_library.h"
 
 /* default avereager time */
 #define DEFAULT_RMS_MS 4
 
+/* default floor of the dB output */
+#define DEFAULT_FLOOR_DB -100
+
 #define EULER 2.718281828459045
 
 
@@ -49,18 +65,52 @@ typedef struct _hsd_rmsf
     /* rms (averager) time for the envelope follower in ms */
     t_float t_rms;
     
+    /* the time coefficient used in the last block, and the one for the current time that is reached by the end of the next block */
+    t_float TAV;
+    t_float TAV_target;
+    
     /* sampledelay-element. the output of the envelope follower is stored in this variable and is used for calculating the output value of the following sample */
     t_float xrms2_z1;
     
     /* samplerate */
     t_float sr;
     
+    /* the control-rate output: the number of blocks between two floats (0 = full-rate signal output), the number of blocks since the last float, the float outlet, the clock that sends the float after the DSP tick, and the value it sends */
+    int interval;
+    int block_count;
+    t_outlet *float_out;
+    t_clock *clock;
+    t_float control_value;
+    
+    /* 1 if the output is in dB, and the floor of the dB output as a linear value (of the squared rms-value) */
+    int db;
+    t_float db_floor;
+    
+    /* the rectangular window: its length in ms and samples (0 = exponential averager), the ring-buffer with the squared input samples, the running sum of the squared samples in the window, and the number of samples since the sum was calculated again and between two of these calculations */
+    t_float window_ms;
+    t_int window;
+    t_hsd_delayline line;
+    double sum;
+    t_int resum_count;
+    t_int resum_interval;
+    
 }t_hsd_rmsf;
 
 /* function prototypes */
-void *hsd_rmsf_new (t_floatarg f);
+void *hsd_rmsf_new (t_floatarg f, t_floatarg f2);
+void hsd_rmsf_free(t_hsd_rmsf *x);
 void hsd_rmsf_dsp(t_hsd_rmsf *x, t_signal **sp, short *count);
 t_int *hsd_rmsf_perform(t_int *w);
+void hsd_rmsf_interval(t_hsd_rmsf *x, t_floatarg f);
+void hsd_rmsf_tick(t_hsd_rmsf *x);
+void hsd_rmsf_coefficient(t_hsd_rmsf *x);
+void hsd_rmsf_time(t_hsd_rmsf *x, t_floatarg f);
+void hsd_rmsf_db(t_hsd_rmsf *x, t_floatarg f);
+void hsd_rmsf_floor(t_hsd_rmsf *x, t_floatarg f);
+void hsd_rmsf_window(t_hsd_rmsf *x, t_floatarg f);
+int hsd_rmsf_window_update(t_hsd_rmsf *x, int reset);
+void hsd_rmsf_resum(t_hsd_rmsf *x);
+void hsd_rmsf_control(t_hsd_rmsf *x, t_float ms, t_float *out, t_int n);
 
 
 /* setup routine */
@@ -68,10 +118,11 @@ void hsd_rmsf_tilde_setup(void)
 {
     hsd_rmsf_class = class_new(gensym("hsd_rmsf~"),
                             (t_newmethod)hsd_rmsf_new,
-                            0,
+                            (t_method)hsd_rmsf_free,
                             sizeof(t_hsd_rmsf),
                             CLASS_DEFAULT,
                             A_DEFFLOAT,
+                            A_DEFFLOAT,
                             0);
     
     CLASS_MAINSIGNALIN(hsd_rmsf_class,
@@ -83,21 +134,57 @@ void hsd_rmsf_tilde_setup(void)
                     gensym("dsp"),
                     0);
     
+    class_addmethod(hsd_rmsf_class,
+                    (t_method)hsd_rmsf_time,
+                    gensym("time"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_rmsf_class,
+                    (t_method)hsd_rmsf_interval,
+                    gensym("interval"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_rmsf_class,
+                    (t_method)hsd_rmsf_db,
+                    gensym("db"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_rmsf_class,
+                    (t_method)hsd_rmsf_floor,
+                    gensym("floor"),
+                    A_FLOAT,
+                    0);
+    
+    class_addmethod(hsd_rmsf_class,
+                    (t_method)hsd_rmsf_window,
+                    gensym("window"),
+                    A_FLOAT,
+                    0);
+    
     post("hsd_rmsf~ by David Bau, University of Applied Sciences Duessldorf");
     
 }
 
 
 /* new-instance routine */
-void *hsd_rmsf_new (t_floatarg f)
+void *hsd_rmsf_new (t_floatarg f, t_floatarg f2)
 {
     t_hsd_rmsf *x = (t_hsd_rmsf*)pd_new(hsd_rmsf_class);
     
-    /* creation of passive float inlet. the averager time is accessed by a passive inlet, so no sanity checking is used  */
-    floatinlet_new(&x->obj, &x->t_rms);
+    /* creation of the active float inlet. the function specified in the last argument is called, when the inlet receives a float message, so the time coefficient is only calculated when the time changes */
+    inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("time"));
     
     outlet_new(&x->obj, gensym("signal"));
     
+    /* the outlet for the control-rate output and the clock that sends it */
+    x->float_out = outlet_new(&x->obj, gensym("float"));
+    x->clock = clock_new(x, (t_method)hsd_rmsf_tick);
+    x->block_count = 0;
+    x->control_value = 0;
+    
     /* init samplerate, delay element and default value */
     x->sr = sys_getsr();
     x->xrms2_z1 = 0;
@@ -109,16 +196,205 @@ void *hsd_rmsf_new (t_floatarg f)
         x->t_rms = f;
     }
     
+    /* calculate the time coefficient, the first block starts with it without ramping */
+    hsd_rmsf_time(x, x->t_rms);
+    x->TAV = x->TAV_target;
+    
+    x->interval = 0;
+    hsd_rmsf_interval(x, f2);
+    
+    x->db = 0;
+    hsd_rmsf_floor(x, DEFAULT_FLOOR_DB);
+    
+    /* the exponential averager is the default, the ring-buffer of the rectangular window is only allocated when a window is set */
+    x->window_ms = 0;
+    x->window = 0;
+    x->line.buffer = NULL;
+    x->line.length = 0;
+    x->line.mask = 0;
+    x->line.bytes = 0;
+    x->line.write_index = 0;
+    x->sum = 0;
+    x->resum_count = 0;
+    x->resum_interval = 0;
+    
     return x;
 }
 
 
+/* free function, the clock and the ring-buffer have to be freed */
+void hsd_rmsf_free(t_hsd_rmsf *x)
+{
+    clock_free(x->clock);
+    hsd_delayline_free(&x->line);
+}
+
+
+/* calculates the time coefficient for the current averager time and sample rate. the perform routine ramps to it within the next block */
+void hsd_rmsf_coefficient(t_hsd_rmsf *x)
+{
+    x->TAV_target = 1 - pow(EULER, -2.2/(x->sr * x->t_rms * 0.001));
+}
+
+
+/* function for setting the averager time, called by the active inlet. a time of 0 ms follows the input immediately */
+void hsd_rmsf_time(t_hsd_rmsf *x, t_floatarg f)
+{
+    if (f < 0) {
+        f = 0;
+    }
+    x->t_rms = f;
+    hsd_rmsf_coefficient(x);
+}
+
+
+/* function for setting the number of blocks between two floats of the control-rate output. 0 switches back to the full-rate signal output */
+void hsd_rmsf_interval(t_hsd_rmsf *x, t_floatarg f)
+{
+    if (f < 0) {
+        f = 0;
+    }
+    x->interval = f;
+    x->block_count = 0;
+}
+
+
+/* function for switching the dB output on (1) and off (0) */
+void hsd_rmsf_db(t_hsd_rmsf *x, t_floatarg f)
+{
+    x->db = (f != 0);
+}
+
+
+/* function for setting the floor of the dB output in dB. the floor is compared with the squared rms-value, so the linear floor is 10^(floor/10) */
+void hsd_rmsf_floor(t_hsd_rmsf *x, t_floatarg f)
+{
+    x->db_floor = hsd_db_floor(f, 10);
+}
+
+
+/* function for setting the length of the rectangular window in ms. 0 switches back to the exponential averager */
+void hsd_rmsf_window(t_hsd_rmsf *x, t_floatarg f)
+{
+    if (f < 0) {
+        f = 0;
+    }
+    if (f > HSD_DELAY_LIMIT_MS) {
+        error("hsd_rmsf~: window too long: %f ms. window set to %d ms", f, HSD_DELAY_LIMIT_MS);
+        f = HSD_DELAY_LIMIT_MS;
+    }
+    x->window_ms = f;
+    hsd_rmsf_window_update(x, 0);
+}
+
+
+/* calculates the window length in samples and lets the ring-buffer grow, if it is too short for it. a shorter window (or a longer one that still fits into the ring-buffer) keeps the samples that are already in the ring-buffer, so its rms-value is correct at once. if the ring-buffer has to grow, or if the object comes from the exponential averager, the ring-buffer holds samples that were never written or are out of date: it is cleared then, and the rms-value fills in from silence over one window length. "reset" throws the content away too (sample rate change). returns 0 if the memory could not be allocated, the object falls back to the exponential averager then */
+int hsd_rmsf_window_update(t_hsd_rmsf *x, int reset)
+{
+    int ok;
+    t_int old_length = x->line.length;
+    int was_window = (x->window > 0);
+    
+    if (x->window_ms == 0) {
+        x->window = 0;
+        return 1;
+    }
+    
+    if (reset) {
+        ok = hsd_delayline_reset(&x->line, hsd_delayline_samples(x->sr, x->window_ms));
+    }
+    else {
+        ok = hsd_delayline_grow(&x->line, hsd_delayline_samples(x->sr, x->window_ms));
+    }
+    if (!ok) {
+        error("hsd_rmsf~: cannot allocate memory for a window of %f ms", x->window_ms);
+        x->window = 0;
+        return 0;
+    }
+    
+    // the exponential averager doesn´t write to the ring-buffer, and the new part of a grown ring-buffer was never written: start from silence
+    if (!reset && (!was_window || x->line.length != old_length)) {
+        hsd_delayline_clear(&x->line);
+    }
+    
+    x->window = (t_int)(x->sr * x->window_ms * 0.001 + 0.5);
+    if (x->window < 1) {
+        x->window = 1;
+    }
+    
+    // the running sum is calculated again once per second, or once per window for windows that are longer
+    x->resum_interval = x->sr;
+    if (x->resum_interval < x->window) {
+        x->resum_interval = x->window;
+    }
+    
+    hsd_rmsf_resum(x);
+    return 1;
+}
+
+
+/* calculates the sum of the squared samples in the window again from the ring-buffer. called when the window changes and every resum_interval samples by the perform routine, so the rounding errors of the running sum can´t grow */
+void hsd_rmsf_resum(t_hsd_rmsf *x)
+{
+    t_float *line = x->line.buffer;
+    t_int mask = x->line.mask;
+    t_int write_index = x->line.write_index;
+    double sum = 0;
+    t_int k;
+    
+    for (k=1; k<=x->window; k++) {
+        sum += line[(write_index - k) & mask];
+    }
+    
+    x->sum = sum;
+    x->resum_count = 0;
+}
+
+
+/* the control-rate output: converts the squared rms-value at the end of the block to the rms-value (or dB, straight from the squared value), writes it to the whole output vector (a decimated signal) and sends it every "interval" blocks. the clock calls hsd_rmsf_tick() right after this DSP tick */
+void hsd_rmsf_control(t_hsd_rmsf *x, t_float ms, t_float *out, t_int n)
+{
+    t_float rms;
+    
+    if (x->db) {
+        rms = ms;
+        hsd_db_block(&rms, 1, 10, x->db_floor);
+    }
+    else {
+        rms = sqrt(ms);
+    }
+    while (n--) {
+        *out++ = rms;
+    }
+    
+    if (++x->block_count >= x->interval) {
+        x->block_count = 0;
+        x->control_value = rms;
+        clock_delay(x->clock, 0);
+    }
+}
+
+
+/* the clock function sends the control-rate output after the DSP tick. outlets must not be used in the perform routine */
+void hsd_rmsf_tick(t_hsd_rmsf *x)
+{
+    outlet_float(x->float_out, x->control_value);
+}
+
+
 /* the dsp-init-routine */
 void hsd_rmsf_dsp(t_hsd_rmsf *x, t_signal **sp, short *count)
 {
     /* check for sample-rate changes */
     if(x->sr != sp[0]->s_sr){
         x->sr = sp[0]->s_sr;
+        
+        /* the time coefficient depends on the sample rate. it is used at once, without ramping */
+        hsd_rmsf_coefficient(x);
+        x->TAV = x->TAV_target;
+        
+        /* the window length in samples too. the squared samples in the ring-buffer don´t fit to the new sample rate anymore, so it is reset */
+        hsd_rmsf_window_update(x, 1);
     }
     
     /* add the objects signal processing to the signal-chain of puredata */
@@ -143,13 +419,107 @@ t_int *hsd_rmsf_perform(t_int *w)
     t_float xrms2_z1 = x->xrms2_z1;
     
     t_float x_in;
+    t_float ms;
     
-    /*calulate the time-constant */
-    t_float TAV = 1 - pow(EULER, -2.2/(x->sr * x->t_rms * 0.001));
+    /* the time-constant of the last block. if the time has changed, it is ramped to the new value within this block (the increment is zero otherwise) */
+    t_float TAV = x->TAV;
+    t_float TAV_inc = (x->TAV_target - TAV) / n;
+    x->TAV = x->TAV_target;
+    
+    /* rectangular window: the running sum of the squared samples. the mean of the squared samples is written to the output vector, which is then converted to the rms-value (or dB) in one loop */
+    if (x->window) {
+        
+        t_float *line = x->line.buffer;
+        t_int mask = x->line.mask;
+        t_int write_index = x->line.write_index;
+        t_int window = x->window;
+        t_float scale = 1.0 / window;
+        double sum = x->sum;
+        t_float square;
+        
+        /* DSP Loop */
+        while (n--) {
+            x_in = *in++;
+            square = x_in * x_in;
+            
+            // add the newest squared sample, subtract the one that falls out of the window. both in double precision, the difference of the two floats would lose a quiet sample next to a loud one
+            sum += square;
+            sum -= line[(write_index - window) & mask];
+            line[write_index] = square;
+            write_index = (write_index + 1) & mask;
+            
+            // the rounding errors of the running sum must not give a negative value
+            ms = sum * scale;
+            *out++ = (ms > 0) ? ms : 0;
+        }
+        
+        x->line.write_index = write_index;
+        x->sum = sum;
+        
+        // calculate the running sum again from time to time
+        x->resum_count += w[4];
+        if (x->resum_count >= x->resum_interval) {
+            hsd_rmsf_resum(x);
+        }
+        
+        out = (t_float *) (w[3]);
+        n = w[4];
+        if (x->interval) {
+            hsd_rmsf_control(x, out[n-1], out, n);
+        }
+        else if (x->db) {
+            hsd_db_block(out, n, 10, x->db_floor);
+        }
+        else {
+            while (n--) {
+                *out = sqrt(*out);
+                out++;
+            }
+        }
+        
+        return w+5;
+    }
+    
+    /* control-rate output: the squared rms-value is calculated for every sample, but the root only once for the whole block */
+    if (x->interval) {
+        
+        /* DSP Loop */
+        while (n--) {
+            TAV += TAV_inc;
+            x_in = *in++;
+            xrms2_z1 = (1-TAV) * xrms2_z1 + TAV * x_in * x_in;
+        }
+        
+        // the decimated signal: the rms-value at the end of the block for the whole block
+        hsd_rmsf_control(x, xrms2_z1, out, w[4]);
+        
+        x->xrms2_z1 = xrms2_z1;
+        return w+5;
+    }
+    
+    /* dB output: the squared rms-values are written to the output vector, which is then converted in one loop. no root is needed */
+    if (x->db) {
+        
+        /* DSP Loop */
+        while (n--) {
+            TAV += TAV_inc;
+            x_in = *in++;
+            xrms2_z1 = (1-TAV) * xrms2_z1 + TAV * x_in * x_in;
+            *out++ = xrms2_z1;
+        }
+        
+        hsd_db_block((t_float *) (w[3]), w[4], 10, x->db_floor);
+        
+        x->xrms2_z1 = xrms2_z1;
+        return w+5;
+    }
     
     /* DSP Loop */
     while (n--) {
         
+        // ramp the time-constant
+        TAV += TAV_inc;
+        
         // get input sample
         x_in = *in++;
         
@@ -0,0 +1,733 @@
+/* hsd_sweep~ external from the HSD-Library, University of Applied Science Duesseldorf
+ Created 18.10.2026
+
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This is a measurement tool for impulse responses, with the exponential sine sweep method by Angelo Farina. A single impulse (hsd_impulse~) has very little energy, so the measured impulse response is buried in noise. A sine sweep puts much more energy into the system, because every frequency is played for a while at full level. The impulse response is then calculated from the recorded answer of the system (deconvolution).
+
+
+ The sweep: the frequency of the sine rises exponentially from f1 to f2 within the duration T, so every octave gets the same time:
+
+    s(n) = sin( w1 * L * (e^(n/L) - 1) )        with  L = T / ln(f2/f1)     (T and L in samples, w1 = 2*PI*f1/sr)
+
+ The first and the last milliseconds are faded in and out, so the sweep starts and ends without a click.
+
+ The sweep is not calculated in advance and not stored: a 60 s sweep at 96 kHz would take about 200 ms to calculate in the bang (an exp() and a sin() per sample) and 23 MB of memory. The perform routine calculates the samples of every block while it plays them. The phase gets very large at the end of the sweep, so it is calculated in double precision, and only once per block with the formula above. Within the block it is continued with a recursion, because the phase increment (the instantaneous frequency) grows by the same factor from sample to sample:
+
+    phase(n+1) = phase(n) + inc(n)        inc(n+1) = inc(n) * e^(1/L)
+
+
+ The deconvolution: the recorded signal is convolved with the inverse filter of the sweep. The inverse filter is the sweep played backwards, so the high frequencies come first and the low frequencies last: convolved with the sweep, all frequencies arrive at the same time, the sweep is "compressed" into an impulse. But an exponential sweep stays longer at the low frequencies (it has a pink spectrum), so the inverse filter is faded down by 6 dB per octave towards the low frequencies:
+
+    f(m) = s(T-1-m) * e^(-m/L) * 2*w2 / (PI*L)
+
+ The factor at the end makes the product of the spectra of the sweep and the inverse filter 1, so a system that just passes the signal gets an impulse of the height 1 (within the frequency range of the sweep). The samples of the sweep for the inverse filter are calculated again in the same way, one partition after the other (see below). The linear impulse response starts at sample T-1 of the convolution, the harmonic distortion of the system shows up before it and is not written to the array.
+
+
+ FFT-based block processing: the sweep can be long (a 10 s sweep at 96 kHz has almost a million samples), a convolution sample by sample would take hours. But only N samples of the convolution are needed (the length of the array). The convolution is split into blocks of P samples (uniformly partitioned convolution, P = HSD_SWEEP_PARTITION): the inverse filter is split into partitions of P samples, the wanted output samples into segments of P samples, and the recording into frames of 2*P samples that overlap by P samples. Every partition of the filter (with P zeros) and every frame of the recording are transformed with the real FFT of Pd (mayer_realfft()), once. Then every segment of the output is a sum of products of spectra:
+
+    Y(b) = sum over j of  F(j) * X(b-j)          (segment b, filter partition j, frame k = b-j)
+
+ and one inverse FFT per segment gives its P samples (overlap-save: the last P samples of the circular convolution are the same as the linear convolution). The loop over the frequencies has no dependencies and is vectorized by the compiler.
+
+ The deconvolution is not calculated at once, but in small steps in the clock function, after the recording has ended: the samples and the FFT of one partition of the filter, the FFT of one frame, the product of one frame with the partition of one segment, or the inverse FFT of one segment. Every step has a fixed size that doesn´t depend on the length of the sweep or the array, and the work of one clock call is limited to HSD_SWEEP_WORK (about two FFTs of 4096 samples, well below 0.5 ms), then the clock is set for the next scheduler tick. So the DSP keeps running in between without dropouts, and a 10 s sweep at 96 kHz with an impulse response of 1 s is still done about one second after the recording.
+
+
+ Inlet: (signal) the answer of the measured system, and the messages.
+ Outlets: (signal) the sweep, and a bang when the impulse response has been written to the array.
+ Arguments: the name of the array, the duration in seconds (default 5), the start and the end frequency (default 20 and 20000 Hz).
+
+
+ Messages:
+
+    -> "bang": plays the sweep and records the input. after the sweep, the input is recorded for the length of the array, then the impulse response is calculated and written to the array.
+    -> "stop": stops the measurement.
+    -> "array <name>": the array for the impulse response. its length is the length of the impulse response.
+    -> "duration <seconds>", "frequencies <f1> <f2>": the sweep.
+    -> "latency <samples>": the latency of the measured system that isn´t part of the impulse response (e.g. the soundcard), it is cut off at the start.
+
+ */
+
+#include "m_pd.h"
+#include <math.h>
+#include <string.h>
+#include "hsd_library.h"
+
+/* the longest sweep in seconds */
+#define HSD_SWEEP_MAX_SECONDS 60
+
+/* the longest impulse response in samples */
+#define HSD_SWEEP_MAX_IR 1048576
+
+/* the length of the fades at the start and the end of the sweep in ms */
+#define HSD_SWEEP_FADE_MS 5
+
+/* the length of the partitions of the deconvolution in samples, the FFTs have twice this length */
+#define HSD_SWEEP_PARTITION 2048
+
+/* the work of the deconvolution per clock call, and the work of one step. the work is counted in samples: an FFT of 2*P samples costs about 2*P*log2(2*P)/2 operations, the product of two spectra P operations, P samples of the sweep (a sin() each) about as much as an FFT */
+#define HSD_SWEEP_WORK 49152
+#define HSD_SWEEP_FFT_WORK (HSD_SWEEP_PARTITION * 12)
+#define HSD_SWEEP_MAC_WORK HSD_SWEEP_PARTITION
+#define HSD_SWEEP_SINE_WORK (HSD_SWEEP_PARTITION * 12)
+
+/* default values */
+#define DEFAULT_DURATION 5
+#define DEFAULT_F1 20
+#define DEFAULT_F2 20000
+
+#define PI 3.14159265358979
+
+/* the states of the measurement */
+#define HSD_SWEEP_IDLE 0
+#define HSD_SWEEP_RUNNING 1
+#define HSD_SWEEP_DECONVOLVING 2
+
+/* the stages of the deconvolution */
+#define HSD_SWEEP_FILTER 0
+#define HSD_SWEEP_FRAMES 1
+#define HSD_SWEEP_INVERSE 2
+
+/* data struct */
+typedef struct _hsd_sweep{
+
+    /* the object data itself */
+    t_object obj;
+
+    /* sample rate */
+    t_float sr;
+
+    /* the name of the array, the duration of the sweep in seconds, its frequency range and the latency in samples */
+    t_symbol *array_name;
+    t_float duration;
+    t_float f1;
+    t_float f2;
+    t_int latency;
+
+    /* the end frequency of the running measurement (f2, but not above the nyquist frequency) */
+    t_float f2_used;
+
+    /* the state of the measurement, and the position of the playback and recording in samples */
+    int state;
+    t_int position;
+
+    /* the length of the sweep, the recording (record_length samples) and the length of the impulse response */
+    t_int sweep_length;
+    t_float *record;
+    t_int record_length;
+    t_int ir_length;
+
+    /* the sweep: the factor L in samples, w1*L, the growth of the phase increment from sample to sample (e^(1/L)), and the length of the fades in samples */
+    double L;
+    double w1L;
+    double growth;
+    t_int fade;
+
+    /* the deconvolution: the number of partitions of the inverse filter and of segments of the output, the spectra of the partitions and the sums of the segments (2*P samples each), and the buffer for the frames of the recording. every spectrum of the filter is a buffer of its own, so it can be freed as soon as the last frame has used it */
+    t_int partitions;
+    t_int segments;
+    t_float **filter_spectra;
+    t_float *sum;
+    t_float *frame;
+
+    /* the step of the deconvolution: the stage, the partition, frame or segment, and the next segment of the current frame (-1: the FFT of the frame is not done yet) */
+    int stage;
+    t_int index;
+    t_int segment;
+
+    /* the clock for the deconvolution after the DSP tick, and the bang outlet */
+    t_clock *clock;
+    t_outlet *done_out;
+
+    /* dummy float for CLASS_MAINSIGNALIN */
+    t_float x_f;
+
+}t_hsd_sweep;
+
+static t_class *hsd_sweep_class;
+
+
+/* function prototypes */
+void *hsd_sweep_new(t_symbol *s, short argc, t_atom *argv);
+void hsd_sweep_free(t_hsd_sweep *x);
+void hsd_sweep_dsp(t_hsd_sweep *x, t_signal **sp);
+t_int *hsd_sweep_perform(t_int *w);
+void hsd_sweep_tick(t_hsd_sweep *x);
+void hsd_sweep_bang(t_hsd_sweep *x);
+void hsd_sweep_stop(t_hsd_sweep *x);
+void hsd_sweep_array(t_hsd_sweep *x, t_symbol *s);
+void hsd_sweep_duration(t_hsd_sweep *x, t_floatarg f);
+void hsd_sweep_frequencies(t_hsd_sweep *x, t_floatarg f1, t_floatarg f2);
+void hsd_sweep_latency(t_hsd_sweep *x, t_floatarg f);
+void hsd_sweep_release(t_hsd_sweep *x);
+void hsd_sweep_generate(t_hsd_sweep *x, t_int n, t_float *out, t_int count);
+t_garray *hsd_sweep_getarray(t_hsd_sweep *x, int *size, t_word **vec);
+t_int hsd_sweep_step(t_hsd_sweep *x);
+void hsd_sweep_write(t_hsd_sweep *x, t_int onset, t_float *samples, t_int n);
+void hsd_sweep_finish(t_hsd_sweep *x);
+
+
+/* finds the array. returns NULL (with an error message) if there is no array of that name */
+t_garray *hsd_sweep_getarray(t_hsd_sweep *x, int *size, t_word **vec){
+
+    t_garray *array;
+
+    if (x->array_name == &s_) {
+        error("hsd_sweep~: no array set");
+        return NULL;
+    }
+    array = (t_garray *)pd_findbyclass(x->array_name, garray_class);
+    if (array == NULL) {
+        error("hsd_sweep~: %s: no such array", x->array_name->s_name);
+        return NULL;
+    }
+    if (!garray_getfloatwords(array, size, vec)) {
+        error("hsd_sweep~: %s: bad template", x->array_name->s_name);
+        return NULL;
+    }
+    return array;
+}
+
+/* frees all buffers of a measurement */
+void hsd_sweep_release(t_hsd_sweep *x){
+
+    t_int N = 2 * HSD_SWEEP_PARTITION;
+    t_int j;
+
+    if (x->record) {
+        freebytes(x->record, x->record_length * sizeof(t_float));
+    }
+    if (x->filter_spectra) {
+        for (j=0; j<x->partitions; j++) {
+            if (x->filter_spectra[j]) {
+                freebytes(x->filter_spectra[j], N * sizeof(t_float));
+            }
+        }
+        freebytes(x->filter_spectra, x->partitions * sizeof(t_float *));
+    }
+    if (x->sum) {
+        freebytes(x->sum, x->segments * N * sizeof(t_float));
+    }
+    if (x->frame) {
+        freebytes(x->frame, N * sizeof(t_float));
+    }
+    x->record = NULL;
+    x->filter_spectra = NULL;
+    x->sum = NULL;
+    x->frame = NULL;
+    x->sweep_length = 0;
+    x->record_length = 0;
+    x->partitions = 0;
+    x->segments = 0;
+}
+
+/* function for starting a measurement, executed when a bang is received. only the buffer for the recording is allocated here, the sweep is calculated by the perform-routine, and the buffers of the deconvolution are allocated when it starts */
+void hsd_sweep_bang(t_hsd_sweep *x){
+
+    t_word *vec;
+    int size;
+    double f2 = x->f2;
+
+    // the array has to be there, its length is the length of the impulse response
+    if (hsd_sweep_getarray(x, &size, &vec) == NULL) {
+        return;
+    }
+    if (size < 1 || size > HSD_SWEEP_MAX_IR) {
+        error("hsd_sweep~: %s: the array must have 1 to %d samples", x->array_name->s_name, HSD_SWEEP_MAX_IR);
+        return;
+    }
+
+    // a running measurement is thrown away
+    x->state = HSD_SWEEP_IDLE;
+    clock_unset(x->clock);
+    hsd_sweep_release(x);
+
+    // the sweep ends below the nyquist frequency
+    if (f2 > 0.5 * x->sr) {
+        f2 = 0.5 * x->sr;
+    }
+    if (f2 <= x->f1) {
+        error("hsd_sweep~: the end frequency must be higher than the start frequency");
+        return;
+    }
+
+    /* allocate the buffer for the recording of the sweep, the latency and the impulse response */
+    x->ir_length = size;
+    x->sweep_length = x->duration * x->sr;
+    if (x->sweep_length < 2) {
+        x->sweep_length = 2;
+    }
+    x->record_length = x->sweep_length + x->latency + x->ir_length;
+    x->record = (t_float*)getbytes(x->record_length * sizeof(t_float));
+    if (!x->record) {
+        error("hsd_sweep~: cannot allocate memory for the measurement");
+        hsd_sweep_release(x);
+        return;
+    }
+
+    /* the parameters of the sweep */
+    x->L = x->sweep_length / log(f2 / x->f1);
+    x->w1L = 2 * PI * x->f1 / x->sr * x->L;
+    x->growth = exp(1 / x->L);
+    x->fade = HSD_SWEEP_FADE_MS * 0.001 * x->sr;
+    if (x->fade > x->sweep_length / 2) {
+        x->fade = x->sweep_length / 2;
+    }
+
+    // the factor of the inverse filter needs the end frequency of this measurement
+    x->f2_used = f2;
+
+    x->position = 0;
+    x->state = HSD_SWEEP_RUNNING;
+}
+
+/* function for stopping a measurement */
+void hsd_sweep_stop(t_hsd_sweep *x){
+
+    x->state = HSD_SWEEP_IDLE;
+    clock_unset(x->clock);
+    hsd_sweep_release(x);
+}
+
+/* functions for setting the parameters. they are used with the next bang */
+void hsd_sweep_array(t_hsd_sweep *x, t_symbol *s){
+
+    x->array_name = s;
+}
+
+void hsd_sweep_duration(t_hsd_sweep *x, t_floatarg f){
+
+    if (f <= 0 || f > HSD_SWEEP_MAX_SECONDS) {
+        error("hsd_sweep~: illegal duration: %f. duration set to %d seconds", f, DEFAULT_DURATION);
+        f = DEFAULT_DURATION;
+    }
+    x->duration = f;
+}
+
+void hsd_sweep_frequencies(t_hsd_sweep *x, t_floatarg f1, t_floatarg f2){
+
+    if (f1 <= 0 || f2 <= f1) {
+        error("hsd_sweep~: illegal frequencies: %f %f. frequencies set to %d %d", f1, f2, DEFAULT_F1, DEFAULT_F2);
+        f1 = DEFAULT_F1;
+        f2 = DEFAULT_F2;
+    }
+    x->f1 = f1;
+    x->f2 = f2;
+}
+
+void hsd_sweep_latency(t_hsd_sweep *x, t_floatarg f){
+
+    if (f < 0) {
+        f = 0;
+    }
+    x->latency = f;
+}
+
+
+/* calculates "count" samples of the sweep, from sample n on (see above): the phase with the formula at sample n, then with the recursion. the fades at the start and the end are raised cosines */
+void hsd_sweep_generate(t_hsd_sweep *x, t_int n, t_float *out, t_int count){
+
+    t_int T = x->sweep_length;
+    t_int fade = x->fade;
+    double growth = x->growth;
+    double e = exp(n / x->L);
+    double phase = x->w1L * (e - 1);
+    double inc = x->w1L * (growth - 1) * e;
+    t_int i, m;
+
+    for (i=0; i<count; i++) {
+        m = n + i;
+        out[i] = sin(phase);
+        if (m < fade) {
+            out[i] *= 0.5 - 0.5 * cos(PI * m / fade);
+        }
+        else if (T - 1 - m < fade) {
+            out[i] *= 0.5 - 0.5 * cos(PI * (T - 1 - m) / fade);
+        }
+        phase += inc;
+        inc *= growth;
+    }
+}
+
+
+/* one step of the deconvolution (see above). returns the work of the step */
+t_int hsd_sweep_step(t_hsd_sweep *x){
+
+    t_int P = HSD_SWEEP_PARTITION;
+    t_int N = 2 * P;
+    t_int T = x->sweep_length;
+    t_float *spectrum, *sum;
+    t_float re, im;
+    t_int i, m, start, last;
+
+    // the first output sample of the convolution: the end of the sweep plus the latency
+    t_int out0 = T - 1 + x->latency;
+
+    if (x->stage == HSD_SWEEP_FILTER) {
+
+        /* the spectrum of partition j of the inverse filter: the sweep backwards, faded down towards the low frequencies, and P zeros. the samples T-1-jP-(count-1) ... T-1-jP of the sweep are calculated into the second half of the buffer first, then copied backwards into the first half */
+        t_int j = x->index;
+        t_int count = T - j * P;
+        double norm = 2 * (2 * PI * x->f2_used / x->sr) / (PI * x->L);
+        double decay = exp(-1 / x->L);
+        double envelope = norm * exp(-(double)(j * P) / x->L);
+        spectrum = x->filter_spectra[j] = (t_float*)getbytes(N * sizeof(t_float));
+        if (!spectrum) {
+            error("hsd_sweep~: cannot allocate memory for the deconvolution");
+            hsd_sweep_stop(x);
+            return 0;
+        }
+        if (count > P) {
+            count = P;
+        }
+        hsd_sweep_generate(x, T - j * P - count, spectrum + P, count);
+        for (i=0; i<P; i++) {
+            spectrum[i] = (i < count) ? spectrum[P + count - 1 - i] * envelope : 0;
+            envelope *= decay;
+        }
+        memset(spectrum + P, 0, P * sizeof(t_float));
+        mayer_realfft(N, spectrum);
+
+        if (++x->index == x->partitions) {
+            x->stage = HSD_SWEEP_FRAMES;
+            x->index = 1 - x->partitions;
+            x->segment = -1;
+        }
+        return HSD_SWEEP_SINE_WORK + HSD_SWEEP_FFT_WORK;
+    }
+
+    if (x->stage == HSD_SWEEP_FRAMES) {
+
+        /* frame k of the recording meets partition j in segment b = k + j */
+        t_int k = x->index;
+
+        if (x->segment < 0) {
+
+            /* the spectrum of the frame: the 2*P samples of the recording before the end of segment k */
+            start = out0 + (k - 1) * P;
+            for (i=0; i<N; i++) {
+                m = start + i;
+                x->frame[i] = (m >= 0 && m < x->record_length) ? x->record[m] : 0;
+            }
+            mayer_realfft(N, x->frame);
+            x->segment = (k > 0) ? k : 0;
+            return HSD_SWEEP_FFT_WORK;
+        }
+
+        /* complex multiplication and sum. the real parts are in buffer[0...N/2], the imaginary parts in buffer[N-1...N/2+1] (see mayer_realfft() in Pd). index 0 and N/2 are real only */
+        spectrum = x->filter_spectra[x->segment - k];
+        sum = x->sum + x->segment * N;
+        sum[0] += x->frame[0] * spectrum[0];
+        sum[P] += x->frame[P] * spectrum[P];
+        for (i=1; i<P; i++) {
+            re = x->frame[i] * spectrum[i] - x->frame[N-i] * spectrum[N-i];
+            im = x->frame[i] * spectrum[N-i] + x->frame[N-i] * spectrum[i];
+            sum[i] += re;
+            sum[N-i] += im;
+        }
+
+        // the last segment of this frame: the last partition of the filter, or the last segment of the output
+        last = k + x->partitions - 1;
+        if (last > x->segments - 1) {
+            last = x->segments - 1;
+        }
+        if (x->segment++ == last) {
+            x->segment = -1;
+
+            // partition j meets the frames k = -j ... segments-1-j: after this frame, partition segments-1-k isn´t needed any more
+            m = x->segments - 1 - k;
+            if (m >= 0 && m < x->partitions) {
+                freebytes(x->filter_spectra[m], N * sizeof(t_float));
+                x->filter_spectra[m] = NULL;
+            }
+
+            if (++x->index == x->segments) {
+                // the recording isn´t needed any more
+                freebytes(x->record, x->record_length * sizeof(t_float));
+                x->record = NULL;
+                x->stage = HSD_SWEEP_INVERSE;
+                x->index = 0;
+            }
+        }
+        return HSD_SWEEP_MAC_WORK;
+    }
+
+    /* the inverse FFT of one segment, its last P samples are written to the array */
+    sum = x->sum + x->index * N;
+    mayer_realifft(N, sum);
+    hsd_sweep_write(x, x->index * P, sum + P, P);
+    x->index++;
+    return HSD_SWEEP_FFT_WORK;
+}
+
+/* writes n samples of the impulse response (from the position "onset") to the array. the array is looked up for every segment, it might have been deleted or resized in the meantime (the error is reported at the end, by hsd_sweep_finish()) */
+void hsd_sweep_write(t_hsd_sweep *x, t_int onset, t_float *samples, t_int n){
+
+    t_float scale = 1.0 / (2 * HSD_SWEEP_PARTITION);
+    t_garray *array;
+    t_word *vec;
+    int size;
+    t_int i;
+
+    array = (t_garray *)pd_findbyclass(x->array_name, garray_class);
+    if (array == NULL || !garray_getfloatwords(array, &size, &vec)) {
+        return;
+    }
+    if (n > x->ir_length - onset) {
+        n = x->ir_length - onset;
+    }
+    if (n > size - onset) {
+        n = size - onset;
+    }
+    for (i=0; i<n; i++) {
+        vec[onset + i].w_float = samples[i] * scale;
+    }
+}
+
+/* the end of the deconvolution: all segments are written to the array, it is redrawn */
+void hsd_sweep_finish(t_hsd_sweep *x){
+
+    t_garray *array;
+    t_word *vec;
+    int size;
+
+    array = hsd_sweep_getarray(x, &size, &vec);
+    if (array != NULL) {
+        garray_redraw(array);
+    }
+
+    x->state = HSD_SWEEP_IDLE;
+    hsd_sweep_release(x);
+
+    if (array != NULL) {
+        outlet_bang(x->done_out);
+    }
+}
+
+/* the clock function: after the recording, the deconvolution is calculated in steps, until the work of one clock call is done. the clock is set again for the next scheduler tick until all steps are done */
+void hsd_sweep_tick(t_hsd_sweep *x){
+
+    t_int work = 0;
+    t_int N = 2 * HSD_SWEEP_PARTITION;
+
+    if (x->state != HSD_SWEEP_DECONVOLVING) {
+        return;
+    }
+
+    /* the first call: allocate the buffers of the deconvolution, they aren´t needed during the recording. the spectra of the filter are allocated one after the other by the steps */
+    if (x->filter_spectra == NULL && x->stage == HSD_SWEEP_FILTER) {
+        x->partitions = (x->sweep_length + HSD_SWEEP_PARTITION - 1) / HSD_SWEEP_PARTITION;
+        x->segments = (x->ir_length + HSD_SWEEP_PARTITION - 1) / HSD_SWEEP_PARTITION;
+        x->filter_spectra = (t_float**)getbytes(x->partitions * sizeof(t_float *));
+        x->sum = (t_float*)getbytes(x->segments * N * sizeof(t_float));
+        x->frame = (t_float*)getbytes(N * sizeof(t_float));
+        if (!x->filter_spectra || !x->sum || !x->frame) {
+            error("hsd_sweep~: cannot allocate memory for the deconvolution");
+            hsd_sweep_stop(x);
+            return;
+        }
+    }
+
+    while (work < HSD_SWEEP_WORK && !(x->stage == HSD_SWEEP_INVERSE && x->index == x->segments)) {
+        work += hsd_sweep_step(x);
+
+        // a step could not allocate its memory, the measurement has been stopped
+        if (x->state != HSD_SWEEP_DECONVOLVING) {
+            return;
+        }
+    }
+
+    if (x->stage == HSD_SWEEP_INVERSE && x->index == x->segments) {
+        hsd_sweep_finish(x);
+    }else{
+        clock_delay(x->clock, sys_getblksize() * 1000.0 / sys_getsr());
+    }
+}
+
+
+/* the dsp-init-routine */
+void hsd_sweep_dsp(t_hsd_sweep *x, t_signal **sp)
+{
+    // a measurement doesn´t survive a change of the sample rate
+    if (x->sr != sp[0]->s_sr) {
+        if (x->state != HSD_SWEEP_IDLE) {
+            error("hsd_sweep~: sample rate changed, measurement stopped");
+            hsd_sweep_stop(x);
+        }
+        x->sr = sp[0]->s_sr;
+    }
+
+    /* add the objects signal processing to the signal-chain of puredata */
+    dsp_add(hsd_sweep_perform,
+            4,
+            x,
+            sp[0]->s_vec,
+            sp[1]->s_vec,
+            sp[0]->s_n);
+}
+
+
+/* the perform routine. the sweep is calculated for every block while it is played */
+t_int *hsd_sweep_perform(t_int *w)
+{
+    t_hsd_sweep *x = (t_hsd_sweep *) (w[1]);            //object data
+    t_float *in = (t_float *) (w[2]);                   //input-vector
+    t_float *out = (t_float *) (w[3]);                  //output-vector
+    t_int n = w[4];                                     //buffer-size
+
+    t_int position = x->position;
+    t_int length, playing;
+
+    if (x->state != HSD_SWEEP_RUNNING) {
+        memset(out, 0, n * sizeof(t_float));
+        return w+5;
+    }
+
+    /* record the input first, the output vector may be the same as the input vector */
+    length = x->record_length - position;
+    if (length > n) {
+        length = n;
+    }
+    memcpy(x->record + position, in, length * sizeof(t_float));
+
+    /* play the sweep, and zeros after it */
+    playing = x->sweep_length - position;
+    if (playing > n) {
+        playing = n;
+    }
+    if (playing < 0) {
+        playing = 0;
+    }
+    hsd_sweep_generate(x, position, out, playing);
+    memset(out + playing, 0, (n - playing) * sizeof(t_float));
+
+    x->position = position + length;
+
+    // the recording is complete: the deconvolution is started right after this DSP tick
+    if (x->position >= x->record_length) {
+        x->state = HSD_SWEEP_DECONVOLVING;
+        x->stage = HSD_SWEEP_FILTER;
+        x->index = 0;
+        clock_delay(x->clock, 0);
+    }
+
+    return w+5;
+}
+
+
+/* free function, the buffers and the clock have to be freed */
+void hsd_sweep_free(t_hsd_sweep *x)
+{
+    hsd_sweep_release(x);
+    clock_free(x->clock);
+}
+
+
+/* new-instance routine */
+void *hsd_sweep_new(t_symbol *s, short argc, t_atom *argv)
+{
+    t_hsd_sweep *x = (t_hsd_sweep *)pd_new(hsd_sweep_class);
+
+    // creating the signal-outlet and the bang outlet
+    outlet_new(&x->obj, &s_signal);
+    x->done_out = outlet_new(&x->obj, &s_bang);
+    x->clock = clock_new(x, (t_method)hsd_sweep_tick);
+
+    // getting sample rate
+    x->sr = sys_getsr();
+
+    x->state = HSD_SWEEP_IDLE;
+    x->position = 0;
+    x->latency = 0;
+    x->record = NULL;
+    x->filter_spectra = NULL;
+    x->sum = NULL;
+    x->frame = NULL;
+    x->sweep_length = 0;
+    x->record_length = 0;
+    x->partitions = 0;
+    x->segments = 0;
+    x->stage = HSD_SWEEP_FILTER;
+    x->index = 0;
+    x->segment = -1;
+
+    /* getting creation arguments: the name of the array, the duration and the frequencies */
+    x->array_name = atom_getsymbolarg(0, argc, argv);
+    hsd_sweep_duration(x, (argc > 1) ? atom_getfloatarg(1, argc, argv) : DEFAULT_DURATION);
+    hsd_sweep_frequencies(x, (argc > 2) ? atom_getfloatarg(2, argc, argv) : DEFAULT_F1, (argc > 3) ? atom_getfloatarg(3, argc, argv) : DEFAULT_F2);
+
+    return x;
+}
+
+/* setup routine */
+void hsd_sweep_tilde_setup(void){
+
+    hsd_sweep_class = class_new(gensym("hsd_sweep~"),
+                                (t_newmethod)hsd_sweep_new,
+                                (t_method)hsd_sweep_free,
+                                sizeof(t_hsd_sweep),
+                                0,
+                                A_GIMME,
+                                0);
+
+    CLASS_MAINSIGNALIN(hsd_sweep_class, t_hsd_sweep, x_f);
+
+
+    class_addmethod(hsd_sweep_class,
+                    (t_method)hsd_sweep_dsp,
+                    gensym("dsp"),
+                    0);
+
+    class_addmethod(hsd_sweep_class,
+                    (t_method)hsd_sweep_stop,
+                    gensym("stop"),
+                    0);
+
+    class_addmethod(hsd_sweep_class,
+                    (t_method)hsd_sweep_array,
+                    gensym("array"),
+                    A_SYMBOL,
+                    0);
+
+    class_addmethod(hsd_sweep_class,
+                    (t_method)hsd_sweep_duration,
+                    gensym("duration"),
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_sweep_class,
+                    (t_method)hsd_sweep_frequencies,
+                    gensym("frequencies"),
+                    A_FLOAT,
+                    A_FLOAT,
+                    0);
+
+    class_addmethod(hsd_sweep_class,
+                    (t_method)hsd_sweep_latency,
+                    gensym("latency"),
+                    A_FLOAT,
+                    0);
+
+    class_addbang(hsd_sweep_class, hsd_sweep_bang);
+
+
+    post ("hsd_sweep~ from the hsd_library, HS Duesseldorf ");
+
+}
@@ -58,13 +58,23 @@
             D = between 0 and "depth", sinusoidal modulated
  
  
+ External modulation
+ 
+ With the creation argument "external" (after the numbers), the object gets another signal inlet on the right, and the internal LFO is switched off. The signal at this inlet (0...1) replaces the output of the LFO: 0 is the shortest delay, 1 is the delay "depth". Like this, the vibrato can be driven by any modulation (a tempo-synced phasor~, random or envelope signals), and many vibratos with the same modulation can share one oscillator instead of calculating the same sine wave each. The modulation signal is clipped to 0...1, so it can´t read outside the delay-line. The frequency inlet has no effect in this mode.
+ 
+ 
+ Shared LFO
+ 
+ With the message "lfo <name> <offset>", the vibrato doesn´t calculate its own LFO anymore, but uses the LFO group <name> together with other hsd_vibrato~ and hsd_chorus~ objects. The group calculates its sine wave only once per DSP tick for all members, and every member reads it with its own phase offset (in cycles, 0...1). The frequency inlet then sets the frequency of the whole group. "lfo" without a name switches back to the own LFO. (see hsd_library.h)
+ 
  */
 
 #include "m_pd.h"
 #include "math.h"
+#include "hsd_library.h"
 
 /* defaults */
-#define DELMAX 20
+#define DELMAX 20  //default maximum depth in ms
 
 #define PI 3.1415926536
 
@@ -77,20 +87,14 @@ typedef struct _hsd_vibrato{
     /* sample rate */
     t_float sr;
     
-    /* the length of the complete delay-line in samples. the maximum delay time is defined by DELMAX 100 milliseconds, therefore the delayline is always allocated with enough samples to store 100ms of audio. this value is always in dependance of the samplerate and has to be recalculated when the sample rate changes */
-    t_float delay_line_length;
-    
-    /* the length of the delay-line in bytes. it is proportional to delay_line_length, which is just mulitplied by the byte-size of a float variable. it is important to store the bytes, because when the object is destroyed at the end of runtime, the allocated memory has to be freed again */
-    t_int delay_bytes;
+    /* the delay-line: the pointer to the ring-buffer, its length in samples (always a power of two) and in bytes, and the current position of the write-pointer. the write-pointer is incremented with every sample-tick in the dsp-loop. it indicates the position, where the input is written to the delay-line. (see hsd_library.h) */
+    t_hsd_delayline delay_line;
     
-    /* the pointer to the delay-line itself. when the memory of the delay-line is allocated, a pointer to this memory (to the first entry) is returned and stored in this variable. */
-    t_float *delay_line;
+    /* the maximum depth in ms, set by the fourth creation argument. the delay-line is only allocated as long as the current depth needs it, but it may grow up to this length */
+    t_float max_depth_ms;
     
-    /* the current position of the write-pointer. it is incremented with every sample-tick in the dsp-loop. it indicates the position, where the input is written to the delay-line. */
-    t_int write_index;
-    
-    /* the current position of the read-pointer. it "follows" the write pointer skimming thorugh the delay-line with a displacement of delay_length. this displacement is achieved by subtracting the delay_length from the write-pointer */
-    t_int read_index;
+    /* the interpolation mode (HSD_INTERP_LINEAR ...), see hsd_library.h */
+    int interpolation;
     
     /* dummy float for CLASS_MAINSIGNALIN */
     t_float x_f;
@@ -114,6 +118,14 @@ typedef struct _hsd_vibrato{
     /* determines the amount of the DDL-Output that is sent back to its input. Range between -0.99 and 0.99 */
     t_float feedback;
     
+    /* 1 if the modulation comes from the additional signal inlet instead of the LFO (creation argument "external") */
+    int external;
+    
+    /* the shared LFO group (NULL, if the own LFO is used), the cosine and sine of the phase offset in the group, and the block size of the last dsp-init-routine */
+    t_hsd_lfo *lfo;
+    t_float lfo_cos, lfo_sin;
+    t_int blocksize;
+    
     
 }t_hsd_vibrato;
 
@@ -121,13 +133,16 @@ static t_class *hsd_vibrato_class;
 
 
 /* function prototypes */
-void *hsd_vibrato_new(t_floatarg f1, t_floatarg f2, t_floatarg f3);
+void *hsd_vibrato_new(t_symbol *s, short argc, t_atom *argv);
 void hsd_vibrato_dsp(t_hsd_vibrato *x, t_signal **sp);
 t_int *hsd_vibrato_perform(t_int *w);
 void hsd_vibrato_free(t_hsd_vibrato *x);
+void hsd_vibrato_stats(t_hsd_vibrato *x);
 void hsd_vibrato_depth(t_hsd_vibrato *x, t_floatarg f);
 void hsd_vibrato_frequency(t_hsd_vibrato *x, t_floatarg f);
 void hsd_vibrato_feedback(t_hsd_vibrato *x, t_floatarg f);
+void hsd_vibrato_interpolation(t_hsd_vibrato *x, t_symbol *s);
+void hsd_vibrato_lfo(t_hsd_vibrato *x, t_symbol *s, t_floatarg offset);
 
 
 /* function for setting the modulation depth, called by the third inlet, performs sanity checking */
@@ -136,13 +151,19 @@ void hsd_vibrato_depth(t_hsd_vibrato *x, t_floatarg f){
     t_float depth_ms = f;
     
     // sanity checking
-    if(depth_ms > DELMAX){
-        depth_ms=DELMAX;
+    if(depth_ms > x->max_depth_ms){
+        depth_ms=x->max_depth_ms;
         
     }
     if (depth_ms < 0) {
         depth_ms = 0;
     }
+    
+    // let the delay-line grow, if it is too short for the new depth
+    if(!hsd_delayline_grow(&x->delay_line, hsd_delayline_samples(x->sr, depth_ms))){
+        error("hsd_vibrato~: cannot allocate memory for a depth of %f ms", depth_ms);
+        return;
+    }
     x->depth_ms = depth_ms;
     x->depth = x->sr * x->depth_ms/1000;
     
@@ -159,6 +180,11 @@ void hsd_vibrato_frequency(t_hsd_vibrato *x, t_floatarg f){
     }else{
         x->cycle_length = x->sr/frequency;
         x->frequency = frequency;
+        
+        // in an LFO group, the frequency applies to all members
+        if (x->lfo) {
+            x->lfo->frequency = frequency;
+        }
     }
     
 }
@@ -184,46 +210,97 @@ void hsd_vibrato_feedback(t_hsd_vibrato *x, t_floatarg f){
 }
 
 
+/* function for selecting the interpolation mode, executed when an "interpolation" message is received */
+void hsd_vibrato_interpolation(t_hsd_vibrato *x, t_symbol *s){
+    
+    int interpolation = hsd_interp_mode(s);
+    
+    // sanity checking
+    if(interpolation < 0){
+        error("hsd_vibrato~: unknown interpolation mode: %s. use linear, lagrange, hermite or allpass", s->s_name);
+        return;
+    }
+    x->interpolation = interpolation;
+    x->z_alp = 0;
+    
+}
+
+/* function for joining the shared LFO group "s" with a phase offset in cycles, executed when an "lfo" message is received. without a name, the vibrato leaves its group and uses its own LFO again */
+void hsd_vibrato_lfo(t_hsd_vibrato *x, t_symbol *s, t_floatarg offset){
+    
+    if (x->lfo) {
+        hsd_lfo_leave(x->lfo);
+        x->lfo = NULL;
+    }
+    if (s == &s_) {
+        return;
+    }
+    
+    x->lfo = hsd_lfo_join(s, x->frequency, x->blocksize);
+    if (x->lfo == NULL) {
+        error("hsd_vibrato~: cannot join the LFO group %s", s->s_name);
+        return;
+    }
+    x->lfo_cos = cos(2*PI*offset);
+    x->lfo_sin = sin(2*PI*offset);
+    
+}
+
+/* prints how much memory the delay-lines of the whole library take, executed when a "stats" message is received */
+void hsd_vibrato_stats(t_hsd_vibrato *x){
+    
+    hsd_arena_stats("hsd_vibrato~");
+    
+}
+
 /* the dsp-init-routine */
 void hsd_vibrato_dsp(t_hsd_vibrato *x, t_signal **sp)
 {
     /* check if samplerate has changed */
     if(x->sr != sp[0]->s_sr){
         
-        
-        t_int i;
-        /* store the size of the delay-line. if the length of the delay-line needs to be changed, you need the new size and the old size */
-        t_int oldbytes = x->delay_bytes;
-        
         /* store the new sample rate */
         x->sr = sp[0]->s_sr;
         
-        /* reallocate the delay-line. this process is similar to the one in the new-instance-routine except the function "resizebytes()" instead of "getbytes()" */
-        t_int delay_line_length = (t_int)(x->sr * DELMAX/1000 + 1);
-        x->delay_bytes = (int)(delay_line_length) * sizeof(t_float);
-        x->delay_line = (t_float*)resizebytes((void*)x->delay_line,oldbytes, x->delay_bytes);
-        if(x->delay_line == NULL){
-            error("hsd_vibrato~: cannot reallocate %ld bytes of memory", x->delay_bytes);
+        /* the delay-line needs more samples for the same depth at a higher sample rate. the old content doesn´t fit to the new sample rate anyway, so the delay-line is reset instead of grown: it is cleared with a single memset or replaced by a fresh (already zeroed) one, nothing is copied */
+        if(!hsd_delayline_reset(&x->delay_line, hsd_delayline_samples(x->sr, x->depth_ms))){
+            error("hsd_vibrato~: cannot reallocate the delay-line");
+            // the old delay-line is gone: forget the sample rate, so the next DSP start tries again instead of running without delay-line
+            x->sr = 0;
             return;
         }
-        for (i=0; i<delay_line_length; i++) {
-            x->delay_line[i] =0.0;
-        }
-        x->delay_line_length = delay_line_length;
-        x->write_index = 0;
         
-        // recalculate cycle_length
+        // recalculate depth and cycle_length
+        x->depth = x->sr * x->depth_ms/1000;
         x->cycle_length = x->sr/x->frequency;
         
     }
     
-    /* add the objects signal processing to the signal-chain of puredata */
-    dsp_add(hsd_vibrato_perform,
-            4,
-            x,
-            sp[0]->s_vec,
-            sp[1]->s_vec,
-            sp[0]->s_n);
+    // the tables of the LFO group need room for a whole block
+    x->blocksize = sp[0]->s_n;
+    if (x->lfo && !hsd_lfo_dsp(x->lfo, x->blocksize)) {
+        error("hsd_vibrato~: cannot allocate memory for the LFO group");
+    }
+    
+    /* add the objects signal processing to the signal-chain of puredata. with external modulation, the modulation signal is the second signal vector and the output the third one. without it, no modulation vector is passed (0) */
+    if (x->external) {
+        dsp_add(hsd_vibrato_perform,
+                5,
+                x,
+                sp[0]->s_vec,
+                sp[1]->s_vec,
+                sp[2]->s_vec,
+                sp[0]->s_n);
+    }
+    else {
+        dsp_add(hsd_vibrato_perform,
+                5,
+                x,
+                sp[0]->s_vec,
+                0,
+                sp[1]->s_vec,
+                sp[0]->s_n);
+    }
 }
 
 
@@ -232,33 +309,31 @@ t_int *hsd_vibrato_perform(t_int *w)
 {
     t_hsd_vibrato *x = (t_hsd_vibrato *) (w[1]);            //object data
     t_float *input = (t_float *) (w[2]);                //input-vector
-    t_float *output = (t_float *) (w[3]);               //output-vector
-    t_int n = w[4];                                     //buffer-size
+    t_float *modulation = (t_float *) (w[3]);           //modulation-vector (0, if the internal LFO is used)
+    t_float *output = (t_float *) (w[4]);               //output-vector
+    t_int n = w[5];                                     //buffer-size
     
     /* get needed data from data struct */
-    t_float *delay_line = x->delay_line;
-    t_int read_index = x->read_index;
-    t_int write_index = x->write_index;
-    t_int delay_line_length = (int)(x->delay_line_length);
+    t_float *delay_line = x->delay_line.buffer;
+    t_int write_index = x->delay_line.write_index;
+    t_int mask = x->delay_line.mask;
     t_float depth = x->depth;
     t_float cycle_length = x->cycle_length;
     t_float phase = x->phase;
     t_float feedback = x->feedback;
+    int interpolation = x->interpolation;
+    t_float z_alp = x->z_alp;
+    t_float lfo_cos = x->lfo_cos;
+    t_float lfo_sin = x->lfo_sin;
+    
+    // the sine and cosine of the shared LFO for this block (NULL, if the own LFO is used)
+    t_float *lfo_sin_table = NULL;
+    t_float *lfo_cos_table = NULL;
+    if (!modulation && x->lfo && hsd_lfo_block(x->lfo, x->sr, n)) {
+        lfo_sin_table = x->lfo->sin_table;
+        lfo_cos_table = x->lfo->cos_table;
+    }
     
-    /* init variables need for interpolation */
-    
-    // the next lower integer-value of the delay-length. -> the next accessable array-position
-    t_int idelay;
-    
-    // the factor for the interpolation -> the offset between the real delay-length and the next smaller integer value of the delay-length
-    t_float fraction;
-    
-    // the sample that is stored in the next lower accessable array-position
-    t_float samp1;
-    
-    // the sample that is stored in the next higher accessable array-position
-    t_float samp2;
-
     /* variable for storing the outputsample */
     t_float out_sample;
     
@@ -271,29 +346,46 @@ t_int *hsd_vibrato_perform(t_int *w)
     // delaylength after applying the modulation
     t_float delay_length;
     
-    //the second read index, used to read out the second sample used for interpolation
-    t_int read_index2;
-    
     /* DSP-Loop */
     while (n--) {
         
         
-        /* LFO */
-        theta = phase / cycle_length;
-        
-        //calculate low frequency sinewave
-        lfo = sin(2*PI*theta);
-        
-        //map values from (-1...+1) to (0...+1)
-        lfo = (lfo + 1.0) / 2.0;
-        
-        // increase phase
-        phase++;
-        
-        
-        // reset phase after one period
-        if (phase > cycle_length) {
-            phase = 0;
+        if (modulation) {
+            
+            /* external modulation, clipped to (0...+1) */
+            lfo = *modulation++;
+            if (lfo < 0) {
+                lfo = 0;
+            }
+            if (lfo > 1) {
+                lfo = 1;
+            }
+        }
+        else if (lfo_sin_table) {
+            
+            /* shared LFO, shifted by the phase offset of this vibrato and mapped from (-1...+1) to (0...+1) */
+            lfo = *lfo_sin_table++ * lfo_cos + *lfo_cos_table++ * lfo_sin;
+            lfo = (lfo + 1.0) / 2.0;
+        }
+        else {
+            
+            /* LFO */
+            theta = phase / cycle_length;
+            
+            //calculate low frequency sinewave
+            lfo = sin(2*PI*theta);
+            
+            //map values from (-1...+1) to (0...+1)
+            lfo = (lfo + 1.0) / 2.0;
+            
+            // increase phase
+            phase++;
+            
+            
+            // reset phase after one period
+            if (phase > cycle_length) {
+                phase = 0;
+            }
         }
         
         // calculate delay by appling a sinusoidal modulation between 0 and depth ( 2 samples added for a minumum delay to avoid zero samples delay)
@@ -301,62 +393,40 @@ t_int *hsd_vibrato_perform(t_int *w)
         
         /* delay line */
         
-        // truncate the delay-length, so an array-entry can be accessed with it. (truncate -> round to next lower integer value)
-        idelay = trunc(delay_length);
-        
-        // calculate the factor for interpolation
-        fraction = delay_length - idelay;
-        
-        //set the offset between read & write; wrap it into legal space if needed
-        read_index = write_index - idelay;
-        read_index2 = read_index - 1;
-        while (read_index < 0) {
-            read_index += delay_line_length;
-        }
-        while (read_index2 < 0) {
-            read_index2 += delay_line_length;
-        }
-        
-        
-        // read the two samples for interpolation
-        samp1 = delay_line[read_index];
-        samp2 = delay_line[read_index2];
-        
+        // read the delayed sample, interpolated with the selected interpolation mode (see hsd_library.h)
         //quick buffer delayline-output before reading the input sample, so in case of shared input- and output-buffers, the input sample won´t be the recent written output-sample
-        
-        out_sample = samp1 * fraction + samp2 * (1.0-fraction);
-
-        
-        
+        out_sample = hsd_delayline_read(delay_line, mask, write_index, delay_length, interpolation, &z_alp);
         
         // write the input of the delay line
-        delay_line[write_index++] = *input++ + out_sample*feedback;
+        delay_line[write_index] = *input++ + out_sample*feedback;
         
         *output++ = out_sample;
         
-        //reset the write_index
-        if(write_index >= delay_line_length){
-            write_index -= delay_line_length;
-        }
+        //increment and wrap the write_index
+        write_index = (write_index + 1) & mask;
     }
-    x->write_index = write_index;
+    x->delay_line.write_index = write_index;
     x->phase = phase;
+    x->z_alp = z_alp;
     
-    return w+5;
+    return w+6;
 }
 
 
 /* free function that is called when the object is destroyed */
 void hsd_vibrato_free(t_hsd_vibrato *x)
 {
-    freebytes(x->delay_line, x->delay_bytes);
+    hsd_delayline_free(&x->delay_line);
+    if (x->lfo) {
+        hsd_lfo_leave(x->lfo);
+    }
 }
 
 
 
 
 /* new-instance routine */
-void *hsd_vibrato_new(t_floatarg f1, t_floatarg f2, t_floatarg f3)
+void *hsd_vibrato_new(t_symbol *s, short argc, t_atom *argv)
 {
     t_hsd_vibrato *x = (t_hsd_vibrato *)pd_new(hsd_vibrato_class);
 
@@ -369,6 +439,24 @@ void *hsd_vibrato_new(t_floatarg f1, t_floatarg f2, t_floatarg f3)
     // initialise intermediate variables
     t_float depth_ms, frequency, feedback;
     
+    // the symbol "external" after the numbers replaces the LFO by a modulation signal inlet
+    x->external = 0;
+    if (argc>=1 && argv[argc-1].a_type == A_SYMBOL) {
+        if (atom_getsymbolarg(argc-1, argc, argv) == gensym("external")) {
+            x->external = 1;
+        }
+        else {
+            error("hsd_vibrato~: unknown argument %s", atom_getsymbolarg(argc-1, argc, argv)->s_name);
+        }
+        argc--;
+    }
+    
+    // the numbers (0, if they are missing)
+    t_float f1 = atom_getfloatarg(0, argc, argv);
+    t_float f2 = atom_getfloatarg(1, argc, argv);
+    t_float f3 = atom_getfloatarg(2, argc, argv);
+    t_float f4 = atom_getfloatarg(3, argc, argv);
+    
     // check if arguments have been passed by the user and write it to the intermediate variables. if the argument was not passed, the default value is applied
     if(f1){
         depth_ms = f1;
@@ -388,9 +476,12 @@ void *hsd_vibrato_new(t_floatarg f1, t_floatarg f2, t_floatarg f3)
         feedback = 0; //default no feedback
     }
     
+    // the maximum depth is the fourth creation argument (default DELMAX)
+    x->max_depth_ms = hsd_maxdelay(f4, DELMAX, depth_ms);
+    
     // sanity checking
-    if (depth_ms > DELMAX){
-        depth_ms = DELMAX;
+    if (depth_ms > x->max_depth_ms){
+        depth_ms = x->max_depth_ms;
     }
     if (depth_ms < 0.0){
         depth_ms = 0.0;
@@ -420,27 +511,27 @@ void *hsd_vibrato_new(t_floatarg f1, t_floatarg f2, t_floatarg f3)
     inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("frequency"));
     inlet_new(&x->obj, &x->obj.ob_pd, gensym("float"), gensym("feedback"));
     
+    // the signal inlet for the external modulation. if no signal is connected, it takes floats (a fixed delay between 0 and depth)
+    if (x->external) {
+        signalinlet_new(&x->obj, 0);
+    }
+    
     
     //creating the signal-outlet
     outlet_new(&x->obj, gensym("signal"));
     
     
-    //Allocating the DelayLine
-    t_int delay_line_length = (t_int)(x->sr * DELMAX/1000 + 1);
-    x->delay_bytes = delay_line_length * sizeof(t_float);
-    x->delay_line = (t_float*)getbytes(x->delay_bytes);
-    if(x->delay_line == NULL){
-        error("hsd_vibrato~: cannot allocate %ld bytes of memory", x->delay_bytes);
+    //Allocating the DelayLine, just long enough for the initial depth
+    if(!hsd_delayline_grow(&x->delay_line, hsd_delayline_samples(x->sr, x->depth_ms))){
+        error("hsd_vibrato~: cannot allocate memory for the delay-line");
         return NULL;
     }
-    t_int i;
-    for (i=0; i<delay_line_length; i++) {
-        x->delay_line[i] =0.0;
-    }
     
-    x->delay_line_length = delay_line_length;
-    x->write_index=0;
     x->phase = 0;
+    x->interpolation = HSD_INTERP_LINEAR;
+    x->z_alp = 0;
+    x->lfo = NULL;
+    x->blocksize = 0;
     return x;
 }
 
@@ -452,13 +543,14 @@ void hsd_vibrato_tilde_setup(void){
                                (t_method)hsd_vibrato_free,
                                sizeof(t_hsd_vibrato),
                                0,
-                               A_DEFFLOAT,
-                               A_DEFFLOAT,
-                               A_DEFFLOAT,
+                               A_GIMME,
                                0);
     
     CLASS_MAINSIGNALIN(hsd_vibrato_class, t_hsd_vibrato, x_f);
     
+    // calculate the coefficient table of the interpolation
+    hsd_interp_init();
+    
     
     class_addmethod(hsd_vibrato_class,
                     (t_method)hsd_vibrato_dsp,
@@ -479,6 +571,21 @@ void hsd_vibrato_tilde_setup(void){
                     gensym("feedback"),
                     A_DEFFLOAT,
                     0);
+    class_addmethod(hsd_vibrato_class,
+                    (t_method)hsd_vibrato_interpolation,
+                    gensym("interpolation"),
+                    A_SYMBOL,
+                    0);
+    class_addmethod(hsd_vibrato_class,
+                    (t_method)hsd_vibrato_lfo,
+                    gensym("lfo"),
+                    A_DEFSYMBOL,
+                    A_DEFFLOAT,
+                    0);
+    class_addmethod(hsd_vibrato_class,
+                    (t_method)hsd_vibrato_stats,
+                    gensym("stats"),
+                    0);
     
     
     post ("hsd_vibrato~ by David Bau, HS Duesseldorf ");
@@ -0,0 +1,427 @@
+/* hsd_library.h - shared code of the HSD-Library, University of Applied Science Duesseldorf
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ This header declares the code that is shared between the externals of the library. The functions are implemented in libhsd_library.c, which the Makefile of the library template builds into a shared library ("libhsd_library") and links to every external.
+
+
+ The delay-line (t_hsd_delayline)
+
+ All delay-based externals (hsd_delay~, hsd_comb~, hsd_comblp~, hsd_allpass~, hsd_vibrato~, hsd_chorus~, hsd_dynamics~) use the same ring-buffer, which is described in detail in hsd_delay~.c. The differences to the original implementation are:
+
+    -> the length of the ring-buffer is always a power of two. Wrapping the read- and write-pointers into legal space is then done by a bitwise AND with "mask" (= length-1) instead of comparing and subtracting:
+
+            read_index = (write_index - idelay) & mask;
+
+    -> the ring-buffer is only as long as the current delay time needs it to be ("lazy" sizing). The maximum delay time is a creation argument of each external and only limits how far the buffer is allowed to grow. Growing happens in the message-functions (e.g. "delaytime") and in the dsp-init-routine, never in the perform-routine.
+
+    -> the objects with a fractional (modulated) delay time, hsd_delay~, hsd_vibrato~ and hsd_chorus~, read from the delay-line with the same function, hsd_delayline_read() (see below), which offers several interpolation modes for fractional delays. hsd_comb~, hsd_comblp~ and hsd_allpass~ read their delay with their own linear interpolation between two samples, and hsd_dynamics~ reads whole blocks at an integer delay.
+
+    -> the ring-buffers are not allocated with getbytes(), but come from one arena that is shared by all objects of the library (see below).
+
+    -> a sample rate change (dsp-init-routine) doesn´t copy or zero the buffer sample by sample: hsd_delayline_reset() either clears it with one memset() or replaces it by a fresh calloc()-ed one. this keeps a restart of the DSP short, even with lots of delay objects in a patch.
+
+
+ The delay-bank (t_hsd_delaybank)
+
+ Objects that contain several delay-lines of their own (hsd_combbank~, hsd_diffuser~) don´t use a t_hsd_delayline for each of them, but a delay-bank: all delay-lines have the same length and lie one after the other in a single block of memory from the arena, with one common write-pointer. They grow and reset together, with the same rules as a single delay-line. These objects process the signal vector in chunks that are never longer than their shortest delay, so hsd_delaybank_read() can read the output of a delay-line for a whole chunk at once, in a loop that the compiler can vectorize.
+
+
+ The shared LFO (t_hsd_lfo)
+
+ In ensemble patches, lots of hsd_vibrato~ and hsd_chorus~ objects run their LFOs at the same frequency, each one calculating the same sine wave for itself. With the message "lfo <name> <offset>", an object joins the LFO group of that name instead. A group calculates the sine and cosine of its oscillator only once per DSP tick, for the whole block (the first member whose perform-routine runs in a tick does it, the others find the block already done). Every member reads the block at its own phase offset (in cycles, 0...1), using the addition theorem:
+
+        sin(theta + offset) = sin(theta) * cos(offset) + cos(theta) * sin(offset)
+
+ So the cost of the LFO doesn´t grow with the number of objects anymore, every member just needs two multiplications and one addition per sample. The frequency of a group is set by the frequency inlet of any member and applies to all of them. All members of a group should run with the same block size, otherwise the group is calculated more than once per tick and runs faster. A group is deleted when its last member leaves it ("lfo" without a name) or is deleted.
+
+
+ The arena (hsd_arena_...)
+
+ With hundreds of delay objects in a patch, lots of separate getbytes() calls scatter the ring-buffers all over the heap and fragment it. Therefore all delay memory of the library comes from one arena: big chunks of memory that are requested directly from the operating system and split into blocks of a power of two bytes. Every block is aligned to a cache-line, blocks from 4 kB upwards are aligned to a page. If the library is compiled with -DHSD_ARENA_HUGEPAGES, the chunks are backed by huge pages (MAP_HUGETLB, or madvise() if no huge pages are reserved), which saves a lot of TLB misses when many long delay-lines are read. All delay objects understand the message "stats", which prints the number of bytes the arena has reserved and the number of bytes that are actually used by delay-lines.
+
+
+ Interpolation (hsd_delayline_read)
+
+ If the delay is not an integer number of samples, the output has to be interpolated between the samples in the delay-line. The linear interpolation between two samples is cheap, but it works like a lowpass that changes with the fraction of the delay: a modulated delay (vibrato, chorus) sounds dull and gets some modulation noise in the highs. hsd_delayline_read() offers these modes, selected with the message "interpolation <mode>":
+
+    -> linear: 2 samples, the cheapest one (default)
+    -> lagrange: 3rd order lagrange polynomial through 4 samples. flat up to high frequencies, the best choice for modulated delays
+    -> hermite: 4 samples, 3rd order hermite polynomial (catmull-rom). a little less flat than lagrange, but smoother when the delay is modulated fast
+    -> allpass: 1st order thiran allpass. a flat frequency response without any damping, but the phase of the output depends on the previous output. good for fixed or slowly changing delays, fast modulations produce artifacts
+
+ The coefficients of the 4-tap modes are not calculated for every sample, but read from a table with HSD_INTERP_PHASES+1 rows of 4 coefficients (one row per fraction), which is calculated once by hsd_interp_init(). The output is then just the dot-product of one row of the table and 4 samples of the delay-line.
+
+
+ dB conversion (hsd_db_block, hsd_gain_block)
+
+ The envelope followers (hsd_peakf~, hsd_rmsf~) can send their output in dB instead of a linear level. The logarithm is not calculated with log10() from math.h, but with an approximation that works on the bits of the float:
+
+        x = 2^e * m    (1 <= m < 2)   -->   log2(x) = e + log2(m)
+
+ The exponent e is read directly from the bits of the float, log2(m) is a polynomial of 5th order (error below 0.00002, which is less than 0.0001 dB). Values below the floor are replaced by the floor before the logarithm is taken. This is done with an integer comparison of the bits (for positive floats, the bits are in the same order as the values), so the whole conversion has no branches and no calls, and the compiler can calculate the loop of hsd_db_block() with SIMD instructions.
+
+ The other way round, hsd_gain_block() converts gains in dB to linear factors (hsd_dynamics~). 2^x is split into 2^e * 2^m with the integer part e and the fraction m of x: the bits of 2^e are set directly, 2^m is a polynomial of 5th order (error below 0.0000001).
+
+ */
+
+#ifndef HSD_LIBRARY_H
+#define HSD_LIBRARY_H
+
+#include "m_pd.h"
+#include <string.h>
+#include <stdint.h>
+
+/* the longest delay time in ms that can be set as maximum delay by any external of the library (1 minute) */
+#define HSD_DELAY_LIMIT_MS 60000
+
+/* additional samples that are allocated on top of the delay time, so there is always room for the samples around the read-pointer that are needed for interpolation */
+#define HSD_DELAYLINE_GUARD 4
+
+/* the alignment of every block of the arena (one cache-line) */
+#define HSD_ARENA_ALIGN 64
+
+/* blocks from this size upwards are page aligned */
+#define HSD_ARENA_PAGE 4096
+
+/* returns a block of at least "bytes" bytes of zeroed memory from the arena, or NULL if the memory could not be allocated */
+void *hsd_arena_alloc(size_t bytes);
+
+/* gives a block back to the arena. "bytes" has to be the same size that was used for hsd_arena_alloc() */
+void hsd_arena_free(void *block, size_t bytes);
+
+/* returns the number of bytes the arena has reserved from the operating system and the number of bytes that are handed out as blocks */
+void hsd_arena_getstats(size_t *reserved, size_t *used);
+
+/* prints the statistics of the arena to the pd console. "name" is the name of the object that received the "stats" message */
+void hsd_arena_stats(const char *name);
+
+
+/* data struct of the delay-line */
+typedef struct _hsd_delayline{
+
+    /* the pointer to the ring-buffer itself */
+    t_float *buffer;
+
+    /* the length of the ring-buffer in samples. always a power of two (or zero, if nothing is allocated yet) */
+    t_int length;
+
+    /* length-1. used to wrap the read- and write-pointers into legal space */
+    t_int mask;
+
+    /* the size of the ring-buffer in bytes, needed for freeing the memory again */
+    t_int bytes;
+
+    /* the current position of the write-pointer */
+    t_int write_index;
+
+}t_hsd_delayline;
+
+
+/* the interpolation modes of hsd_delayline_read() */
+#define HSD_INTERP_LINEAR 0
+#define HSD_INTERP_LAGRANGE 1
+#define HSD_INTERP_HERMITE 2
+#define HSD_INTERP_ALLPASS 3
+#define HSD_INTERP_MODES 4
+
+/* the resolution of the coefficient table: the fraction of the delay is rounded to 1/HSD_INTERP_PHASES of a sample */
+#define HSD_INTERP_PHASES 1024
+
+/* the coefficient table, one row of 4 coefficients per fraction and mode. the rows of the 4-tap modes contain the weights for the samples at the delays idelay-1, idelay, idelay+1 and idelay+2. for the allpass mode, the first coefficient is the allpass coefficient for a fraction of 0.1 + row/HSD_INTERP_PHASES */
+extern t_float hsd_interp_table[HSD_INTERP_MODES][HSD_INTERP_PHASES + 1][4];
+
+/* calculates the coefficient table. every object that uses hsd_delayline_read() calls it in its setup routine, only the first call does something */
+void hsd_interp_init(void);
+
+/* returns the interpolation mode that belongs to the name s ("linear", "lagrange", "hermite" or "allpass"), or -1 if there is no such mode */
+int hsd_interp_mode(t_symbol *s);
+
+/* returns the name of an interpolation mode */
+const char *hsd_interp_name(int mode);
+
+/* like hsd_delayline_read() (see below), but for a delay-line that stores the samples of several channels interleaved: one frame of "channels" samples per sample-tick. buffer points to the sample of the wanted channel in the first frame, mask and write_index count frames, not samples. hsd_chorus~ keeps both channels in one interleaved delay-line like this, so the left and right sample of a sample-tick lie next to each other in the same cache-line. */
+static inline t_float hsd_delayline_read_interleaved(const t_float *buffer, t_int mask, t_int write_index, t_float delay, int channels, int interpolation, t_float *state){
+
+    t_int idelay, read_index;
+    t_float fraction, out;
+    const t_float *c;
+
+    switch (interpolation) {
+
+        case HSD_INTERP_LAGRANGE:
+        case HSD_INTERP_HERMITE:
+            if (delay < 2) {
+                delay = 2;
+            }
+            idelay = (t_int)delay;
+            fraction = delay - idelay;
+            c = hsd_interp_table[interpolation][(int)(fraction * HSD_INTERP_PHASES + 0.5)];
+            read_index = write_index - idelay;
+            return c[0] * buffer[((read_index + 1) & mask) * channels]
+                 + c[1] * buffer[(read_index & mask) * channels]
+                 + c[2] * buffer[((read_index - 1) & mask) * channels]
+                 + c[3] * buffer[((read_index - 2) & mask) * channels];
+
+        case HSD_INTERP_ALLPASS:
+            // the fraction is kept between 0.1 and 1.1, where the thiran allpass works best
+            if (delay < 1.1) {
+                delay = 1.1;
+            }
+            idelay = (t_int)(delay - 0.1);
+            fraction = delay - idelay - 0.1;
+            c = hsd_interp_table[HSD_INTERP_ALLPASS][(int)(fraction * HSD_INTERP_PHASES + 0.5)];
+            read_index = write_index - idelay;
+            // y(n) = eta * x(n-idelay) + x(n-idelay-1) - eta * y(n-1)
+            out = c[0] * (buffer[(read_index & mask) * channels] - *state) + buffer[((read_index - 1) & mask) * channels];
+            *state = out;
+            return out;
+
+        default:
+            if (delay < 1) {
+                delay = 1;
+            }
+            idelay = (t_int)delay;
+            fraction = delay - idelay;
+            read_index = write_index - idelay;
+            out = buffer[(read_index & mask) * channels];
+            return out + fraction * (buffer[((read_index - 1) & mask) * channels] - out);
+    }
+}
+
+
+/* reads a sample from the delay-line with a delay of "delay" samples (can be fractional), the samples delay-line[write_index - 1] ... have been written in the last sample-ticks. the buffer, mask and write_index are passed separately, because the perform-routines keep them in local variables. "state" is the filter state of the allpass mode (one per read-pointer, zero at the beginning), the other modes don´t use it.
+ the delay is limited to the smallest delay the mode can do with the samples that are already written (1 sample for linear, 2 samples for the 4-tap modes and 1.1 samples for allpass). */
+static inline t_float hsd_delayline_read(const t_float *buffer, t_int mask, t_int write_index, t_float delay, int interpolation, t_float *state){
+
+    return hsd_delayline_read_interleaved(buffer, mask, write_index, delay, 1, interpolation, state);
+}
+
+
+/* returns the smallest power of two that is greater or equal to n */
+t_int hsd_nextpow2(t_int n);
+
+/* returns the number of samples a delay-line needs to delay a signal by delay_ms at the sample rate sr (including the guard samples for interpolation) */
+t_int hsd_delayline_samples(t_float sr, t_float delay_ms);
+
+/* makes sure the delay-line can hold at least "samples" samples. if the ring-buffer is too short, a new one (next power of two) is allocated from the arena and the content of the old one is copied, so the signal in the delay-line keeps running without a click. returns 0 if the memory could not be allocated */
+int hsd_delayline_grow(t_hsd_delayline *d, t_int samples);
+
+/* like hsd_delayline_grow(), but the content of the delay-line is thrown away (e.g. after a sample rate change). nothing is copied: a delay-line that is long enough is cleared with memset(), a delay-line that is too short is replaced by a new, already zeroed one. returns 0 if the memory could not be allocated */
+int hsd_delayline_reset(t_hsd_delayline *d, t_int samples);
+
+/* sets all values of the delay-line to zero (memset) and resets the write-pointer */
+void hsd_delayline_clear(t_hsd_delayline *d);
+
+/* frees the memory of the delay-line */
+void hsd_delayline_free(t_hsd_delayline *d);
+
+/* a bank of delay-lines of the same length in one block of memory (e.g. the comb filters of hsd_combbank~). delay-line k starts at buffer + k * length, all delay-lines share one write-pointer. objects that process several delay-lines in the same loop only need one pointer to increment and one mask for wrapping, and the memory of all delay-lines lies together */
+typedef struct _hsd_delaybank{
+
+    /* the pointer to the block with all delay-lines */
+    t_float *buffer;
+
+    /* the number of delay-lines */
+    t_int lines;
+
+    /* the length of one delay-line in samples. always a power of two (or zero, if nothing is allocated yet) */
+    t_int length;
+
+    /* length-1. used to wrap the read- and write-pointers into legal space */
+    t_int mask;
+
+    /* the size of the whole block in bytes */
+    t_int bytes;
+
+    /* the current position of the common write-pointer */
+    t_int write_index;
+
+}t_hsd_delaybank;
+
+/* like hsd_delayline_grow() for all delay-lines of the bank: the content of every delay-line is copied into the new block */
+int hsd_delaybank_grow(t_hsd_delaybank *d, t_int samples);
+
+/* like hsd_delayline_reset() for all delay-lines of the bank: the content is thrown away */
+int hsd_delaybank_reset(t_hsd_delaybank *d, t_int samples);
+
+/* sets all values of all delay-lines to zero (one memset) and resets the write-pointer */
+void hsd_delaybank_clear(t_hsd_delaybank *d);
+
+/* frees the memory of the bank */
+void hsd_delaybank_free(t_hsd_delaybank *d);
+
+/* reads n samples from one delay-line of a bank (or any other ring-buffer of a power of two) with a fixed delay of idelay + fraction samples, linearly interpolated like hsd_delayline_read(). the first sample is the one for the sample-tick of write_index. the delay has to be at least n samples (idelay >= n), so all samples that are read have been written before and the samples in "out" don´t depend on each other. the loop is split where the read-pointer wraps around, so every piece runs over contiguous memory and can be calculated with SIMD instructions by the compiler */
+static inline void hsd_delaybank_read(const t_float *line, t_int mask, t_int write_index, t_int idelay, t_float fraction, t_float *out, t_int n){
+
+    // the position of the older one of the two samples (delay idelay+1). the newer one (delay idelay) is the next sample in the delay-line
+    t_int read_index = write_index - idelay - 1;
+    t_int i = 0, run, j;
+    const t_float *older, *newer;
+
+    while (i < n) {
+
+        read_index &= mask;
+
+        // the newer sample is at the beginning of the delay-line again
+        if (read_index == mask) {
+            out[i] = line[0] + fraction * (line[mask] - line[0]);
+            read_index++;
+            i++;
+            continue;
+        }
+
+        // the longest run until the newer sample wraps around
+        run = n - i;
+        if (run > mask - read_index) {
+            run = mask - read_index;
+        }
+
+        older = line + read_index;
+        newer = older + 1;
+        for (j=0; j<run; j++) {
+            out[i + j] = newer[j] + fraction * (older[j] - newer[j]);
+        }
+
+        read_index += run;
+        i += run;
+    }
+}
+
+/* sanity checking for the "maximum delay" creation argument: if it is not set (zero), the default of the external is used, and it is never shorter than the initial delay time and never longer than HSD_DELAY_LIMIT_MS */
+t_float hsd_maxdelay(t_float max_ms, t_float default_ms, t_float delay_ms);
+
+
+/* data struct of a shared LFO group */
+typedef struct _hsd_lfo{
+
+    /* the name of the group */
+    t_symbol *name;
+
+    /* the number of objects in the group */
+    int members;
+
+    /* the frequency of the oscillator in Hz */
+    t_float frequency;
+
+    /* the phase of the oscillator at the beginning of the next block, in cycles (0...1) */
+    double phase;
+
+    /* the sine and cosine of the oscillator for every sample of the current block, and the number of samples they have room for */
+    t_float *sin_table;
+    t_float *cos_table;
+    t_int size;
+
+    /* the logical time and the block size the tables have been calculated for */
+    double stamp;
+    t_int n;
+
+    /* the next group in the list of all groups */
+    struct _hsd_lfo *next;
+
+}t_hsd_lfo;
+
+/* joins the LFO group "name" (it is created with the given frequency, if it doesn´t exist yet) and makes sure its tables have room for blocks of n samples. returns NULL if the memory could not be allocated */
+t_hsd_lfo *hsd_lfo_join(t_symbol *name, t_float frequency, t_int n);
+
+/* leaves the group, the last member deletes it */
+void hsd_lfo_leave(t_hsd_lfo *lfo);
+
+/* makes sure the tables have room for blocks of n samples. called by the dsp-init-routines of the members, so the perform-routines never allocate memory. returns 0 if the memory could not be allocated */
+int hsd_lfo_dsp(t_hsd_lfo *lfo, t_int n);
+
+/* returns 1 and calculates the sine and cosine of the next block of n samples at the sample rate sr, if this hasn´t been done in the current DSP tick yet. returns 0 if the tables are too short for n samples (the member should use its own LFO then) */
+int hsd_lfo_block(t_hsd_lfo *lfo, t_float sr, t_int n);
+
+
+/* the lowest floor of the dB conversion in dB (the smallest normal float is about -758 dB as a power, -379 dB as an amplitude) */
+#define HSD_DB_MIN -300
+
+/* log10(2), to get from log2() to log10() */
+#define HSD_LOG10_2 0.30102999566
+
+/* returns the linear value that belongs to the floor floor_db (in dB, not lower than HSD_DB_MIN). "factor" is 20 for amplitudes and 10 for powers (squared values), like in hsd_db_block() */
+t_float hsd_db_floor(t_float floor_db, t_float factor);
+
+/* returns log2(x) for positive, normal values of x (see above) */
+static inline t_float hsd_log2(t_float x){
+
+    float f = x;
+    uint32_t bits;
+    t_float exponent, m;
+
+    memcpy(&bits, &f, sizeof(bits));
+
+    // the exponent without the bias, and the mantissa with the exponent of 1.0 (1 <= m < 2)
+    exponent = (t_float)((int32_t)(bits >> 23) - 127);
+    bits = (bits & 0x007fffff) | 0x3f800000;
+    memcpy(&f, &bits, sizeof(f));
+    m = f - 1;
+
+    return exponent + m * (1.44196575f + m * (-0.70966559f + m * (0.41760809f + m * (-0.19628861f + m * 0.04639481f))));
+}
+
+/* converts the n values of vec (levels >= 0) to dB in place: factor * log10(vec[i]). "factor" is 20 for amplitudes (peak, rms) and 10 for powers (the squared rms). values below "floor" (a linear value, see hsd_db_floor()) are set to the floor, so the output never goes below it and a level of 0 doesn´t give -infinity */
+static inline void hsd_db_block(t_float *vec, t_int n, t_float factor, t_float floor){
+
+    float f = floor;
+    uint32_t floor_bits, bits;
+    t_float scale = factor * HSD_LOG10_2;
+    t_int i;
+
+    memcpy(&floor_bits, &f, sizeof(floor_bits));
+
+    for (i=0; i<n; i++) {
+        f = vec[i];
+        memcpy(&bits, &f, sizeof(bits));
+        bits = (bits < floor_bits) ? floor_bits : bits;
+        memcpy(&f, &bits, sizeof(f));
+        vec[i] = scale * hsd_log2(f);
+    }
+}
+
+/* returns 2^x for -126 < x < 127 (see above) */
+static inline t_float hsd_exp2(t_float x){
+
+    float f;
+    uint32_t bits;
+    int32_t exponent;
+    t_float shifted = x + 127, m;
+
+    // the exponent with the bias: shifted is always positive, so the conversion to int cuts the fraction off (floor). the fraction (0 <= m < 1) is left for the polynomial
+    exponent = (int32_t)shifted;
+    m = shifted - exponent;
+    bits = (uint32_t)exponent << 23;
+    memcpy(&f, &bits, sizeof(f));
+
+    return f * (1 + m * (0.69315136f + m * (0.24016414f + m * (0.05580049f + m * (0.00901663f + m * 0.00186721f)))));
+}
+
+/* converts the n gains in dB in vec to linear factors in place: 10^(vec[i]/20). the gains must lie between HSD_DB_MIN and -HSD_DB_MIN */
+static inline void hsd_gain_block(t_float *vec, t_int n){
+
+    t_float scale = 1 / (20 * HSD_LOG10_2);
+    t_int i;
+
+    for (i=0; i<n; i++) {
+        vec[i] = hsd_exp2(scale * vec[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,659 @@
+/* libhsd_library.c - shared code of the HSD-Library, University of Applied Science Duesseldorf
+
+ *******************
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************
+
+
+ The implementation of the shared functions declared in hsd_library.h. The Makefile of the library template picks up this file automatically (SHARED_SOURCE), builds it into a shared library and links it to every external.
+
+ */
+
+#include "hsd_library.h"
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* the arena                                                                                                         */
+/* ---------------------------------------------------------------------------------------------------------------- */
+
+/* the memory of the arena comes in chunks of HSD_ARENA_CHUNK bytes straight from the operating system (mmap / VirtualAlloc), so it is always page aligned. inside a chunk the blocks are handed out one after the other ("bump pointer"). every block has a size of a power of two and is at least one cache-line long, so there is one free-list per size class: a freed block is put on the list of its size class and handed out again the next time a block of this size is needed. the chunks themselves are never given back to the operating system.
+ blocks that are bigger than half a chunk get their own mapping and are given back to the operating system when they are freed. */
+
+/* the size of a chunk (2 MB, which is also the size of a huge page on x86 and arm64) */
+#define HSD_ARENA_CHUNK (2*1024*1024)
+
+/* the number of size classes: 2^0 ... 2^(HSD_ARENA_CLASSES-1) bytes. only the classes from HSD_ARENA_ALIGN up to HSD_ARENA_CHUNK/2 are really used */
+#define HSD_ARENA_CLASSES 32
+
+/* a free block stores the pointer to the next free block of its size class in its first bytes */
+typedef struct _hsd_arena_freeblock{
+    struct _hsd_arena_freeblock *next;
+}t_hsd_arena_freeblock;
+
+/* the state of the arena. there is only one arena for all objects of the library, pd creates and deletes objects (and calls the dsp-init-routines) from one thread only */
+static struct{
+
+    /* the chunk that is currently used for new blocks and the position of the bump pointer inside it */
+    char *chunk;
+    size_t chunk_used;
+
+    /* one free-list per size class */
+    t_hsd_arena_freeblock *freelist[HSD_ARENA_CLASSES];
+
+    /* statistics */
+    size_t reserved;
+    size_t used;
+    size_t chunks;
+
+}hsd_arena;
+
+
+/* returns the size class (log2) of a block of "bytes" bytes */
+static int hsd_arena_class(size_t bytes){
+
+    int c = 0;
+    while (((size_t)1 << c) < bytes) {
+        c++;
+    }
+    return c;
+}
+
+/* gets "bytes" of fresh, zeroed and page aligned memory from the operating system */
+static void *hsd_arena_map(size_t bytes){
+
+    void *mem;
+#ifdef _WIN32
+    mem = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    mem = MAP_FAILED;
+#if defined(HSD_ARENA_HUGEPAGES) && defined(MAP_HUGETLB)
+    // explicit huge pages have to be reserved by the system administrator (vm.nr_hugepages). if there are none, fall back to normal pages
+    if (bytes % HSD_ARENA_CHUNK == 0) {
+        mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (mem == MAP_FAILED) {
+        mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(HSD_ARENA_HUGEPAGES) && defined(MADV_HUGEPAGE)
+        // ask for transparent huge pages instead
+        if (mem != MAP_FAILED) {
+            madvise(mem, bytes, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    if (mem == MAP_FAILED) {
+        mem = NULL;
+    }
+#endif
+    if (mem != NULL) {
+        hsd_arena.reserved += bytes;
+    }
+    return mem;
+}
+
+/* gives memory that was mapped by hsd_arena_map() back to the operating system */
+static void hsd_arena_unmap(void *mem, size_t bytes){
+
+#ifdef _WIN32
+    VirtualFree(mem, 0, MEM_RELEASE);
+#else
+    munmap(mem, bytes);
+#endif
+    hsd_arena.reserved -= bytes;
+}
+
+void *hsd_arena_alloc(size_t bytes){
+
+    int c;
+    size_t size, align;
+    void *block;
+
+    if (bytes == 0) {
+        return NULL;
+    }
+
+    // every block is a power of two and at least one cache-line long
+    c = hsd_arena_class(bytes < HSD_ARENA_ALIGN ? HSD_ARENA_ALIGN : bytes);
+    size = (size_t)1 << c;
+
+    // big blocks get their own mapping (rounded up to whole chunks, so huge pages fit)
+    if (size > HSD_ARENA_CHUNK/2) {
+        size = (size + HSD_ARENA_CHUNK - 1) & ~((size_t)HSD_ARENA_CHUNK - 1);
+        block = hsd_arena_map(size);
+        if (block != NULL) {
+            hsd_arena.used += size;
+        }
+        return block;
+    }
+
+    // is there a free block of this size class? it has to be zeroed again, because it was used before
+    if (hsd_arena.freelist[c] != NULL) {
+        block = hsd_arena.freelist[c];
+        hsd_arena.freelist[c] = hsd_arena.freelist[c]->next;
+        memset(block, 0, size);
+        hsd_arena.used += size;
+        return block;
+    }
+
+    /* otherwise take it from the current chunk. small blocks are aligned to their own size, blocks from a page upwards are page aligned. the memory is still untouched and therefore already zeroed by the operating system */
+    align = size < HSD_ARENA_PAGE ? size : HSD_ARENA_PAGE;
+    hsd_arena.chunk_used = (hsd_arena.chunk_used + align - 1) & ~(align - 1);
+    if (hsd_arena.chunk == NULL || hsd_arena.chunk_used + size > HSD_ARENA_CHUNK) {
+        // the rest of the old chunk is lost, but it is never more than one block of this size
+        char *chunk = (char*)hsd_arena_map(HSD_ARENA_CHUNK);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        hsd_arena.chunk = chunk;
+        hsd_arena.chunk_used = 0;
+        hsd_arena.chunks++;
+    }
+    block = hsd_arena.chunk + hsd_arena.chunk_used;
+    hsd_arena.chunk_used += size;
+    hsd_arena.used += size;
+    return block;
+}
+
+void hsd_arena_free(void *block, size_t bytes){
+
+    int c;
+    size_t size;
+
+    if (block == NULL || bytes == 0) {
+        return;
+    }
+
+    c = hsd_arena_class(bytes < HSD_ARENA_ALIGN ? HSD_ARENA_ALIGN : bytes);
+    size = (size_t)1 << c;
+
+    // big blocks go back to the operating system
+    if (size > HSD_ARENA_CHUNK/2) {
+        size = (size + HSD_ARENA_CHUNK - 1) & ~((size_t)HSD_ARENA_CHUNK - 1);
+        hsd_arena_unmap(block, size);
+        hsd_arena.used -= size;
+        return;
+    }
+
+    // small blocks are put on the free-list of their size class
+    ((t_hsd_arena_freeblock*)block)->next = hsd_arena.freelist[c];
+    hsd_arena.freelist[c] = (t_hsd_arena_freeblock*)block;
+    hsd_arena.used -= size;
+}
+
+void hsd_arena_getstats(size_t *reserved, size_t *used){
+
+    *reserved = hsd_arena.reserved;
+    *used = hsd_arena.used;
+}
+
+void hsd_arena_stats(const char *name){
+
+    post("%s: hsd_library delay memory: %lu bytes reserved (%lu chunks of %d bytes + big blocks), %lu bytes used",
+         name,
+         (unsigned long)hsd_arena.reserved,
+         (unsigned long)hsd_arena.chunks,
+         HSD_ARENA_CHUNK,
+         (unsigned long)hsd_arena.used);
+}
+
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* interpolation                                                                                                     */
+/* ---------------------------------------------------------------------------------------------------------------- */
+
+t_float hsd_interp_table[HSD_INTERP_MODES][HSD_INTERP_PHASES + 1][4];
+
+void hsd_interp_init(void){
+
+    static int done = 0;
+    int i;
+    double f, eta;
+    t_float *c;
+
+    if (done) {
+        return;
+    }
+    done = 1;
+
+    for (i=0; i<=HSD_INTERP_PHASES; i++) {
+
+        f = (double)i / HSD_INTERP_PHASES;
+
+        // linear: only needed for completeness, hsd_delayline_read() calculates it directly
+        c = hsd_interp_table[HSD_INTERP_LINEAR][i];
+        c[0] = 0;
+        c[1] = 1 - f;
+        c[2] = f;
+        c[3] = 0;
+
+        /* lagrange: the polynomial through the 4 points at the positions -1, 0, 1 and 2, evaluated at the position f */
+        c = hsd_interp_table[HSD_INTERP_LAGRANGE][i];
+        c[0] = -f * (f - 1) * (f - 2) / 6;
+        c[1] = (f + 1) * (f - 1) * (f - 2) / 2;
+        c[2] = -(f + 1) * f * (f - 2) / 2;
+        c[3] = (f + 1) * f * (f - 1) / 6;
+
+        /* hermite: the catmull-rom spline between the points at 0 and 1, the slopes are taken from the outer points */
+        c = hsd_interp_table[HSD_INTERP_HERMITE][i];
+        c[0] = -0.5*f + f*f - 0.5*f*f*f;
+        c[1] = 1 - 2.5*f*f + 1.5*f*f*f;
+        c[2] = 0.5*f + 2*f*f - 1.5*f*f*f;
+        c[3] = -0.5*f*f + 0.5*f*f*f;
+
+        /* allpass: the first order thiran allpass has a delay of (1-eta)/(1+eta) samples at low frequencies. the fraction runs from 0.1 to 1.1 */
+        eta = (1 - (f + 0.1)) / (1 + (f + 0.1));
+        c = hsd_interp_table[HSD_INTERP_ALLPASS][i];
+        c[0] = eta;
+        c[1] = 0;
+        c[2] = 0;
+        c[3] = 0;
+    }
+}
+
+int hsd_interp_mode(t_symbol *s){
+
+    int mode;
+    for (mode=0; mode<HSD_INTERP_MODES; mode++) {
+        if (!strcmp(s->s_name, hsd_interp_name(mode))) {
+            return mode;
+        }
+    }
+    return -1;
+}
+
+const char *hsd_interp_name(int mode){
+
+    switch (mode) {
+        case HSD_INTERP_LAGRANGE: return "lagrange";
+        case HSD_INTERP_HERMITE: return "hermite";
+        case HSD_INTERP_ALLPASS: return "allpass";
+        default: return "linear";
+    }
+}
+
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* the delay-line                                                                                                    */
+/* ---------------------------------------------------------------------------------------------------------------- */
+
+
+/* returns the smallest power of two that is greater or equal to n */
+t_int hsd_nextpow2(t_int n){
+
+    t_int pow2 = 1;
+    while (pow2 < n) {
+        pow2 <<= 1;
+    }
+    return pow2;
+}
+
+/* returns the number of samples needed for a delay of delay_ms at the sample rate sr */
+t_int hsd_delayline_samples(t_float sr, t_float delay_ms){
+
+    return (t_int)ceil(sr * delay_ms/1000) + HSD_DELAYLINE_GUARD;
+}
+
+/* makes sure the delay-line can hold at least "samples" samples */
+int hsd_delayline_grow(t_hsd_delayline *d, t_int samples){
+
+    t_int length = hsd_nextpow2(samples);
+    t_int bytes;
+    t_float *buffer;
+
+    // the delay-line is already long enough, nothing to do
+    if (length <= d->length) {
+        return 1;
+    }
+
+    // allocate the new ring-buffer. the arena returns zeroed memory
+    bytes = length * sizeof(t_float);
+    buffer = (t_float*)hsd_arena_alloc(bytes);
+    if (buffer == NULL) {
+        return 0;
+    }
+
+    /* copy the old content. the samples behind the write-pointer are copied to the end of the new buffer, the samples in front of it stay at the beginning. this way the write-pointer keeps its position and every sample keeps its distance to it:
+
+        old:  |  0 ... write_index-1  | write_index ... oldlength-1 |
+        new:  |  0 ... write_index-1  |    (zeros)    | write_index ... oldlength-1 |
+     */
+    if (d->buffer != NULL) {
+        t_int tail = d->length - d->write_index;
+        memcpy(buffer, d->buffer, d->write_index * sizeof(t_float));
+        memcpy(buffer + length - tail, d->buffer + d->write_index, tail * sizeof(t_float));
+        hsd_arena_free(d->buffer, d->bytes);
+    }
+
+    d->buffer = buffer;
+    d->length = length;
+    d->mask = length - 1;
+    d->bytes = bytes;
+
+    return 1;
+}
+
+/* makes sure the delay-line can hold at least "samples" samples and throws away its content */
+int hsd_delayline_reset(t_hsd_delayline *d, t_int samples){
+
+    t_int length = hsd_nextpow2(samples);
+    t_int bytes;
+    t_float *buffer;
+
+    // the delay-line is already long enough, a single memset is all we need
+    if (length <= d->length) {
+        hsd_delayline_clear(d);
+        return 1;
+    }
+
+    /* the old content is thrown away anyway, so there is nothing to copy: free the old buffer first (this keeps the memory peak low) and get a new one. the arena hands out memory that is already zeroed (fresh pages from the operating system or one memset of a recycled block), so there is no second pass over the buffer */
+    hsd_delayline_free(d);
+    bytes = length * sizeof(t_float);
+    buffer = (t_float*)hsd_arena_alloc(bytes);
+    if (buffer == NULL) {
+        return 0;
+    }
+
+    d->buffer = buffer;
+    d->length = length;
+    d->mask = length - 1;
+    d->bytes = bytes;
+
+    return 1;
+}
+
+/* sets all values of the delay-line to zero and resets the write-pointer */
+void hsd_delayline_clear(t_hsd_delayline *d){
+
+    if (d->buffer != NULL) {
+        memset(d->buffer, 0, d->length * sizeof(t_float));
+    }
+    d->write_index = 0;
+}
+
+/* frees the memory of the delay-line */
+void hsd_delayline_free(t_hsd_delayline *d){
+
+    if (d->buffer != NULL) {
+        hsd_arena_free(d->buffer, d->bytes);
+    }
+    d->buffer = NULL;
+    d->length = 0;
+    d->mask = 0;
+    d->bytes = 0;
+    d->write_index = 0;
+}
+
+/* makes sure every delay-line of the bank can hold at least "samples" samples, copying the content like hsd_delayline_grow() */
+int hsd_delaybank_grow(t_hsd_delaybank *d, t_int samples){
+
+    t_int length = hsd_nextpow2(samples);
+    t_int tail = d->length - d->write_index;
+    t_int bytes;
+    t_float *buffer;
+    int k;
+
+    // the delay-lines are already long enough, nothing to do
+    if (length <= d->length) {
+        return 1;
+    }
+
+    // allocate the new block. the arena returns zeroed memory
+    bytes = d->lines * length * sizeof(t_float);
+    buffer = (t_float*)hsd_arena_alloc(bytes);
+    if (buffer == NULL) {
+        return 0;
+    }
+
+    // copy the old content, delay-line by delay-line, the same way as hsd_delayline_grow() does
+    if (d->buffer != NULL) {
+        for (k=0; k<d->lines; k++) {
+            memcpy(buffer + k * length, d->buffer + k * d->length, d->write_index * sizeof(t_float));
+            memcpy(buffer + (k+1) * length - tail, d->buffer + k * d->length + d->write_index, tail * sizeof(t_float));
+        }
+        hsd_arena_free(d->buffer, d->bytes);
+    }
+
+    d->buffer = buffer;
+    d->length = length;
+    d->mask = length - 1;
+    d->bytes = bytes;
+
+    return 1;
+}
+
+/* makes sure every delay-line of the bank can hold at least "samples" samples and throws away the content, like hsd_delayline_reset() */
+int hsd_delaybank_reset(t_hsd_delaybank *d, t_int samples){
+
+    t_int length = hsd_nextpow2(samples);
+    t_int lines = d->lines;
+    t_int bytes;
+    t_float *buffer;
+
+    // the delay-lines are already long enough, a single memset is all we need
+    if (length <= d->length) {
+        hsd_delaybank_clear(d);
+        return 1;
+    }
+
+    // nothing to copy: free the old block first and get a new, already zeroed one
+    hsd_delaybank_free(d);
+    d->lines = lines;
+    bytes = lines * length * sizeof(t_float);
+    buffer = (t_float*)hsd_arena_alloc(bytes);
+    if (buffer == NULL) {
+        return 0;
+    }
+
+    d->buffer = buffer;
+    d->length = length;
+    d->mask = length - 1;
+    d->bytes = bytes;
+
+    return 1;
+}
+
+/* sets all values of all delay-lines of the bank to zero and resets the write-pointer */
+void hsd_delaybank_clear(t_hsd_delaybank *d){
+
+    if (d->buffer != NULL) {
+        memset(d->buffer, 0, d->bytes);
+    }
+    d->write_index = 0;
+}
+
+/* frees the memory of the bank. the number of delay-lines is kept */
+void hsd_delaybank_free(t_hsd_delaybank *d){
+
+    if (d->buffer != NULL) {
+        hsd_arena_free(d->buffer, d->bytes);
+    }
+    d->buffer = NULL;
+    d->length = 0;
+    d->mask = 0;
+    d->bytes = 0;
+    d->write_index = 0;
+}
+
+/* sanity checking for the "maximum delay" creation argument */
+t_float hsd_maxdelay(t_float max_ms, t_float default_ms, t_float delay_ms){
+
+    if (max_ms <= 0) {
+        max_ms = default_ms;
+    }
+    if (max_ms < delay_ms) {
+        max_ms = delay_ms;
+    }
+    if (max_ms > HSD_DELAY_LIMIT_MS) {
+        error("hsd_library: maximum delay time of %f ms is too long, using %d ms", max_ms, HSD_DELAY_LIMIT_MS);
+        max_ms = HSD_DELAY_LIMIT_MS;
+    }
+    return max_ms;
+}
+
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* the shared LFO                                                                                                    */
+/* ---------------------------------------------------------------------------------------------------------------- */
+
+#define HSD_LFO_TWOPI 6.283185307179586
+
+/* the list of all LFO groups. like the arena, it is only used from the one thread that creates and deletes objects and runs the DSP */
+static t_hsd_lfo *hsd_lfo_list = NULL;
+
+/* joins the LFO group "name", the group is created if it doesn´t exist yet */
+t_hsd_lfo *hsd_lfo_join(t_symbol *name, t_float frequency, t_int n){
+
+    t_hsd_lfo *lfo;
+
+    for (lfo = hsd_lfo_list; lfo != NULL; lfo = lfo->next) {
+        if (lfo->name == name) {
+            break;
+        }
+    }
+
+    if (lfo == NULL) {
+        lfo = (t_hsd_lfo *)getbytes(sizeof(t_hsd_lfo));
+        if (lfo == NULL) {
+            return NULL;
+        }
+        lfo->name = name;
+        lfo->members = 0;
+        lfo->frequency = frequency;
+        lfo->phase = 0;
+        lfo->sin_table = NULL;
+        lfo->cos_table = NULL;
+        lfo->size = 0;
+        lfo->stamp = -1;
+        lfo->n = 0;
+        lfo->next = hsd_lfo_list;
+        hsd_lfo_list = lfo;
+    }
+
+    lfo->members++;
+    if (!hsd_lfo_dsp(lfo, n)) {
+        hsd_lfo_leave(lfo);
+        return NULL;
+    }
+    return lfo;
+}
+
+/* leaves the group, the last member deletes it */
+void hsd_lfo_leave(t_hsd_lfo *lfo){
+
+    t_hsd_lfo **p;
+
+    if (--lfo->members > 0) {
+        return;
+    }
+
+    for (p = &hsd_lfo_list; *p != NULL; p = &(*p)->next) {
+        if (*p == lfo) {
+            *p = lfo->next;
+            break;
+        }
+    }
+    if (lfo->sin_table != NULL) {
+        freebytes(lfo->sin_table, lfo->size * sizeof(t_float));
+        freebytes(lfo->cos_table, lfo->size * sizeof(t_float));
+    }
+    freebytes(lfo, sizeof(t_hsd_lfo));
+}
+
+/* makes sure the tables have room for blocks of n samples */
+int hsd_lfo_dsp(t_hsd_lfo *lfo, t_int n){
+
+    t_float *sin_table, *cos_table;
+
+    if (n <= lfo->size) {
+        return 1;
+    }
+
+    sin_table = (t_float *)getbytes(n * sizeof(t_float));
+    cos_table = (t_float *)getbytes(n * sizeof(t_float));
+    if (sin_table == NULL || cos_table == NULL) {
+        if (sin_table != NULL) {
+            freebytes(sin_table, n * sizeof(t_float));
+        }
+        if (cos_table != NULL) {
+            freebytes(cos_table, n * sizeof(t_float));
+        }
+        return 0;
+    }
+    if (lfo->sin_table != NULL) {
+        freebytes(lfo->sin_table, lfo->size * sizeof(t_float));
+        freebytes(lfo->cos_table, lfo->size * sizeof(t_float));
+    }
+    lfo->sin_table = sin_table;
+    lfo->cos_table = cos_table;
+    lfo->size = n;
+
+    // the new tables are empty, so the next block has to be calculated in any case
+    lfo->stamp = -1;
+    return 1;
+}
+
+/* calculates the next block of the oscillator, once per DSP tick */
+int hsd_lfo_block(t_hsd_lfo *lfo, t_float sr, t_int n){
+
+    double now = clock_getlogicaltime();
+    double phase = lfo->phase;
+    double increment = lfo->frequency / sr;
+    t_int i;
+
+    if (n > lfo->size) {
+        return 0;
+    }
+
+    // another member has already calculated this block
+    if (now == lfo->stamp && n == lfo->n) {
+        return 1;
+    }
+
+    for (i=0; i<n; i++) {
+        lfo->sin_table[i] = sin(HSD_LFO_TWOPI*phase);
+        lfo->cos_table[i] = cos(HSD_LFO_TWOPI*phase);
+        phase += increment;
+        if (phase >= 1) {
+            phase -= 1;
+        }
+    }
+
+    lfo->phase = phase;
+    lfo->stamp = now;
+    lfo->n = n;
+    return 1;
+}
+
+
+/* ---------------------------------------------------------------------------------------------------------------- */
+/* dB conversion                                                                                                     */
+/* ---------------------------------------------------------------------------------------------------------------- */
+
+t_float hsd_db_floor(t_float floor_db, t_float factor){
+
+    if (floor_db < HSD_DB_MIN) {
+        floor_db = HSD_DB_MIN;
+    }
+    return pow(10, floor_db / factor);
+}